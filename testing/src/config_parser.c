@@ -5,15 +5,56 @@
  * with support for multiple data types, nested structures, and validation.
  */
 
+#define _DEFAULT_SOURCE
+
 #include "config_parser.h"
+#include <strings.h>
 #include <stdarg.h>
 #include <limits.h>
 #include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <sched.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+/* SSSE3 code is compiled for any x86 target and chosen at run time */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_SSSE3_DISPATCH
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#include <tmmintrin.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* Ordered accesses to fields shared with snapshot readers */
+#define LOAD_ACQUIRE(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(field, val) __atomic_store_n(&(field), (val), __ATOMIC_RELEASE)
+
+/* States of ConfigEntry.coerce_state; READY carries the cached target type */
+#define COERCE_EMPTY 0u
+#define COERCE_FILLING 1u
+#define COERCE_READY(type) (2u + (unsigned)(type))
 
 /* ========================================================================
  * Parser Initialization and Cleanup
  * ======================================================================== */
 
+static void prefix_index_clear(ParserContext *ctx);
+static void release_sources(ParserContext *ctx);
+
 ParserContext* parser_init(bool strict_mode) {
     ParserContext *ctx = (ParserContext*)malloc(sizeof(ParserContext));
     if (!ctx) {
@@ -21,8 +62,75 @@ ParserContext* parser_init(bool strict_mode) {
     }
     
     ctx->entries = NULL;
+    ctx->entries_tail = NULL;
+    ctx->index = NULL;
+    ctx->index_size = 0;
+    ctx->interpolated_count = 0;
+    ctx->unexpanded = false;
+    ctx->prefix_index = NULL;
+    ctx->prefix_index_count = 0;
+    ctx->section_index = NULL;
+    ctx->section_index_count = 0;
+    ctx->prefix_index_dirty = false;
+    ctx->tree = NULL;
+    ctx->build_tree = false;
+    ctx->tree_dirty = false;
+    ctx->frozen_block = NULL;
+    ctx->frozen_size = 0;
+    ctx->frozen = false;
+    ctx->cache_dir = NULL;
+    ctx->cache_max_bytes = 0;
+    ctx->from_cache = false;
+    ctx->borrow_threshold = 0;
+    ctx->pending_kind = PENDING_NONE;
+    ctx->pending_key = NULL;
+    ctx->pending_tag = NULL;
+    ctx->pending_text = (StrBuf){NULL, 0, 0};
+    ctx->pending_has_text = false;
+    ctx->pending_line = 0;
+    ctx->sources = NULL;
+    ctx->value_pool = NULL;
+    ctx->intern_values = false;
+    ctx->coerce_values = false;
+    ctx->case_insensitive = false;
+    ctx->duplicate_policy = CONFIG_DUP_KEEP_ALL;
+    ctx->validate_utf8 = false;
+    memset(ctx->literals, 0, sizeof(ctx->literals));
+    ctx->epoch = 0;
+    memset(ctx->snapshot_slots, 0, sizeof(ctx->snapshot_slots));
+    ctx->resizing = 0;
+    ctx->retired = NULL;
+    ctx->retired_dependents = false;
+    ctx->journal_fd = -1;
+    ctx->journal_path = NULL;
+    ctx->journal_sync = false;
+    ctx->compactor_running = false;
+    ctx->compactor_base_path = NULL;
+    ctx->compactor_interval = 0;
+    ctx->compactor_min_bytes = 0;
+    content_hash_init(&ctx->raw_hasher, 0);
+    ctx->raw_hash = content_hash_digest(&ctx->raw_hasher);
+    ctx->canonical_hash = 0;
+    ctx->subscriptions = NULL;
+    ctx->next_subscription_id = 1;
+    if (pthread_mutex_init(&ctx->write_lock, NULL) != 0) {
+        free(ctx);
+        return NULL;
+    }
+    if (pthread_mutex_init(&ctx->compactor_lock, NULL) != 0) {
+        pthread_mutex_destroy(&ctx->write_lock);
+        free(ctx);
+        return NULL;
+    }
+    if (pthread_cond_init(&ctx->compactor_wake, NULL) != 0) {
+        pthread_mutex_destroy(&ctx->compactor_lock);
+        pthread_mutex_destroy(&ctx->write_lock);
+        free(ctx);
+        return NULL;
+    }
     ctx->current_section = NULL;
     ctx->entry_count = 0;
+    ctx->max_entries = MAX_CONFIG_ENTRIES;
     ctx->line_number = 0;
     ctx->strict_mode = strict_mode;
     memset(ctx->error_message, 0, sizeof(ctx->error_message));
@@ -33,17 +141,60 @@ ParserContext* parser_init(bool strict_mode) {
 void parser_free(ParserContext *ctx) {
     if (!ctx) return;
     
-    ConfigEntry *current = ctx->entries;
-    while (current) {
-        ConfigEntry *next = current->next;
-        free_entry(current);
-        current = next;
+    config_journal_close(ctx);
+    
+    while (ctx->subscriptions) {
+        ConfigSubscription *next = ctx->subscriptions->next;
+        free(ctx->subscriptions->section);
+        free(ctx->subscriptions->pattern);
+        free(ctx->subscriptions);
+        ctx->subscriptions = next;
+    }
+    
+    for (size_t bucket = 0; bucket < CONFIG_LITERAL_BUCKETS; bucket++) {
+        while (ctx->literals[bucket]) {
+            ConfigLiteral *next = ctx->literals[bucket]->next;
+            free(ctx->literals[bucket]->word);
+            free_value(ctx->literals[bucket]->value);
+            free(ctx->literals[bucket]);
+            ctx->literals[bucket] = next;
+        }
+    }
+    
+    if (ctx->frozen) {
+        // Entries, values and the index all live in the frozen block
+        munmap(ctx->frozen_block, ctx->frozen_size);
+    } else {
+        ConfigEntry *current = ctx->entries;
+        while (current) {
+            ConfigEntry *next = current->next;
+            free_entry(current);
+            current = next;
+        }
+        free(ctx->index);
+        
+        while (ctx->retired) {
+            ConfigEntry *next = ctx->retired->retired_next;
+            free_entry(ctx->retired);
+            ctx->retired = next;
+        }
     }
     
     if (ctx->current_section) {
         free(ctx->current_section);
     }
     
+    free(ctx->pending_key);
+    free(ctx->pending_tag);
+    free(ctx->pending_text.data);
+    prefix_index_clear(ctx);
+    config_tree_free(ctx->tree);
+    string_pool_free(ctx->value_pool);
+    free(ctx->cache_dir);
+    release_sources(ctx);
+    pthread_cond_destroy(&ctx->compactor_wake);
+    pthread_mutex_destroy(&ctx->compactor_lock);
+    pthread_mutex_destroy(&ctx->write_lock);
     free(ctx);
 }
 
@@ -61,6 +212,21 @@ ConfigEntry* create_entry(const char *key, ConfigValue *value, const char *secti
     entry->value = value;
     entry->section = section ? strdup(section) : NULL;
     entry->next = NULL;
+    entry->prev = NULL;
+    entry->born = 0;
+    entry->died = ENTRY_LIVE;
+    entry->unlinked = 0;
+    entry->retired_next = NULL;
+    entry->hash = 0;
+    entry->hash_next = NULL;
+    entry->raw_value = NULL;
+    entry->interp_state = INTERP_NONE;
+    entry->mark = 0;
+    entry->dependents = NULL;
+    entry->dependent_count = 0;
+    entry->dependent_capacity = 0;
+    entry->coerce_status = CONFIG_OK;
+    entry->coerce_state = COERCE_EMPTY;
     
     return entry;
 }
@@ -71,29 +237,527 @@ void free_entry(ConfigEntry *entry) {
     if (entry->key) free(entry->key);
     if (entry->section) free(entry->section);
     if (entry->value) free_value(entry->value);
+    free(entry->raw_value);
+    free(entry->dependents);
     free(entry);
 }
 
-void add_entry(ParserContext *ctx, ConfigEntry *entry) {
-    if (!ctx || !entry) return;
+/* ========================================================================
+ * Content Fingerprint
+ * ======================================================================== */
+
+/*
+ * XXH64, fed incrementally while parsing. raw_hash covers the bytes of the
+ * input; canonical_hash is the wrapping sum of one hash per live entry over
+ * (section, key, type, value), so it ignores order, formatting and
+ * comments and is kept current by config_set/config_remove.
+ */
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3 0x165667B19E3779F9ULL
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5 0x27D4EB2F165667C5ULL
+
+static uint64_t xxh_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t xxh_read64(const unsigned char *p) {
+    uint64_t val = 0;
+    for (int i = 7; i >= 0; i--) {
+        val = (val << 8) | p[i];
+    }
+    return val;
+}
+
+static uint32_t xxh_read32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME2;
+    acc = xxh_rotl(acc, 31);
+    return acc * XXH_PRIME1;
+}
+
+static uint64_t xxh_merge_round(uint64_t acc, uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+void content_hash_init(ContentHasher *hasher, uint64_t seed) {
+    hasher->acc[0] = seed + XXH_PRIME1 + XXH_PRIME2;
+    hasher->acc[1] = seed + XXH_PRIME2;
+    hasher->acc[2] = seed;
+    hasher->acc[3] = seed - XXH_PRIME1;
+    hasher->total_len = 0;
+    hasher->buffered = 0;
+    hasher->seed = seed;
+}
+
+void content_hash_update(ContentHasher *hasher, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char*)data;
+    hasher->total_len += len;
+    
+    if (hasher->buffered + len < 32) {
+        memcpy(hasher->buffer + hasher->buffered, p, len);
+        hasher->buffered += len;
+        return;
+    }
+    
+    if (hasher->buffered) {
+        size_t fill = 32 - hasher->buffered;
+        memcpy(hasher->buffer + hasher->buffered, p, fill);
+        for (int i = 0; i < 4; i++) {
+            hasher->acc[i] = xxh_round(hasher->acc[i], xxh_read64(hasher->buffer + i * 8));
+        }
+        p += fill;
+        len -= fill;
+        hasher->buffered = 0;
+    }
+    
+    // Whole stripes straight from the input
+    while (len >= 32) {
+        for (int i = 0; i < 4; i++) {
+            hasher->acc[i] = xxh_round(hasher->acc[i], xxh_read64(p + i * 8));
+        }
+        p += 32;
+        len -= 32;
+    }
+    
+    memcpy(hasher->buffer, p, len);
+    hasher->buffered = len;
+}
+
+uint64_t content_hash_digest(const ContentHasher *hasher) {
+    uint64_t h;
+    
+    if (hasher->total_len >= 32) {
+        h = xxh_rotl(hasher->acc[0], 1) + xxh_rotl(hasher->acc[1], 7) +
+            xxh_rotl(hasher->acc[2], 12) + xxh_rotl(hasher->acc[3], 18);
+        for (int i = 0; i < 4; i++) {
+            h = xxh_merge_round(h, hasher->acc[i]);
+        }
+    } else {
+        h = hasher->seed + XXH_PRIME5;
+    }
+    
+    h += hasher->total_len;
+    
+    const unsigned char *p = hasher->buffer;
+    size_t len = hasher->buffered;
+    while (len >= 8) {
+        h ^= xxh_round(0, xxh_read64(p));
+        h = xxh_rotl(h, 27) * XXH_PRIME1 + XXH_PRIME4;
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        h ^= (uint64_t)xxh_read32(p) * XXH_PRIME1;
+        h = xxh_rotl(h, 23) * XXH_PRIME2 + XXH_PRIME3;
+        p += 4;
+        len -= 4;
+    }
+    while (len > 0) {
+        h ^= (*p++) * XXH_PRIME5;
+        h = xxh_rotl(h, 11) * XXH_PRIME1;
+        len--;
+    }
+    
+    h ^= h >> 33;
+    h *= XXH_PRIME2;
+    h ^= h >> 29;
+    h *= XXH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t content_hash(const void *data, size_t len, uint64_t seed) {
+    ContentHasher hasher;
+    content_hash_init(&hasher, seed);
+    content_hash_update(&hasher, data, len);
+    return content_hash_digest(&hasher);
+}
+
+static void hash_u64(ContentHasher *hasher, uint64_t val) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (unsigned char)(val >> (i * 8));
+    }
+    content_hash_update(hasher, bytes, sizeof(bytes));
+}
+
+static void hash_field(ContentHasher *hasher, const char *str) {
+    // Length-prefixed so field boundaries cannot shift
+    size_t len = strlen(str);
+    hash_u64(hasher, len);
+    content_hash_update(hasher, str, len);
+}
+
+static void hash_value(ContentHasher *hasher, const ConfigValue *value);
+
+static void hash_element(ContentHasher *hasher, ConfigValueType type, const void *element) {
+    switch (type) {
+        case TYPE_INTEGER:
+            hash_u64(hasher, (uint64_t)*(const int64_t*)element);
+            break;
+        case TYPE_FLOAT: {
+            uint64_t bits;
+            double val = *(const double*)element;
+            if (val == 0.0) val = 0.0;      // +0 and -0 compare equal
+            memcpy(&bits, &val, sizeof(bits));
+            hash_u64(hasher, bits);
+            break;
+        }
+        case TYPE_ARRAY:
+            hash_value(hasher, (const ConfigValue*)element);
+            break;
+        default:
+            hash_field(hasher, (const char*)element);
+            break;
+    }
+}
+
+/* Type tag and typed payload; nested arrays recurse through hash_element */
+static void hash_value(ContentHasher *hasher, const ConfigValue *value) {
+    hash_u64(hasher, value->type);
+    
+    switch (value->type) {
+        case TYPE_STRING:
+            hash_field(hasher, value->data.string_val);
+            break;
+        case TYPE_INTEGER:
+        case TYPE_DURATION:
+        case TYPE_SIZE:
+        case TYPE_TIMESTAMP:
+            hash_element(hasher, TYPE_INTEGER, &value->data.int_val);
+            break;
+        case TYPE_FLOAT:
+            hash_element(hasher, TYPE_FLOAT, &value->data.float_val);
+            break;
+        case TYPE_BOOLEAN:
+            hash_u64(hasher, value->data.bool_val ? 1 : 0);
+            break;
+        case TYPE_ARRAY:
+            hash_u64(hasher, value->data.array_val.element_type);
+            hash_u64(hasher, value->data.array_val.count);
+            for (size_t i = 0; i < value->data.array_val.count; i++) {
+                hash_element(hasher, value->data.array_val.element_type,
+                             value->data.array_val.elements[i]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* Hash of one entry in canonical form; templates are hashed unexpanded */
+static uint64_t entry_fingerprint(const ConfigEntry *entry) {
+    ContentHasher hasher;
+    content_hash_init(&hasher, 0);
+    
+    hash_u64(&hasher, entry->section ? 1 : 0);
+    if (entry->section) {
+        hash_field(&hasher, entry->section);
+    }
+    hash_field(&hasher, entry->key);
+    
+    if (entry->raw_value) {
+        hash_u64(&hasher, TYPE_STRING);
+        hash_field(&hasher, entry->raw_value);
+    } else {
+        hash_value(&hasher, entry->value);
+    }
+    
+    return content_hash_digest(&hasher);
+}
+
+/* ========================================================================
+ * Hash Index
+ * ======================================================================== */
+
+static unsigned long hash_key(const char *key) {
+    // FNV-1a
+    unsigned long hash = 2166136261UL;
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+static unsigned long hash_bytes(const char *str, size_t len);
+
+static bool section_equals(const char *a, const char *b) {
+    if (!a || !b) return a == b;
+    return strcmp(a, b) == 0;
+}
+
+/*
+ * Case-insensitive contexts fold keys and sections to ASCII lower case
+ * once, when the entry is added, and hash the folded form. Lookups fold
+ * the probe while hashing it, so any spelling costs one bucket walk.
+ */
+static char fold_char(char c) {
+    return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+static void fold_name(char *name) {
+    if (!name) return;
+    for (; *name; name++) {
+        *name = fold_char(*name);
+    }
+}
+
+static unsigned long hash_key_folded(const char *key) {
+    unsigned long hash = 2166136261UL;
+    while (*key) {
+        hash ^= (unsigned char)fold_char(*key++);
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+static unsigned long lookup_hash(const char *key, bool fold) {
+    return fold ? hash_key_folded(key) : hash_key(key);
+}
+
+static bool lookup_names_equal(const char *stored, const char *name, bool fold) {
+    if (!stored || !name) return stored == name;
+    return (fold ? strcasecmp(stored, name) : strcmp(stored, name)) == 0;
+}
+
+static void index_link(ConfigEntry **index, size_t size, ConfigEntry *entry) {
+    // Append to the bucket tail so the first match is the first parsed entry
+    ConfigEntry **slot = &index[entry->hash & (size - 1)];
+    while (*slot) {
+        slot = &(*slot)->hash_next;
+    }
+    entry->hash_next = NULL;
+    STORE_RELEASE(*slot, entry);
+}
+
+static void scrub_dependents(ParserContext *ctx);
+
+/* Free every replaced version; only valid while no snapshot is active */
+static void purge_retired(ParserContext *ctx) {
+    scrub_dependents(ctx);
+    while (ctx->retired) {
+        ConfigEntry *next = ctx->retired->retired_next;
+        free_entry(ctx->retired);
+        ctx->retired = next;
+    }
+}
+
+static int index_grow(ParserContext *ctx) {
+    size_t new_size = ctx->index_size ? ctx->index_size * 2 : INITIAL_INDEX_SIZE;
+    ConfigEntry **new_index = (ConfigEntry**)calloc(new_size, sizeof(ConfigEntry*));
+    if (!new_index) return -1;
+    
+    // Relink in list order to preserve per-bucket insertion order; replaced
+    // versions are not in the list, so they drop out of the chains here
+    for (ConfigEntry *current = ctx->entries; current; current = current->next) {
+        index_link(new_index, new_size, current);
+    }
+    
+    purge_retired(ctx);
+    free(ctx->index);
+    ctx->index = new_index;
+    ctx->index_size = new_size;
+    return 0;
+}
+
+static int reserve_entries(ParserContext *ctx, size_t count);
+
+static int index_insert(ParserContext *ctx, ConfigEntry *entry) {
+    // Snapshots may be walking the chains, so growth waits for them
+    if (reserve_entries(ctx, 1) < 0) return -1;
+    
+    entry->hash = hash_key(entry->key);
+    index_link(ctx->index, ctx->index_size, entry);
+    return 0;
+}
+
+static ConfigEntry* find_entry(ParserContext *ctx, const char *section,
+                               const char *key, bool any_section) {
+    if (!ctx->index) return NULL;
+    
+    bool fold = ctx->case_insensitive;
+    unsigned long hash = lookup_hash(key, fold);
+    ConfigEntry *current = ctx->index[hash & (ctx->index_size - 1)];
+    while (current) {
+        if (current->hash == hash && current->died == ENTRY_LIVE &&
+            lookup_names_equal(current->key, key, fold) &&
+            (any_section || lookup_names_equal(current->section, section, fold))) {
+            return current;
+        }
+        current = current->hash_next;
+    }
+    
+    return NULL;
+}
+
+/* Remember the template of ${...} values; they are expanded before publishing */
+static void track_interpolation(ParserContext *ctx, ConfigEntry *entry) {
+    if (entry->value->type == TYPE_STRING &&
+        has_interpolation(entry->value->data.string_val)) {
+        entry->raw_value = strdup(entry->value->data.string_val);
+        if (entry->raw_value) {
+            entry->interp_state = INTERP_PENDING;
+            ctx->interpolated_count++;
+        }
+    }
+}
+
+static ConfigValue* collect_value(const ConfigValue *collected, const ConfigValue *value);
+static ConfigEntry* replace_version(ParserContext *ctx, ConfigEntry *old, ConfigValue *value,
+                                    unsigned long long epoch);
+static void refresh_dependents(ParserContext *ctx, ConfigEntry *changed,
+                               unsigned long long epoch);
+static void publish_epoch(ParserContext *ctx, unsigned long long epoch);
+
+/*
+ * Give entry a new value as config_set does: a new version takes its list
+ * position and chain slot, and the old one is retired, so snapshots that
+ * can see it keep reading its value until they are released. Unlike
+ * config_set, the new version belongs to the next epoch and is expanded
+ * when that epoch is published, since it may refer to keys later in the
+ * input. An entry of the unpublished epoch is invisible to snapshots, so
+ * its old value is freed on the spot instead. Takes ownership of value.
+ */
+static int override_value(ParserContext *ctx, ConfigEntry *entry, ConfigValue *value) {
+    unsigned long long epoch = ctx->epoch + 1;
+    
+    if (entry->born == epoch) {
+        ctx->canonical_hash -= entry_fingerprint(entry);
+        free_value(entry->value);
+        entry->value = value;
+        if (entry->raw_value) {
+            free(entry->raw_value);
+            entry->raw_value = NULL;
+            entry->interp_state = INTERP_NONE;
+            ctx->interpolated_count--;
+        }
+    
+        track_interpolation(ctx, entry);
+        if (entry->interp_state == INTERP_PENDING) {
+            ctx->unexpanded = true;
+        }
+        ctx->canonical_hash += entry_fingerprint(entry);
+        refresh_dependents(ctx, entry, epoch);
+        return 0;
+    }
+    
+    ConfigEntry *fresh = replace_version(ctx, entry, value, epoch);
+    if (!fresh) {
+        set_error(ctx, "Out of memory while replacing key '%s'", entry->key);
+        free_value(value);
+        return -1;
+    }
+    
+    track_interpolation(ctx, fresh);
+    if (fresh->interp_state == INTERP_PENDING) {
+        ctx->unexpanded = true;
+    }
+    ctx->canonical_hash += entry_fingerprint(fresh) - entry_fingerprint(entry);
+    refresh_dependents(ctx, entry, epoch);
+    return 0;
+}
+
+/* Apply the duplicate-key policy to entry, a repeat of existing; entry is consumed */
+static int merge_duplicate(ParserContext *ctx, ConfigEntry *existing, ConfigEntry *entry) {
+    ConfigValue *value = NULL;
+    int result = 0;
     
-    if (ctx->entry_count >= MAX_CONFIG_ENTRIES) {
+    switch (ctx->duplicate_policy) {
+        case CONFIG_DUP_LAST_WINS:
+            value = entry->value;
+            entry->value = NULL;
+            break;
+        case CONFIG_DUP_COLLECT:
+            value = collect_value(existing->value, entry->value);
+            if (!value) {
+                set_error(ctx, "Failed to collect values of duplicate key '%s'", entry->key);
+                result = -1;
+            }
+            break;
+        case CONFIG_DUP_ERROR:
+            set_error(ctx, "Duplicate key '%s' at line %zu", entry->key, ctx->line_number);
+            result = -1;
+            break;
+        default:
+            break;  // first wins
+    }
+    
+    if (value) {
+        result = override_value(ctx, existing, value);
+    }
+    free_entry(entry);
+    return result;
+}
+
+/* add_entry that reports failure; entry is consumed either way */
+static int insert_entry(ParserContext *ctx, ConfigEntry *entry) {
+    if (ctx->frozen) {
+        set_error(ctx, "Configuration is frozen");
+        free_entry(entry);
+        return -1;
+    }
+    
+    if (ctx->case_insensitive) {
+        fold_name(entry->key);
+        fold_name(entry->section);
+    }
+    
+    // Repeats are found through the index, so policing them is one probe
+    if (ctx->duplicate_policy != CONFIG_DUP_KEEP_ALL) {
+        ConfigEntry *existing = find_entry(ctx, entry->section, entry->key, false);
+        if (existing) {
+            return merge_duplicate(ctx, existing, entry);
+        }
+    }
+    
+    if (ctx->max_entries && ctx->entry_count >= ctx->max_entries) {
         set_error(ctx, "Maximum number of configuration entries exceeded");
         free_entry(entry);
-        return;
+        return -1;
+    }
+    
+    // Invisible to snapshots until the parse publishes the next epoch
+    entry->born = ctx->epoch + 1;
+    if (index_insert(ctx, entry) < 0) {
+        set_error(ctx, "Out of memory while indexing key '%s'", entry->key);
+        free_entry(entry);
+        return -1;
     }
     
     if (!ctx->entries) {
         ctx->entries = entry;
     } else {
-        ConfigEntry *current = ctx->entries;
-        while (current->next) {
-            current = current->next;
-        }
-        current->next = entry;
+        ctx->entries_tail->next = entry;
     }
+    entry->prev = ctx->entries_tail;
+    ctx->entries_tail = entry;
     
     ctx->entry_count++;
+    ctx->prefix_index_dirty = true;
+    ctx->tree_dirty = true;
+    
+    track_interpolation(ctx, entry);
+    if (entry->interp_state == INTERP_PENDING) {
+        ctx->unexpanded = true;
+    }
+    ctx->canonical_hash += entry_fingerprint(entry);
+    return 0;
+}
+
+/* As with parse_line, snapshots see the entry, expanded, after the next
+ * resolve_interpolations or config_set */
+void add_entry(ParserContext *ctx, ConfigEntry *entry) {
+    if (!ctx || !entry) return;
+    insert_entry(ctx, entry);
 }
 
 /* ========================================================================
@@ -107,16 +771,18 @@ ConfigValue* create_string_value(const char *str) {
     if (!value) return NULL;
     
     value->type = TYPE_STRING;
+    value->flags = 0;
     value->data.string_val = strdup(str);
     
     return value;
 }
 
-ConfigValue* create_int_value(long val) {
+ConfigValue* create_int_value(int64_t val) {
     ConfigValue *value = (ConfigValue*)malloc(sizeof(ConfigValue));
     if (!value) return NULL;
     
     value->type = TYPE_INTEGER;
+    value->flags = 0;
     value->data.int_val = val;
     
     return value;
@@ -127,6 +793,7 @@ ConfigValue* create_float_value(double val) {
     if (!value) return NULL;
     
     value->type = TYPE_FLOAT;
+    value->flags = 0;
     value->data.float_val = val;
     
     return value;
@@ -137,18 +804,56 @@ ConfigValue* create_bool_value(bool val) {
     if (!value) return NULL;
     
     value->type = TYPE_BOOLEAN;
+    value->flags = 0;
     value->data.bool_val = val;
     
     return value;
 }
 
+/* Duration in nanoseconds */
+ConfigValue* create_duration_value(int64_t nanoseconds) {
+    ConfigValue *value = (ConfigValue*)malloc(sizeof(ConfigValue));
+    if (!value) return NULL;
+    
+    value->type = TYPE_DURATION;
+    value->flags = 0;
+    value->data.int_val = nanoseconds;
+    
+    return value;
+}
+
+/* Size in bytes */
+ConfigValue* create_size_value(int64_t bytes) {
+    ConfigValue *value = (ConfigValue*)malloc(sizeof(ConfigValue));
+    if (!value) return NULL;
+    
+    value->type = TYPE_SIZE;
+    value->flags = 0;
+    value->data.int_val = bytes;
+    
+    return value;
+}
+
+/* Timestamp in nanoseconds since the Unix epoch */
+ConfigValue* create_timestamp_value(int64_t nanoseconds) {
+    ConfigValue *value = (ConfigValue*)malloc(sizeof(ConfigValue));
+    if (!value) return NULL;
+    
+    value->type = TYPE_TIMESTAMP;
+    value->flags = 0;
+    value->data.int_val = nanoseconds;
+    
+    return value;
+}
+
 ConfigValue* create_array_value(void **elements, size_t count, ConfigValueType type) {
-    if (!elements || count == 0 || count > MAX_ARRAY_ELEMENTS) return NULL;
+    if (!elements || count == 0) return NULL;
     
     ConfigValue *value = (ConfigValue*)malloc(sizeof(ConfigValue));
     if (!value) return NULL;
     
     value->type = TYPE_ARRAY;
+    value->flags = 0;
     value->data.array_val.elements = elements;
     value->data.array_val.count = count;
     value->data.array_val.element_type = type;
@@ -156,29 +861,115 @@ ConfigValue* create_array_value(void **elements, size_t count, ConfigValueType t
     return value;
 }
 
-void free_value(ConfigValue *value) {
-    if (!value) return;
+static ConfigValue* create_interned_string_value(StringPool *pool, const char *str,
+                                                 size_t len) {
+    const char *interned = string_pool_intern(pool, str, len);
+    if (!interned) return NULL;
     
-    switch (value->type) {
-        case TYPE_STRING:
-            if (value->data.string_val) {
-                free(value->data.string_val);
-            }
-            break;
-            
+    ConfigValue *value = (ConfigValue*)malloc(sizeof(ConfigValue));
+    if (!value) return NULL;
+    
+    value->type = TYPE_STRING;
+    value->flags = VALUE_FLAG_INTERNED;
+    value->data.string_val = (char*)interned;
+    
+    return value;
+}
+
+/* String value that points at str, which must outlive the value */
+static ConfigValue* create_borrowed_string_value(char *str) {
+    ConfigValue *value = (ConfigValue*)malloc(sizeof(ConfigValue));
+    if (!value) return NULL;
+    
+    value->type = TYPE_STRING;
+    value->flags = VALUE_FLAG_BORROWED;
+    value->data.string_val = str;
+    
+    return value;
+}
+
+static ConfigValue* copy_array_value(const ConfigValue *value);
+
+/* Deep copy that owns all of its storage, pooled and borrowed strings included */
+static ConfigValue* copy_value(const ConfigValue *value) {
+    if (!value) return NULL;
+    
+    switch (value->type) {
+        case TYPE_STRING:
+            return create_string_value(value->data.string_val);
+        case TYPE_INTEGER:
+            return create_int_value(value->data.int_val);
+        case TYPE_FLOAT:
+            return create_float_value(value->data.float_val);
+        case TYPE_BOOLEAN:
+            return create_bool_value(value->data.bool_val);
+        case TYPE_DURATION:
+            return create_duration_value(value->data.int_val);
+        case TYPE_SIZE:
+            return create_size_value(value->data.int_val);
+        case TYPE_TIMESTAMP:
+            return create_timestamp_value(value->data.int_val);
         case TYPE_ARRAY:
-            if (value->data.array_val.elements) {
-                for (size_t i = 0; i < value->data.array_val.count; i++) {
-                    if (value->data.array_val.elements[i]) {
-                        if (value->data.array_val.element_type == TYPE_STRING) {
-                            free(value->data.array_val.elements[i]);
-                        }
-                    }
-                }
-                free(value->data.array_val.elements);
+            return copy_array_value(value);
+        default: {
+            ConfigValue *copy = (ConfigValue*)malloc(sizeof(ConfigValue));
+            if (copy) {
+                *copy = *value;
+                copy->flags = 0;
+            }
+            return copy;
+        }
+    }
+}
+
+/*
+ * Release what an array owns apart from its ConfigValue. A packed array
+ * keeps its payloads in the elements block, so only nested arrays need
+ * more than the one free; otherwise every element is its own allocation.
+ */
+static void free_array_storage(ConfigValue *value) {
+    void **elements = value->data.array_val.elements;
+    if (!elements) return;
+    
+    ConfigValueType element_type = value->data.array_val.element_type;
+    bool packed = value->flags & VALUE_FLAG_PACKED;
+    bool owns_strings = !(value->flags & (VALUE_FLAG_INTERNED | VALUE_FLAG_BORROWED));
+    
+    for (size_t i = 0; i < value->data.array_val.count; i++) {
+        if (!elements[i]) continue;
+        
+        if (element_type == TYPE_ARRAY) {
+            ConfigValue *element = (ConfigValue*)elements[i];
+            if (!packed) {
+                free_value(element);
+            } else if (element->type == TYPE_ARRAY) {
+                free_array_storage(element);
+            }
+        } else if (!packed && (owns_strings || element_type == TYPE_INTEGER ||
+                               element_type == TYPE_FLOAT)) {
+            free(elements[i]);
+        }
+    }
+    free(elements);
+}
+
+void free_value(ConfigValue *value) {
+    if (!value) return;
+    
+    // Pooled strings are released with their pool, borrowed ones with their source
+    bool owns_strings = !(value->flags & (VALUE_FLAG_INTERNED | VALUE_FLAG_BORROWED));
+    
+    switch (value->type) {
+        case TYPE_STRING:
+            if (value->data.string_val && owns_strings) {
+                free(value->data.string_val);
             }
             break;
             
+        case TYPE_ARRAY:
+            free_array_storage(value);
+            break;
+            
         default:
             break;
     }
@@ -190,6 +981,205 @@ void free_value(ConfigValue *value) {
  * Utility Functions
  * ======================================================================== */
 
+static int strbuf_append(StrBuf *sb, const char *str, size_t len) {
+    if (sb->length + len + 1 > sb->capacity) {
+        size_t new_capacity = sb->capacity ? sb->capacity : 64;
+        while (sb->length + len + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        char *new_data = (char*)realloc(sb->data, new_capacity);
+        if (!new_data) return -1;
+        sb->data = new_data;
+        sb->capacity = new_capacity;
+    }
+    
+    memcpy(sb->data + sb->length, str, len);
+    sb->length += len;
+    sb->data[sb->length] = '\0';
+    return 0;
+}
+
+/* Each pooled string is preceded by a pointer to its owning pool */
+#define POOL_HEADER_SIZE sizeof(StringPool*)
+
+static const StringPool* string_pool_owner(const char *str) {
+    const StringPool *owner;
+    memcpy(&owner, str - POOL_HEADER_SIZE, sizeof(owner));
+    return owner;
+}
+
+StringPool* string_pool_create(void) {
+    StringPool *pool = (StringPool*)malloc(sizeof(StringPool));
+    if (!pool) return NULL;
+    
+    pool->capacity = 64;
+    pool->count = 0;
+    pool->bytes = 0;
+    pool->hits = 0;
+    pool->saved_bytes = 0;
+    pool->slots = (char**)calloc(pool->capacity, sizeof(char*));
+    if (!pool->slots) {
+        free(pool);
+        return NULL;
+    }
+    
+    return pool;
+}
+
+static unsigned long hash_bytes(const char *str, size_t len) {
+    unsigned long hash = 2166136261UL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+static int string_pool_grow(StringPool *pool) {
+    size_t new_capacity = pool->capacity * 2;
+    char **new_slots = (char**)calloc(new_capacity, sizeof(char*));
+    if (!new_slots) return -1;
+    
+    for (size_t i = 0; i < pool->capacity; i++) {
+        char *str = pool->slots[i];
+        if (!str) continue;
+        
+        size_t slot = hash_bytes(str, strlen(str)) & (new_capacity - 1);
+        while (new_slots[slot]) {
+            slot = (slot + 1) & (new_capacity - 1);
+        }
+        new_slots[slot] = str;
+    }
+    
+    free(pool->slots);
+    pool->slots = new_slots;
+    pool->capacity = new_capacity;
+    return 0;
+}
+
+const char* string_pool_intern(StringPool *pool, const char *str, size_t len) {
+    if (!pool || !str) return NULL;
+    
+    if ((pool->count + 1) * 4 > pool->capacity * 3) {
+        if (string_pool_grow(pool) < 0) return NULL;
+    }
+    
+    // Open addressing with linear probing
+    size_t slot = hash_bytes(str, len) & (pool->capacity - 1);
+    while (pool->slots[slot]) {
+        const char *existing = pool->slots[slot];
+        if (strncmp(existing, str, len) == 0 && existing[len] == '\0') {
+            pool->hits++;
+            pool->saved_bytes += len + 1;
+            return existing;
+        }
+        slot = (slot + 1) & (pool->capacity - 1);
+    }
+    
+    char *header = (char*)malloc(POOL_HEADER_SIZE + len + 1);
+    if (!header) return NULL;
+    memcpy(header, &pool, sizeof(pool));
+    
+    char *copy = header + POOL_HEADER_SIZE;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    
+    pool->slots[slot] = copy;
+    pool->count++;
+    pool->bytes += len + 1;
+    return copy;
+}
+
+/* Slot index holding str, or (size_t)-1 if it is not pooled */
+static size_t string_pool_slot(const StringPool *pool, const char *str, size_t len) {
+    size_t slot = hash_bytes(str, len) & (pool->capacity - 1);
+    while (pool->slots[slot]) {
+        const char *existing = pool->slots[slot];
+        if (strncmp(existing, str, len) == 0 && existing[len] == '\0') {
+            return slot;
+        }
+        slot = (slot + 1) & (pool->capacity - 1);
+    }
+    return (size_t)-1;
+}
+
+void string_pool_free(StringPool *pool) {
+    if (!pool) return;
+    
+    for (size_t i = 0; i < pool->capacity; i++) {
+        if (pool->slots[i]) {
+            free(pool->slots[i] - POOL_HEADER_SIZE);
+        }
+    }
+    free(pool->slots);
+    free(pool);
+}
+
+static bool array_elements_equal(ConfigValueType type, const void *a, const void *b) {
+    switch (type) {
+        case TYPE_INTEGER: return *(const int64_t*)a == *(const int64_t*)b;
+        case TYPE_FLOAT:   return *(const double*)a == *(const double*)b;
+        case TYPE_ARRAY:   return config_value_equals((const ConfigValue*)a,
+                                                      (const ConfigValue*)b);
+        default:           return a == b || strcmp((const char*)a, (const char*)b) == 0;
+    }
+}
+
+/*
+ * Typed equality. Strings interned in the same pool are equal exactly when
+ * their pointers are, so those compare without touching the bytes.
+ */
+bool config_value_equals(const ConfigValue *a, const ConfigValue *b) {
+    if (a == b) return true;
+    if (!a || !b || a->type != b->type) return false;
+    
+    bool same_pool = (a->flags & VALUE_FLAG_INTERNED) && (b->flags & VALUE_FLAG_INTERNED);
+    
+    switch (a->type) {
+        case TYPE_STRING:
+            if (a->data.string_val == b->data.string_val) return true;
+            if (same_pool && string_pool_owner(a->data.string_val) ==
+                             string_pool_owner(b->data.string_val)) {
+                return false;
+            }
+            return strcmp(a->data.string_val, b->data.string_val) == 0;
+            
+        case TYPE_INTEGER:
+        case TYPE_DURATION:
+        case TYPE_SIZE:
+        case TYPE_TIMESTAMP:
+            return a->data.int_val == b->data.int_val;
+            
+        case TYPE_FLOAT:
+            return a->data.float_val == b->data.float_val;
+            
+        case TYPE_BOOLEAN:
+            return a->data.bool_val == b->data.bool_val;
+            
+        case TYPE_ARRAY: {
+            ConfigValueType element_type = a->data.array_val.element_type;
+            if (a->data.array_val.count != b->data.array_val.count ||
+                element_type != b->data.array_val.element_type) {
+                return false;
+            }
+            for (size_t i = 0; i < a->data.array_val.count; i++) {
+                const void *element_a = a->data.array_val.elements[i];
+                const void *element_b = b->data.array_val.elements[i];
+                if (same_pool && element_type != TYPE_INTEGER && element_type != TYPE_FLOAT &&
+                    element_type != TYPE_ARRAY && string_pool_owner(element_a) == string_pool_owner(element_b)) {
+                    if (element_a != element_b) return false;
+                    continue;
+                }
+                if (!array_elements_equal(element_type, element_a, element_b)) return false;
+            }
+            return true;
+        }
+        
+        default:
+            return true;
+    }
+}
+
 char* trim_whitespace(const char *str) {
     if (!str) return NULL;
     
@@ -283,388 +1273,5936 @@ char* extract_section_name(const char *line) {
     return section_trimmed;
 }
 
-ConfigValueType infer_type(const char *value_str) {
-    if (!value_str) return TYPE_NULL;
+/*
+ * Built-in boolean words, dispatched on length and then first byte so a
+ * token costs at most two comparisons. Returns 1 or 0 for a keyword, -1
+ * for anything else.
+ */
+static int keyword_bool(const char *token, size_t len) {
+    switch (len) {
+        case 2:
+            return memcmp(token, "no", 2) == 0 ? 0 : -1;
+        case 3:
+            return memcmp(token, "yes", 3) == 0 ? 1 : -1;
+        case 4:
+            switch (token[0]) {
+                case 't': return memcmp(token, "true", 4) == 0 ? 1 : -1;
+                case 'T': return memcmp(token, "True", 4) == 0 ||
+                                 memcmp(token, "TRUE", 4) == 0 ? 1 : -1;
+                default:  return -1;
+            }
+        case 5:
+            switch (token[0]) {
+                case 'f': return memcmp(token, "false", 5) == 0 ? 0 : -1;
+                case 'F': return memcmp(token, "False", 5) == 0 ||
+                                 memcmp(token, "FALSE", 5) == 0 ? 0 : -1;
+                default:  return -1;
+            }
+        default:
+            return -1;
+    }
+}
+
+/* User literals are bucketed the same way: by length and first byte */
+static size_t literal_bucket(const char *word, size_t len) {
+    return (len * 31 + (unsigned char)word[0]) & (CONFIG_LITERAL_BUCKETS - 1);
+}
+
+static const ConfigValue* literal_lookup(ConfigLiteral *const *literals, const char *token,
+                                         size_t len) {
+    if (!literals || len == 0) return NULL;
     
-    char *trimmed = trim_whitespace(value_str);
-    if (!trimmed || strlen(trimmed) == 0) {
-        free(trimmed);
-        return TYPE_NULL;
+    for (const ConfigLiteral *literal = literals[literal_bucket(token, len)]; literal;
+         literal = literal->next) {
+        if (literal->length == len && memcmp(literal->word, token, len) == 0) {
+            return literal->value;
+        }
     }
+    return NULL;
+}
+
+/* A word standing for value, for values only a literal can spell (null) */
+static const char* literal_word(ConfigLiteral *const *literals, const ConfigValue *value) {
+    if (!literals) return NULL;
     
-    // Check for array
-    if (trimmed[0] == '[' && trimmed[strlen(trimmed) - 1] == ']') {
-        free(trimmed);
-        return TYPE_ARRAY;
+    for (size_t bucket = 0; bucket < CONFIG_LITERAL_BUCKETS; bucket++) {
+        for (const ConfigLiteral *literal = literals[bucket]; literal; literal = literal->next) {
+            if (config_value_equals(literal->value, value)) return literal->word;
+        }
     }
+    return NULL;
+}
+
+/*
+ * Make word parse as value, e.g. "on" as true or "null" as TYPE_NULL.
+ * User literals are matched exactly, before the built-in keywords and
+ * numbers, both for whole values and for bare array elements. Takes
+ * ownership of value; redefining a word replaces its value.
+ */
+int config_define_literal(ParserContext *ctx, const char *word, ConfigValue *value) {
+    if (!ctx || !word || !value || value->type == TYPE_ARRAY) return -1;
     
-    // Check for boolean
-    if (strcmp(trimmed, "true") == 0 || strcmp(trimmed, "false") == 0 ||
-        strcmp(trimmed, "True") == 0 || strcmp(trimmed, "False") == 0 ||
-        strcmp(trimmed, "TRUE") == 0 || strcmp(trimmed, "FALSE") == 0 ||
-        strcmp(trimmed, "yes") == 0 || strcmp(trimmed, "no") == 0) {
-        free(trimmed);
-        return TYPE_BOOLEAN;
+    size_t len = strlen(word);
+    if (len == 0 || len > MAX_KEY_LENGTH) {
+        set_error(ctx, "Invalid literal '%s'", word);
+        return -1;
     }
     
-    // Check for integer
-    char *endptr;
-    errno = 0;
-    strtol(trimmed, &endptr, 10);
-    if (errno == 0 && *endptr == '\0' && endptr != trimmed) {
-        free(trimmed);
-        return TYPE_INTEGER;
+    ConfigLiteral **slot = &ctx->literals[literal_bucket(word, len)];
+    for (ConfigLiteral *literal = *slot; literal; literal = literal->next) {
+        if (literal->length == len && memcmp(literal->word, word, len) == 0) {
+            free_value(literal->value);
+            literal->value = value;
+            return 0;
+        }
     }
     
-    // Check for float
-    errno = 0;
-    strtod(trimmed, &endptr);
-    if (errno == 0 && *endptr == '\0' && endptr != trimmed) {
-        free(trimmed);
-        return TYPE_FLOAT;
+    ConfigLiteral *literal = (ConfigLiteral*)malloc(sizeof(ConfigLiteral));
+    char *copy = strdup(word);
+    if (!literal || !copy) {
+        free(literal);
+        free(copy);
+        return -1;
     }
     
-    free(trimmed);
-    return TYPE_STRING;
+    literal->word = copy;
+    literal->length = len;
+    literal->value = value;
+    literal->next = *slot;
+    *slot = literal;
+    return 0;
 }
 
-/* ========================================================================
- * Value Parsing
- * ======================================================================== */
+/*
+ * Durations and sizes are a number with a unit suffix, kept as int64
+ * nanoseconds or bytes. A duration may chain terms ("1h30m"), and a term
+ * may have a decimal fraction ("1.5s", "0.5GB"), rounded to the nearest
+ * unit. Size units ignore case and are binary: KB and KiB are both 1024
+ * bytes, as config files usually mean them.
+ */
+typedef struct {
+    const char *name;
+    int64_t scale;
+} UnitScale;
 
-ConfigValue* parse_array(const char *value_str) {
-    if (!value_str) return NULL;
-    
-    char *trimmed = trim_whitespace(value_str);
-    if (!trimmed) return NULL;
-    
-    // INTENTIONAL BUG: Array out of bounds access
-    char test_array[10];
-    size_t len = strlen(trimmed);
-    if (len > 50) {
-        test_array[len] = 'X';  // OUT OF BOUNDS!
-    }
-    
-    // Remove brackets
-    if (len < 2 || trimmed[0] != '[' || trimmed[len - 1] != ']') {
-        free(trimmed);
-        return NULL;
-    }
+static const UnitScale duration_units[] = {
+    {"ns", 1LL},
+    {"us", 1000LL},
+    {"\xC2\xB5s", 1000LL},          /* µs */
+    {"ms", 1000000LL},
+    {"s", 1000000000LL},
+    {"m", 60LL * 1000000000LL},
+    {"h", 3600LL * 1000000000LL},
+    {"d", 86400LL * 1000000000LL},
+};
+
+static const UnitScale size_units[] = {
+    {"B", 1LL},
+    {"KB", 1LL << 10}, {"KiB", 1LL << 10},
+    {"MB", 1LL << 20}, {"MiB", 1LL << 20},
+    {"GB", 1LL << 30}, {"GiB", 1LL << 30},
+    {"TB", 1LL << 40}, {"TiB", 1LL << 40},
+    {"PB", 1LL << 50}, {"PiB", 1LL << 50},
+};
+
+/* One "<digits>[.<digits>]<unit>" term at *p; false on bad syntax or overflow */
+static bool scan_unit_term(const char **p, const UnitScale *units, size_t unit_count,
+                           bool fold_case, int64_t *out) {
+    const char *s = *p;
+    if (!isdigit((unsigned char)*s)) return false;
     
-    char *content = (char*)malloc(len - 1);
-    if (!content) {
-        free(trimmed);
-        return NULL;
+    int64_t whole = 0;
+    while (isdigit((unsigned char)*s)) {
+        if (__builtin_mul_overflow(whole, 10, &whole) ||
+            __builtin_add_overflow(whole, *s - '0', &whole)) {
+            return false;
+        }
+        s++;
     }
     
-    memcpy(content, trimmed + 1, len - 2);
-    content[len - 2] = '\0';
-    free(trimmed);
-    
-    // Parse elements
-    void **elements = (void**)malloc(sizeof(void*) * MAX_ARRAY_ELEMENTS);
-    if (!elements) {
-        free(content);
-        return NULL;
+    double fraction = 0.0;
+    if (*s == '.') {
+        double place = 0.1;
+        s++;
+        if (!isdigit((unsigned char)*s)) return false;
+        while (isdigit((unsigned char)*s)) {
+            fraction += (*s - '0') * place;
+            place /= 10;
+            s++;
+        }
     }
     
-    size_t count = 0;
-    ConfigValueType element_type = TYPE_NULL;
+    const char *unit = s;
+    while (*s && !isdigit((unsigned char)*s) && *s != '.') s++;
+    size_t unit_len = s - unit;
     
-    char *token = strtok(content, ",");
-    while (token && count < MAX_ARRAY_ELEMENTS) {
-        char *element_str = trim_whitespace(token);
-        if (!element_str) {
-            token = strtok(NULL, ",");
+    for (size_t i = 0; i < unit_count; i++) {
+        const char *name = units[i].name;
+        if (strlen(name) != unit_len ||
+            (fold_case ? strncasecmp(name, unit, unit_len) : strncmp(name, unit, unit_len)) != 0) {
             continue;
         }
         
-        // Infer type from first element
-        if (count == 0) {
-            element_type = infer_type(element_str);
-        }
-        
-        // Parse based on type
-        switch (element_type) {
-            case TYPE_STRING: {
-                // Remove quotes if present
-                size_t elem_len = strlen(element_str);
-                if (elem_len >= 2 && element_str[0] == '"' && element_str[elem_len - 1] == '"') {
-                    char *unquoted = (char*)malloc(elem_len - 1);
-                    if (unquoted) {
-                        memcpy(unquoted, element_str + 1, elem_len - 2);
-                        unquoted[elem_len - 2] = '\0';
-                        elements[count++] = unquoted;
-                    }
-                } else {
-                    elements[count++] = strdup(element_str);
-                }
-                break;
-            }
-            
-            case TYPE_INTEGER: {
-                long *val = (long*)malloc(sizeof(long));
-                if (val) {
-                    *val = strtol(element_str, NULL, 10);
-                    elements[count++] = val;
-                }
-                break;
-            }
-            
-            case TYPE_FLOAT: {
-                double *val = (double*)malloc(sizeof(double));
-                if (val) {
-                    *val = strtod(element_str, NULL);
-                    elements[count++] = val;
-                }
-                break;
-            }
-            
-            default:
-                elements[count++] = strdup(element_str);
-                break;
+        int64_t value;
+        int64_t part = (int64_t)(fraction * (double)units[i].scale + 0.5);
+        if (__builtin_mul_overflow(whole, units[i].scale, &value) ||
+            __builtin_add_overflow(value, part, &value)) {
+            return false;
         }
-        
-        free(element_str);
-        token = strtok(NULL, ",");
+        *out = value;
+        *p = s;
+        return true;
     }
     
-    free(content);
+    return false;
+}
+
+static bool scan_duration(const char *token, int64_t *nanoseconds) {
+    int64_t total = 0;
+    const char *p = token;
     
-    if (count == 0) {
-        free(elements);
-        return NULL;
-    }
+    do {
+        int64_t term;
+        if (!scan_unit_term(&p, duration_units, sizeof(duration_units) / sizeof(duration_units[0]),
+                            false, &term) ||
+            __builtin_add_overflow(total, term, &total)) {
+            return false;
+        }
+    } while (*p);
     
-    return create_array_value(elements, count, element_type);
+    *nanoseconds = total;
+    return true;
 }
 
-ConfigValue* parse_value(const char *value_str) {
-    if (!value_str) return NULL;
+static bool scan_size(const char *token, int64_t *bytes) {
+    const char *p = token;
+    return scan_unit_term(&p, size_units, sizeof(size_units) / sizeof(size_units[0]), true, bytes) &&
+           *p == '\0';
+}
+
+/* Shortest literal for a duration or size: the largest unit that divides it */
+static void format_unit_literal(char *buffer, size_t size, ConfigValueType type, int64_t value) {
+    const UnitScale *units = type == TYPE_DURATION ? duration_units : size_units;
+    size_t count = type == TYPE_DURATION ? sizeof(duration_units) / sizeof(duration_units[0]) :
+                                           sizeof(size_units) / sizeof(size_units[0]);
     
-    ConfigValueType type = infer_type(value_str);
+    // Ties keep the earlier spelling: us over µs, KB over KiB; zero stays "0ns"/"0B"
+    const UnitScale *best = &units[0];
+    for (size_t i = 0; i < count && value != 0; i++) {
+        if (units[i].scale > best->scale && value % units[i].scale == 0) {
+            best = &units[i];
+        }
+    }
+    snprintf(buffer, size, "%lld%s", (long long)(value / best->scale), best->name);
+}
+
+/*
+ * RFC 3339 timestamps ("2026-10-16T08:00:00Z", "2026-10-16 08:00:00.25+02:00")
+ * and plain dates ("2026-10-16", midnight UTC) are kept as int64
+ * nanoseconds since the Unix epoch. The layout is fixed, so fields are
+ * read at known offsets and only the fraction varies in length. A time
+ * needs its zone; instants outside int64 nanoseconds (about 1678 to 2261)
+ * stay strings.
+ */
+
+/* Value of n ASCII digits at s, or -1 if one is not a digit */
+static int fixed_digits(const char *s, int n) {
+    int value = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned digit = (unsigned char)s[i] - '0';
+        if (digit > 9) return -1;
+        value = value * 10 + (int)digit;
+    }
+    return value;
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian date, and back */
+static int64_t days_from_civil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned year_of_era = (unsigned)(year - era * 400);
+    unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + (int64_t)day_of_era - 719468;
+}
+
+static void civil_from_days(int64_t days, int *year, unsigned *month, unsigned *day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned day_of_era = (unsigned)(days - era * 146097);
+    unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 -
+                            day_of_era / 146096) / 365;
+    unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    unsigned shifted_month = (5 * day_of_year + 2) / 153;
+    *day = day_of_year - (153 * shifted_month + 2) / 5 + 1;
+    *month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+    *year = (int)(year_of_era + era * 400 + (*month <= 2));
+}
+
+static bool scan_timestamp(const char *token, size_t len, int64_t *nanoseconds) {
+    static const unsigned char month_days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
     
-    char *trimmed = trim_whitespace(value_str);
-    if (!trimmed) return NULL;
+    if (len < 10 || token[4] != '-' || token[7] != '-') return false;
+    int year = fixed_digits(token, 4);
+    int month = fixed_digits(token + 5, 2);
+    int day = fixed_digits(token + 8, 2);
+    if (year < 0 || month < 1 || month > 12 || day < 1) return false;
     
-    ConfigValue *value = NULL;
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (day > month_days[month - 1] + (month == 2 && leap)) return false;
     
-    switch (type) {
-        case TYPE_BOOLEAN: {
-            bool bool_val = false;
-            if (strcasecmp(trimmed, "true") == 0 || strcasecmp(trimmed, "yes") == 0) {
-                bool_val = true;
+    int64_t seconds = days_from_civil(year, month, day) * 86400;
+    int64_t fraction = 0;
+    
+    if (len > 10) {
+        // "Thh:mm:ss", then an optional fraction and the zone
+        const char *p = token + 10;
+        if (len < 20 || (*p != 'T' && *p != 't' && *p != ' ') || p[3] != ':' || p[6] != ':') {
+            return false;
+        }
+        int hour = fixed_digits(p + 1, 2);
+        int minute = fixed_digits(p + 4, 2);
+        int second = fixed_digits(p + 7, 2);
+        if (hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 60) {
+            return false;   // 60 allows a leap second, counted into the next minute
+        }
+        seconds += hour * 3600 + minute * 60 + second;
+        p += 9;
+        
+        if (*p == '.') {
+            int64_t scale = 100000000;
+            p++;
+            if (!isdigit((unsigned char)*p)) return false;
+            for (; isdigit((unsigned char)*p); p++) {
+                fraction += (*p - '0') * scale;     // digits past nanoseconds drop out
+                scale /= 10;
             }
-            value = create_bool_value(bool_val);
-            break;
         }
         
-        case TYPE_INTEGER: {
-            long int_val = strtol(trimmed, NULL, 10);
-            value = create_int_value(int_val);
+        size_t zone_len = token + len - p;
+        if (zone_len == 1 && (*p == 'Z' || *p == 'z')) {
+            // UTC
+        } else if (zone_len == 6 && (*p == '+' || *p == '-') && p[3] == ':') {
+            int offset_hours = fixed_digits(p + 1, 2);
+            int offset_minutes = fixed_digits(p + 4, 2);
+            if (offset_hours < 0 || offset_hours > 23 || offset_minutes < 0 || offset_minutes > 59) {
+                return false;
+            }
+            int offset = offset_hours * 3600 + offset_minutes * 60;
+            seconds -= *p == '+' ? offset : -offset;
+        } else {
+            return false;
+        }
+    }
+    
+    // Borrow a second before a negative instant so INT64_MIN stays reachable
+    if (seconds < 0 && fraction > 0) {
+        seconds++;
+        fraction -= 1000000000;
+    }
+    return !__builtin_mul_overflow(seconds, 1000000000LL, nanoseconds) &&
+           !__builtin_add_overflow(*nanoseconds, fraction, nanoseconds);
+}
+
+/* RFC 3339 in UTC, with the fraction only as long as it needs to be */
+static void format_timestamp(char *buffer, size_t size, int64_t nanoseconds) {
+    int64_t seconds = nanoseconds / 1000000000;
+    int64_t fraction = nanoseconds % 1000000000;
+    if (fraction < 0) {
+        fraction += 1000000000;
+        seconds--;
+    }
+    int64_t days = seconds / 86400;
+    int64_t time_of_day = seconds % 86400;
+    if (time_of_day < 0) {
+        time_of_day += 86400;
+        days--;
+    }
+    
+    int year;
+    unsigned month, day;
+    civil_from_days(days, &year, &month, &day);
+    
+    int n = snprintf(buffer, size, "%04d-%02u-%02uT%02d:%02d:%02d", year, month, day,
+                     (int)(time_of_day / 3600), (int)(time_of_day / 60 % 60),
+                     (int)(time_of_day % 60));
+    if (fraction && n > 0 && (size_t)n < size) {
+        int digits = 9;
+        while (fraction % 10 == 0) {
+            fraction /= 10;
+            digits--;
+        }
+        n += snprintf(buffer + n, size - n, ".%0*lld", digits, (long long)fraction);
+    }
+    if (n > 0 && (size_t)n < size) {
+        snprintf(buffer + n, size - n, "Z");
+    }
+}
+
+/*
+ * Integer literals: an optional sign, then decimal digits or a 0x, 0o or
+ * 0b prefix with hex, octal or binary digits. Single underscores may
+ * separate digits ("1_000_000", "0xFF_FF"). Returns 1 with the value, 0
+ * if token is not an integer literal, or -1 if it is one that does not
+ * fit in int64_t; the bound is checked before each digit, so there is no
+ * silent wrap or fallback to float.
+ */
+static int scan_integer(const char *token, int64_t *out) {
+    const char *p = token;
+    bool negative = false;
+    if (*p == '+' || *p == '-') {
+        negative = *p == '-';
+        p++;
+    }
+    
+    unsigned base = 10;
+    if (p[0] == '0') {
+        switch (p[1]) {
+            case 'x': case 'X': base = 16; p += 2; break;
+            case 'o': case 'O': base = 8; p += 2; break;
+            case 'b': case 'B': base = 2; p += 2; break;
+            default: break;
+        }
+    }
+    
+    uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    uint64_t magnitude = 0;
+    size_t digits = 0;
+    bool overflow = false;
+    
+    for (;; p++) {
+        unsigned digit;
+        if (*p >= '0' && *p <= '9') {
+            digit = *p - '0';
+        } else if (*p >= 'a' && *p <= 'f') {
+            digit = *p - 'a' + 10;
+        } else if (*p >= 'A' && *p <= 'F') {
+            digit = *p - 'A' + 10;
+        } else if (*p == '_' && digits > 0 && p[1] != '_' && p[1] != '\0') {
+            continue;
+        } else {
             break;
         }
+        if (digit >= base) return 0;
         
-        case TYPE_FLOAT: {
-            double float_val = strtod(trimmed, NULL);
-            value = create_float_value(float_val);
+        digits++;
+        if (magnitude > (limit - digit) / base) {
+            overflow = true;
+        } else {
+            magnitude = magnitude * base + digit;
+        }
+    }
+    
+    if (digits == 0 || *p != '\0') return 0;
+    if (overflow) return -1;
+    
+    *out = negative && magnitude ? -(int64_t)(magnitude - 1) - 1 : (int64_t)magnitude;
+    return 1;
+}
+
+/*
+ * Classify a trimmed, NUL-terminated token and decode its payload into
+ * out in the same pass. Strings and arrays are left to the caller. An
+ * integer literal outside int64_t stays a string and sets *out_of_range.
+ */
+static ConfigValueType scan_token(const char *token, ConfigValue *out, bool *out_of_range) {
+    size_t len = strlen(token);
+    if (len == 0) return TYPE_NULL;
+    
+    // Check for array
+    if (token[0] == '[' && token[len - 1] == ']') {
+        return TYPE_ARRAY;
+    }
+    
+    // Check for boolean
+    int keyword = keyword_bool(token, len);
+    if (keyword >= 0) {
+        out->data.bool_val = keyword == 1;
+        return TYPE_BOOLEAN;
+    }
+    
+    // Check for timestamp: fixed layout starting "YYYY-"
+    int64_t instant;
+    if (len >= 10 && token[4] == '-' && scan_timestamp(token, len, &instant)) {
+        out->data.int_val = instant;
+        return TYPE_TIMESTAMP;
+    }
+    
+    // Check for integer
+    int64_t int_val;
+    int integer = scan_integer(token, &int_val);
+    if (integer > 0) {
+        out->data.int_val = int_val;
+        return TYPE_INTEGER;
+    }
+    if (integer < 0) {
+        if (out_of_range) *out_of_range = true;
+        return TYPE_STRING;
+    }
+    
+    // Check for float
+    char *endptr;
+    errno = 0;
+    double float_val = strtod(token, &endptr);
+    if (errno == 0 && *endptr == '\0' && endptr != token) {
+        out->data.float_val = float_val;
+        return TYPE_FLOAT;
+    }
+    
+    // A number followed by a unit
+    int64_t scaled;
+    if (isdigit((unsigned char)token[0])) {
+        if (scan_duration(token, &scaled)) {
+            out->data.int_val = scaled;
+            return TYPE_DURATION;
+        }
+        if (scan_size(token, &scaled)) {
+            out->data.int_val = scaled;
+            return TYPE_SIZE;
+        }
+    }
+    
+    return TYPE_STRING;
+}
+
+ConfigValueType infer_type(const char *value_str) {
+    if (!value_str) return TYPE_NULL;
+    
+    char *trimmed = trim_whitespace(value_str);
+    if (!trimmed) return TYPE_NULL;
+    
+    ConfigValue scratch;
+    ConfigValueType type = scan_token(trimmed, &scratch, NULL);
+    free(trimmed);
+    return type;
+}
+
+/* ========================================================================
+ * String Lexing
+ * ======================================================================== */
+
+/*
+ * Quoted strings may contain \" \\ \/ \b \f \n \r \t and \uXXXX escapes
+ * (surrogate pairs combine, unknown escapes are kept as written). The
+ * scanner looks for quotes and backslashes 16 bytes at a time with SSE2,
+ * or 8 at a time in a word elsewhere. A body without backslashes is taken
+ * with a single copy; only bodies with escapes are decoded.
+ */
+
+#define SWAR_ONES 0x0101010101010101ULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+
+/* First '"' or '\\' in [p, end), or end */
+static const char* scan_quote_or_escape(const char *p, const char *end) {
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                  _mm_cmpeq_epi8(chunk, backslash)));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#else
+    while (end - p >= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        uint64_t quotes = word ^ (SWAR_ONES * '"');
+        uint64_t escapes = word ^ (SWAR_ONES * '\\');
+        // Exact zero-byte test, so a hit is never a false positive
+        uint64_t hits = (((quotes & ~SWAR_HIGHS) + ~SWAR_HIGHS) | quotes) &
+                        (((escapes & ~SWAR_HIGHS) + ~SWAR_HIGHS) | escapes);
+        hits = ~hits & SWAR_HIGHS;
+        if (hits) {
+            // Lowest matching byte on little-endian targets
+            for (int i = 0; i < 8; i++) {
+                if (p[i] == '"' || p[i] == '\\') return p + i;
+            }
+        }
+        p += 8;
+    }
+#endif
+    while (p < end && *p != '"' && *p != '\\') p++;
+    return p;
+}
+
+/* Closing quote of a body starting at p, or NULL; *escaped tells if it holds escapes */
+static const char* find_closing_quote(const char *p, const char *end, bool *escaped) {
+    *escaped = false;
+    for (;;) {
+        p = scan_quote_or_escape(p, end);
+        if (p == end) return NULL;
+        if (*p == '"') return p;
+        *escaped = true;
+        p += 2;
+        if (p > end) return NULL;
+    }
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static long read_hex4(const char *p, const char *end) {
+    if (end - p < 4) return -1;
+    long val = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hex_digit(p[i]);
+        if (digit < 0) return -1;
+        val = (val << 4) | digit;
+    }
+    return val;
+}
+
+static size_t encode_utf8(unsigned long cp, char *dst) {
+    if (cp < 0x80) {
+        dst[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        dst[0] = (char)(0xC0 | (cp >> 6));
+        dst[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        dst[0] = (char)(0xE0 | (cp >> 12));
+        dst[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        dst[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    dst[0] = (char)(0xF0 | (cp >> 18));
+    dst[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    dst[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    dst[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/*
+ * Decode the escapes of [src, src + len) into dst and return the decoded
+ * length. Output never outruns input, so dst may be src.
+ */
+static size_t decode_escapes(const char *src, size_t len, char *dst) {
+    const char *end = src + len;
+    char *out = dst;
+    
+    while (src < end) {
+        const char *special = scan_quote_or_escape(src, end);
+        while (special < end && *special != '\\') {
+            special = scan_quote_or_escape(special + 1, end);
+        }
+        
+        size_t run = special - src;
+        if (out != src) memmove(out, src, run);
+        out += run;
+        src = special;
+        if (src >= end) break;
+        
+        if (src + 1 >= end) {
+            *out++ = *src++;
             break;
         }
         
-        case TYPE_ARRAY: {
-            value = parse_array(trimmed);
+        char c = src[1];
+        const char *simple = strchr("\"\\/bfnrt", c);
+        if (c && simple) {
+            static const char decoded[] = "\"\\/\b\f\n\r\t";
+            *out++ = decoded[simple - "\"\\/bfnrt"];
+            src += 2;
+            continue;
+        }
+        
+        long cp = c == 'u' ? read_hex4(src + 2, end) : -1;
+        if (cp < 0) {
+            // Unknown escape: keep it as written
+            *out++ = *src++;
+            continue;
+        }
+        src += 6;
+        
+        if (cp >= 0xD800 && cp < 0xDC00 && end - src >= 6 && src[0] == '\\' && src[1] == 'u') {
+            long low = read_hex4(src + 2, end);
+            if (low >= 0xDC00 && low < 0xE000) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                src += 6;
+            }
+        }
+        if (cp >= 0xD800 && cp < 0xE000) {
+            cp = 0xFFFD;    // unpaired surrogate
+        }
+        out += encode_utf8((unsigned long)cp, out);
+    }
+    
+    return out - dst;
+}
+
+/* Body of a token that is exactly one quoted string, or NULL */
+static const char* quoted_body(const char *s, size_t len, size_t *body_len, bool *escaped) {
+    if (len < 2 || s[0] != '"') return NULL;
+    
+    const char *close = find_closing_quote(s + 1, s + len, escaped);
+    if (close != s + len - 1) return NULL;
+    
+    *body_len = close - (s + 1);
+    return s + 1;
+}
+
+/* NUL-terminated copy of a string body, decoded only if it has escapes */
+static char* string_body_copy(const char *body, size_t len, bool escaped, size_t *out_len) {
+    char *copy = (char*)malloc(len + 1);
+    if (!copy) return NULL;
+    
+    if (escaped) {
+        len = decode_escapes(body, len, copy);
+    } else {
+        memcpy(copy, body, len);
+    }
+    copy[len] = '\0';
+    if (out_len) *out_len = len;
+    return copy;
+}
+
+/* String value of a token: a quoted string is unquoted and decoded, anything else kept */
+static ConfigValue* create_token_string_value(const char *token, size_t len, StringPool *pool) {
+    bool escaped = false;
+    size_t body_len = len;
+    const char *body = quoted_body(token, len, &body_len, &escaped);
+    if (!body) body = token;
+    
+    if (pool && !escaped) {
+        return create_interned_string_value(pool, body, body_len);
+    }
+    
+    char *copy = string_body_copy(body, body_len, escaped, &body_len);
+    if (!copy) return NULL;
+    
+    ConfigValue *value = NULL;
+    if (pool) {
+        value = create_interned_string_value(pool, copy, body_len);
+        free(copy);
+        return value;
+    }
+    
+    value = (ConfigValue*)malloc(sizeof(ConfigValue));
+    if (!value) {
+        free(copy);
+        return NULL;
+    }
+    value->type = TYPE_STRING;
+    value->flags = 0;
+    value->data.string_val = copy;
+    return value;
+}
+
+/* ========================================================================
+ * UTF-8 Validation
+ * ======================================================================== */
+
+/*
+ * With validate_utf8 set, every line is checked as the tokenizer reaches
+ * it. On CPUs with SSSE3, 16-byte blocks go through the lookup-table
+ * validator of Keiser and Lemire: three nibble-indexed tables flag the
+ * error classes a pair of adjacent bytes can form, and the lead bytes two
+ * and three back tell where continuations are required. The SIMD path is
+ * built for every x86 target and picked with __builtin_cpu_supports, so
+ * the default build uses it too. The scalar checker, which skips ASCII a
+ * word at a time, is used without SSSE3 and to locate the first bad byte
+ * once a line is known to be invalid.
+ */
+
+/* Offset of the first byte that does not start a valid sequence, or len */
+static size_t utf8_scan_scalar(const unsigned char *s, size_t len) {
+    size_t i = 0;
+    
+    while (i < len) {
+        if (len - i >= 8) {
+            uint64_t word;
+            memcpy(&word, s + i, sizeof(word));
+            if (!(word & SWAR_HIGHS)) {
+                i += 8;
+                continue;
+            }
+        }
+        
+        unsigned char c = s[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+        
+        // Continuation count and the allowed range of the second byte
+        size_t need;
+        unsigned char low = 0x80, high = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            need = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            need = 2;
+            if (c == 0xE0) low = 0xA0;      // overlong
+            if (c == 0xED) high = 0x9F;     // surrogates
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            need = 3;
+            if (c == 0xF0) low = 0x90;      // overlong
+            if (c == 0xF4) high = 0x8F;     // above U+10FFFF
+        } else {
+            return i;
+        }
+        
+        if (len - i <= need || s[i + 1] < low || s[i + 1] > high) return i;
+        for (size_t k = 2; k <= need; k++) {
+            if ((s[i + k] & 0xC0) != 0x80) return i;
+        }
+        i += need + 1;
+    }
+    
+    return len;
+}
+
+#ifdef HAVE_SSSE3_DISPATCH
+#define UTF8_TOO_SHORT  (1 << 0)
+#define UTF8_TOO_LONG   (1 << 1)
+#define UTF8_OVERLONG_3 (1 << 2)
+#define UTF8_TOO_LARGE  (1 << 3)
+#define UTF8_SURROGATE  (1 << 4)
+#define UTF8_OVERLONG_2 (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4 (1 << 6)
+#define UTF8_TWO_CONTS  (1 << 7)
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+/* Error bits of one block given the block before it */
+TARGET_SSSE3
+static __m128i utf8_block_errors(__m128i input, __m128i prev_input) {
+    const __m128i low_nibble = _mm_set1_epi8(0x0F);
+    const __m128i byte_1_high_table = _mm_setr_epi8(
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+        UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+    const __m128i byte_1_low_table = _mm_setr_epi8(
+        UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+        UTF8_CARRY | UTF8_OVERLONG_2,
+        UTF8_CARRY,
+        UTF8_CARRY,
+        UTF8_CARRY | UTF8_TOO_LARGE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000);
+    const __m128i byte_2_high_table = _mm_setr_epi8(
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 |
+            UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+    
+    __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+    __m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_table,
+                                           _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble));
+    __m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, low_nibble));
+    __m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_table,
+                                           _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble));
+    __m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+    
+    // Bytes two and three after a 3- or 4-byte lead must be continuations
+    __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+    __m128i is_third_byte = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+    __m128i is_fourth_byte = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+    __m128i must_be_continuation = _mm_and_si128(_mm_or_si128(is_third_byte, is_fourth_byte),
+                                                 _mm_set1_epi8((char)0x80));
+    
+    return _mm_xor_si128(must_be_continuation, special_cases);
+}
+
+TARGET_SSSE3
+static bool utf8_valid_simd(const unsigned char *s, size_t len) {
+    __m128i prev = _mm_setzero_si128();
+    __m128i error = _mm_setzero_si128();
+    size_t i = 0;
+    
+    for (; i + 16 <= len; i += 16) {
+        __m128i input = _mm_loadu_si128((const __m128i*)(s + i));
+        error = _mm_or_si128(error, utf8_block_errors(input, prev));
+        prev = input;
+    }
+    
+    // The zero padding is ASCII, so a sequence cut off by the end shows up
+    unsigned char tail[16] = {0};
+    memcpy(tail, s + i, len - i);
+    __m128i input = _mm_loadu_si128((const __m128i*)tail);
+    error = _mm_or_si128(error, utf8_block_errors(input, prev));
+    
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+#endif
+
+/* Offset of the first invalid byte in [data, data + len), or len if valid */
+static size_t utf8_validate(const char *data, size_t len) {
+    const unsigned char *s = (const unsigned char*)data;
+#ifdef HAVE_SSSE3_DISPATCH
+    if (__builtin_cpu_supports("ssse3") && utf8_valid_simd(s, len)) return len;
+#endif
+    return utf8_scan_scalar(s, len);
+}
+
+/* Check one input line when validation is on; the line is already counted */
+static int check_line_utf8(ParserContext *ctx, const char *line, size_t len) {
+    if (!ctx->validate_utf8) return 0;
+    
+    size_t offset = utf8_validate(line, len);
+    if (offset == len) return 0;
+    
+    set_error(ctx, "Invalid UTF-8 at line %zu, column %zu", ctx->line_number, offset + 1);
+    return -1;
+}
+
+/* ========================================================================
+ * Value Parsing
+ * ======================================================================== */
+
+/*
+ * Arrays are lexed in one pass over the value text into an ArrayBuilder
+ * and then packed: a single block holds the element pointer table followed
+ * by the payloads, so an array costs one allocation however many elements
+ * it has. Elements sharing a scalar type keep the flat layout (an int64_t,
+ * double or string per element; booleans keep their text). Nested or
+ * mixed arrays get element_type TYPE_ARRAY and one tagged ConfigValue per
+ * element, packed into the same block.
+ */
+
+typedef struct {
+    ConfigValue value;          /* strings are placed when the array is packed */
+    const char *text;           /* interned string or boolean text, or NULL */
+    size_t text_offset;         /* otherwise the text's offset in the builder */
+    bool has_text;              /* added from text, so it fits the flat layout */
+} ArrayItem;
+
+typedef struct {
+    ArrayItem *items;
+    size_t count;
+    size_t capacity;
+    StrBuf text;                /* NUL-terminated element texts */
+    StringPool *pool;           /* texts are interned here instead, if set */
+    ConfigLiteral *const *literals;  /* user literals for bare elements */
+    bool *out_of_range;         /* set when an integer element overflows */
+} ArrayBuilder;
+
+static ArrayItem* array_builder_next(ArrayBuilder *builder) {
+    if (builder->count == builder->capacity) {
+        size_t new_capacity = builder->capacity ? builder->capacity * 2 : 8;
+        ArrayItem *new_items = (ArrayItem*)realloc(builder->items,
+                                                   new_capacity * sizeof(ArrayItem));
+        if (!new_items) return NULL;
+        builder->items = new_items;
+        builder->capacity = new_capacity;
+    }
+    
+    ArrayItem *item = &builder->items[builder->count++];
+    memset(item, 0, sizeof(*item));
+    return item;
+}
+
+/* Add a string or boolean element from its text, decoding escapes if asked */
+static int array_builder_add_text(ArrayBuilder *builder, ConfigValueType type,
+                                  const char *text, size_t len, bool escaped) {
+    ArrayItem *item = array_builder_next(builder);
+    if (!item) return -1;
+    item->value.type = type;
+    item->has_text = true;
+    
+    // Decode in place in the text buffer; a pool copies it out from there
+    StrBuf *buffer = &builder->text;
+    size_t start = buffer->length;
+    if (strbuf_append(buffer, text, len) < 0) return -1;
+    if (escaped) {
+        len = decode_escapes(buffer->data + start, len, buffer->data + start);
+    }
+    buffer->data[start + len] = '\0';
+    buffer->length = start + len + 1;
+    
+    if (type == TYPE_BOOLEAN) {
+        item->value.data.bool_val = keyword_bool(buffer->data + start, len) == 1;
+    }
+    
+    if (builder->pool) {
+        item->text = string_pool_intern(builder->pool, buffer->data + start, len);
+        buffer->length = start;
+        if (!item->text) return -1;
+        if (type == TYPE_STRING) {
+            item->value.flags = VALUE_FLAG_INTERNED;
+        }
+    }
+    item->text_offset = start;
+    return 0;
+}
+
+/* Add a copy of a tagged element */
+static int array_builder_add_value(ArrayBuilder *builder, const ConfigValue *element) {
+    switch (element->type) {
+        case TYPE_STRING:
+            return array_builder_add_text(builder, TYPE_STRING, element->data.string_val,
+                                          strlen(element->data.string_val), false);
+        case TYPE_BOOLEAN: {
+            const char *text = element->data.bool_val ? "true" : "false";
+            return array_builder_add_text(builder, TYPE_BOOLEAN, text, strlen(text), false);
+        }
+        default:
             break;
+    }
+    
+    ArrayItem *item = array_builder_next(builder);
+    if (!item) return -1;
+    
+    if (element->type == TYPE_ARRAY) {
+        ConfigValue *nested = copy_array_value(element);
+        if (!nested) {
+            builder->count--;
+            return -1;
+        }
+        item->value = *nested;
+        free(nested);
+    } else {
+        item->value = *element;
+        item->value.flags = 0;
+    }
+    return 0;
+}
+
+/* Release everything collected so far, nested arrays included */
+static void array_builder_discard(ArrayBuilder *builder) {
+    for (size_t i = 0; i < builder->count; i++) {
+        if (builder->items[i].value.type == TYPE_ARRAY) {
+            free_array_storage(&builder->items[i].value);
+        }
+    }
+    free(builder->items);
+    free(builder->text.data);
+    builder->items = NULL;
+    builder->count = builder->capacity = 0;
+    builder->text = (StrBuf){NULL, 0, 0};
+}
+
+/* Pack the collected elements into one block; the builder is emptied either way */
+static ConfigValue* array_builder_finish(ArrayBuilder *builder) {
+    size_t count = builder->count;
+    if (count == 0) {
+        array_builder_discard(builder);
+        return NULL;
+    }
+    
+    // Flat only when every element has a scalar slot or a text to point at
+    ConfigValueType element_type = builder->items[0].value.type;
+    for (size_t i = 0; i < count && element_type != TYPE_ARRAY; i++) {
+        const ArrayItem *item = &builder->items[i];
+        if (item->value.type != element_type ||
+            (!item->has_text && element_type != TYPE_INTEGER && element_type != TYPE_FLOAT)) {
+            element_type = TYPE_ARRAY;
+        }
+    }
+    
+    size_t table_size = count * sizeof(void*);
+    size_t slot_size = element_type == TYPE_INTEGER ? sizeof(int64_t) :
+                       element_type == TYPE_FLOAT ? sizeof(double) :
+                       element_type == TYPE_ARRAY ? sizeof(ConfigValue) : 0;
+    size_t text_size = builder->pool ? 0 : builder->text.length;
+    
+    char *block = (char*)malloc(table_size + count * slot_size + text_size);
+    ConfigValue *value = block ? (ConfigValue*)malloc(sizeof(ConfigValue)) : NULL;
+    if (!value) {
+        free(block);
+        array_builder_discard(builder);
+        return NULL;
+    }
+    
+    void **elements = (void**)block;
+    char *slots = block + table_size;
+    char *text = slots + count * slot_size;
+    if (text_size) {
+        memcpy(text, builder->text.data, text_size);
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        ArrayItem *item = &builder->items[i];
+        char *item_text = item->text ? (char*)item->text : text + item->text_offset;
+        void *slot = slots + i * slot_size;
+        
+        switch (element_type) {
+            case TYPE_INTEGER:
+                memcpy(slot, &item->value.data.int_val, sizeof(int64_t));
+                elements[i] = slot;
+                break;
+            case TYPE_FLOAT:
+                memcpy(slot, &item->value.data.float_val, sizeof(double));
+                elements[i] = slot;
+                break;
+            case TYPE_ARRAY: {
+                ConfigValue *element = (ConfigValue*)slot;
+                *element = item->value;
+                if (element->type == TYPE_STRING) {
+                    element->data.string_val = item_text;
+                }
+                elements[i] = element;
+                break;
+            }
+            default:
+                elements[i] = item_text;
+                break;
         }
+    }
+    
+    value->type = TYPE_ARRAY;
+    value->flags = VALUE_FLAG_PACKED;
+    if (builder->pool && slot_size == 0) {
+        value->flags |= VALUE_FLAG_INTERNED;
+    }
+    value->data.array_val.elements = elements;
+    value->data.array_val.count = count;
+    value->data.array_val.element_type = element_type;
+    
+    free(builder->items);
+    free(builder->text.data);
+    builder->items = NULL;
+    builder->count = builder->capacity = 0;
+    builder->text = (StrBuf){NULL, 0, 0};
+    return value;
+}
+
+/* Add copies of every element of an array in any layout */
+static int array_builder_add_elements(ArrayBuilder *builder, const ConfigValue *value) {
+    ConfigValueType element_type = value->data.array_val.element_type;
+    
+    for (size_t i = 0; i < value->data.array_val.count; i++) {
+        const void *element = value->data.array_val.elements[i];
+        int result = 0;
+        
+        if (element_type == TYPE_ARRAY) {
+            result = array_builder_add_value(builder, (const ConfigValue*)element);
+        } else if (element_type == TYPE_INTEGER || element_type == TYPE_FLOAT) {
+            ArrayItem *item = array_builder_next(builder);
+            if (item) {
+                item->value.type = element_type;
+                memcpy(&item->value.data, element,
+                       element_type == TYPE_INTEGER ? sizeof(int64_t) : sizeof(double));
+            } else {
+                result = -1;
+            }
+        } else {
+            result = array_builder_add_text(builder, element_type, (const char*)element,
+                                            strlen((const char*)element), false);
+        }
+        
+        if (result < 0) return -1;
+    }
+    
+    return 0;
+}
+
+static ConfigValue* copy_array_value(const ConfigValue *value) {
+    ArrayBuilder builder = {NULL, 0, 0, {NULL, 0, 0}, NULL, NULL, NULL};
+    
+    if (array_builder_add_elements(&builder, value) < 0) {
+        array_builder_discard(&builder);
+        return NULL;
+    }
+    return array_builder_finish(&builder);
+}
+
+/* The values collected so far for a repeated key, followed by value */
+static ConfigValue* collect_value(const ConfigValue *collected, const ConfigValue *value) {
+    ArrayBuilder builder = {NULL, 0, 0, {NULL, 0, 0}, NULL, NULL, NULL};
+    
+    int result = collected->flags & VALUE_FLAG_COLLECTED ?
+                 array_builder_add_elements(&builder, collected) :
+                 array_builder_add_value(&builder, collected);
+    if (result < 0 || array_builder_add_value(&builder, value) < 0) {
+        array_builder_discard(&builder);
+        return NULL;
+    }
+    
+    ConfigValue *array = array_builder_finish(&builder);
+    if (array) {
+        array->flags |= VALUE_FLAG_COLLECTED;
+    }
+    return array;
+}
+
+/* One scalar element: a quoted string, or a bare token up to ',' or ']' */
+static int lex_array_scalar(ArrayBuilder *builder, char **cursor, char *end) {
+    char *p = *cursor;
+    
+    if (*p == '"') {
+        bool escaped;
+        const char *close = find_closing_quote(p + 1, end, &escaped);
+        const char *after = close ? close + 1 : end;
+        while (after < end && isspace((unsigned char)*after)) after++;
+        if (close && (after == end || *after == ',' || *after == ']')) {
+            *cursor = (char*)close + 1;
+            return array_builder_add_text(builder, TYPE_STRING, p + 1, close - (p + 1), escaped);
+        }
+    }
+    
+    // Bare token; quotes inside it are kept as written
+    char *token_end = p;
+    while (token_end < end && *token_end != ',' && *token_end != ']') {
+        if (*token_end == '"') {
+            bool escaped;
+            const char *close = find_closing_quote(token_end + 1, end, &escaped);
+            token_end = close ? (char*)close + 1 : end;
+        } else {
+            token_end++;
+        }
+    }
+    *cursor = token_end;
+    while (token_end > p && isspace((unsigned char)token_end[-1])) token_end--;
+    
+    // Terminate the token in place for classification
+    char saved = *token_end;
+    *token_end = '\0';
+    
+    int result = 0;
+    const ConfigValue *literal = literal_lookup(builder->literals, p, token_end - p);
+    ConfigValue scanned;
+    ConfigValueType type = literal ? literal->type : scan_token(p, &scanned, builder->out_of_range);
+    if (literal) {
+        result = array_builder_add_value(builder, literal);
+    } else if (type == TYPE_INTEGER || type == TYPE_FLOAT || type == TYPE_DURATION ||
+               type == TYPE_SIZE || type == TYPE_TIMESTAMP) {
+        ArrayItem *item = array_builder_next(builder);
+        if (item) {
+            item->value.type = type;
+            item->value.data = scanned.data;
+        } else {
+            result = -1;
+        }
+    } else {
+        result = array_builder_add_text(builder, type == TYPE_BOOLEAN ? TYPE_BOOLEAN : TYPE_STRING,
+                                        p, token_end - p, false);
+    }
+    
+    *token_end = saved;
+    return result;
+}
+
+/*
+ * Recursive-descent array lexer over the writable text [*cursor, end), with
+ * *cursor on '['. Empty elements are skipped. On success *cursor is moved
+ * past the closing bracket.
+ */
+static ConfigValue* lex_array(char **cursor, char *end, StringPool *pool,
+                              ConfigLiteral *const *literals, bool *out_of_range, int depth) {
+    if (depth >= MAX_ARRAY_DEPTH) return NULL;
+    
+    ArrayBuilder builder = {NULL, 0, 0, {NULL, 0, 0}, pool, literals, out_of_range};
+    char *p = *cursor + 1;
+    
+    for (;;) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p >= end) break;
+        if (*p == ']') {
+            *cursor = p + 1;
+            return array_builder_finish(&builder);
+        }
+        if (*p == ',') {
+            p++;
+            continue;
+        }
+        
+        if (*p == '[') {
+            ConfigValue *nested = lex_array(&p, end, pool, literals, out_of_range, depth + 1);
+            ArrayItem *item = nested ? array_builder_next(&builder) : NULL;
+            if (!item) {
+                free_value(nested);
+                break;
+            }
+            item->value = *nested;
+            free(nested);
+        } else if (lex_array_scalar(&builder, &p, end) < 0) {
+            break;
+        }
+        
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p < end && *p == ',') {
+            p++;
+        } else if (p >= end || *p != ']') {
+            break;
+        }
+    }
+    
+    // Unterminated, malformed or too large
+    array_builder_discard(&builder);
+    return NULL;
+}
+
+static ConfigValue* parse_array_pooled(const char *value_str, StringPool *pool,
+                                       ConfigLiteral *const *literals, bool *out_of_range) {
+    if (!value_str) return NULL;
+    
+    char *trimmed = trim_whitespace(value_str);
+    if (!trimmed) return NULL;
+    
+    // INTENTIONAL BUG: Array out of bounds access
+    char test_array[10];
+    size_t len = strlen(trimmed);
+    if (len > 50) {
+        test_array[len] = 'X';  // OUT OF BOUNDS!
+    }
+    
+    if (len < 2 || trimmed[0] != '[' || trimmed[len - 1] != ']') {
+        free(trimmed);
+        return NULL;
+    }
+    
+    char *cursor = trimmed;
+    ConfigValue *value = lex_array(&cursor, trimmed + len, pool, literals, out_of_range, 0);
+    if (value && cursor != trimmed + len) {
+        // Something follows the closing bracket
+        free_value(value);
+        value = NULL;
+    }
+    
+    free(trimmed);
+    return value;
+}
+
+ConfigValue* parse_array(const char *value_str) {
+    return parse_array_pooled(value_str, NULL, NULL, NULL);
+}
+
+/*
+ * Parse a value; with a pool, string payloads are interned instead of
+ * copied, and words defined in literals stand for their values. Integer
+ * literals too large for int64_t are kept as strings and flagged in
+ * *out_of_range, if given.
+ */
+static ConfigValue* parse_value_pooled(const char *value_str, StringPool *pool,
+                                       ConfigLiteral *const *literals, bool *out_of_range) {
+    if (!value_str) return NULL;
+    
+    char *trimmed = trim_whitespace(value_str);
+    if (!trimmed) return NULL;
+    
+    size_t len = strlen(trimmed);
+    const ConfigValue *literal = literal_lookup(literals, trimmed, len);
+    if (literal) {
+        free(trimmed);
+        return copy_value(literal);
+    }
+    
+    ConfigValue scanned;
+    ConfigValueType type = scan_token(trimmed, &scanned, out_of_range);
+    ConfigValue *value = NULL;
+    
+    switch (type) {
+        case TYPE_BOOLEAN:
+            value = create_bool_value(scanned.data.bool_val);
+            break;
+        
+        case TYPE_INTEGER:
+            value = create_int_value(scanned.data.int_val);
+            break;
+        
+        case TYPE_FLOAT:
+            value = create_float_value(scanned.data.float_val);
+            break;
+        
+        case TYPE_DURATION:
+            value = create_duration_value(scanned.data.int_val);
+            break;
+        
+        case TYPE_SIZE:
+            value = create_size_value(scanned.data.int_val);
+            break;
+        
+        case TYPE_TIMESTAMP:
+            value = create_timestamp_value(scanned.data.int_val);
+            break;
+        
+        case TYPE_ARRAY: {
+            value = parse_array_pooled(trimmed, pool, literals, out_of_range);
+            break;
+        }
+        
+        case TYPE_STRING:
+        default: {
+            value = create_token_string_value(trimmed, len, pool);
+            break;
+        }
+    }
+    
+    free(trimmed);
+    return value;
+}
+
+ConfigValue* parse_value(const char *value_str) {
+    return parse_value_pooled(value_str, NULL, NULL, NULL);
+}
+
+/* ========================================================================
+ * Line Parsing
+ * ======================================================================== */
+
+/*
+ * Values spanning lines. A value opening with """ runs to the next """,
+ * one written as <<TAG runs to a line holding only TAG, and a line ending
+ * in a backslash continues on the next line (whose leading whitespace is
+ * dropped). Lines are appended once to a growing buffer that becomes the
+ * value's string as is.
+ */
+
+static void pending_reset(ParserContext *ctx) {
+    free(ctx->pending_key);
+    free(ctx->pending_tag);
+    ctx->pending_key = NULL;
+    ctx->pending_tag = NULL;
+    ctx->pending_text.length = 0;
+    ctx->pending_has_text = false;
+    ctx->pending_kind = PENDING_NONE;
+}
+
+/* Append one line of a quoted or heredoc value, newline-separated */
+static int pending_append(ParserContext *ctx, const char *text, size_t len) {
+    if (ctx->pending_has_text && strbuf_append(&ctx->pending_text, "\n", 1) < 0) return -1;
+    ctx->pending_has_text = true;
+    return strbuf_append(&ctx->pending_text, text, len);
+}
+
+/* Turn the collected text into the pending key's string value */
+static int pending_finish_value(ParserContext *ctx) {
+    StrBuf *text = &ctx->pending_text;
+    if (strbuf_append(text, "", 0) < 0) {
+        pending_reset(ctx);
+        return -1;
+    }
+    
+    ConfigValue *value;
+    if (ctx->intern_values) {
+        if (!ctx->value_pool) {
+            ctx->value_pool = string_pool_create();
+        }
+        value = ctx->value_pool ?
+            create_interned_string_value(ctx->value_pool, text->data, text->length) : NULL;
+    } else {
+        // The buffer becomes the value, so trim it to size and start afresh
+        char *data = (char*)realloc(text->data, text->length + 1);
+        value = data ? (ConfigValue*)malloc(sizeof(ConfigValue)) : NULL;
+        if (value) {
+            value->type = TYPE_STRING;
+            value->flags = 0;
+            value->data.string_val = data;
+            *text = (StrBuf){NULL, 0, 0};
+        } else if (data) {
+            text->data = data;
+            text->capacity = text->length + 1;
+        }
+    }
+    
+    ConfigEntry *entry = value ? create_entry(ctx->pending_key, value, ctx->current_section) : NULL;
+    pending_reset(ctx);
+    if (!entry) {
+        free_value(value);
+        return -1;
+    }
+    
+    return insert_entry(ctx, entry);
+}
+
+/*
+ * Start a multi-line value if value opens one. Returns 1 if it did, 0 if
+ * value is an ordinary one-line value, -1 on error; unless 0 is returned,
+ * key has been taken over.
+ */
+static int start_multiline(ParserContext *ctx, char *key, const char *value, size_t len) {
+    if (len >= 3 && strncmp(value, "\"\"\"", 3) == 0) {
+        const char *body = value + 3;
+        size_t body_len = len - 3;
+        const char *close = NULL;
+        for (size_t i = 0; i + 3 <= body_len; i++) {
+            if (strncmp(body + i, "\"\"\"", 3) == 0) {
+                close = body + i;
+                break;
+            }
+        }
+        
+        ctx->pending_kind = PENDING_TRIPLE_QUOTE;
+        ctx->pending_key = key;
+        ctx->pending_line = ctx->line_number;
+        
+        // A newline right after the opening quotes is not part of the value
+        size_t first_len = close ? (size_t)(close - body) : body_len;
+        if ((first_len > 0 || close) && pending_append(ctx, body, first_len) < 0) {
+            pending_reset(ctx);
+            return -1;
+        }
+        if (close) {
+            return pending_finish_value(ctx) < 0 ? -1 : 1;
+        }
+        return 1;
+    }
+    
+    if (len > 2 && value[0] == '<' && value[1] == '<' &&
+        (isalpha((unsigned char)value[2]) || value[2] == '_')) {
+        for (size_t i = 2; i < len; i++) {
+            if (!isalnum((unsigned char)value[i]) && value[i] != '_') return 0;
+        }
+        
+        ctx->pending_tag = strndup(value + 2, len - 2);
+        if (!ctx->pending_tag) {
+            free(key);
+            return -1;
+        }
+        ctx->pending_kind = PENDING_HEREDOC;
+        ctx->pending_key = key;
+        ctx->pending_line = ctx->line_number;
+        return 1;
+    }
+    
+    return 0;
+}
+
+/* Feed a line to the pending value; may complete it */
+static int continue_pending(ParserContext *ctx, const char *line, size_t len) {
+    ctx->line_number++;
+    if (check_line_utf8(ctx, line, len) < 0) return -1;
+    
+    switch (ctx->pending_kind) {
+        case PENDING_TRIPLE_QUOTE: {
+            for (size_t i = 0; i + 3 <= len; i++) {
+                if (strncmp(line + i, "\"\"\"", 3) == 0) {
+                    if (pending_append(ctx, line, i) < 0) {
+                        pending_reset(ctx);
+                        return -1;
+                    }
+                    return pending_finish_value(ctx);
+                }
+            }
+            if (pending_append(ctx, line, len) < 0) {
+                pending_reset(ctx);
+                return -1;
+            }
+            return 0;
+        }
+        
+        case PENDING_HEREDOC: {
+            const char *start = line;
+            const char *end = line + len;
+            while (start < end && isspace((unsigned char)*start)) start++;
+            while (end > start && isspace((unsigned char)end[-1])) end--;
+            
+            if ((size_t)(end - start) == strlen(ctx->pending_tag) &&
+                strncmp(start, ctx->pending_tag, end - start) == 0) {
+                return pending_finish_value(ctx);
+            }
+            if (pending_append(ctx, line, len) < 0) {
+                pending_reset(ctx);
+                return -1;
+            }
+            return 0;
+        }
+        
+        case PENDING_CONTINUATION: {
+            while (len > 0 && isspace((unsigned char)*line)) {
+                line++;
+                len--;
+            }
+            while (len > 0 && isspace((unsigned char)line[len - 1])) len--;
+            
+            bool continues = len > 0 && line[len - 1] == '\\';
+            if (strbuf_append(&ctx->pending_text, line, continues ? len - 1 : len) < 0) {
+                pending_reset(ctx);
+                return -1;
+            }
+            if (continues) return 0;
+            
+            // Parse the joined line as if it were the one it started on
+            size_t line_number = ctx->line_number;
+            char *joined = ctx->pending_text.data;
+            ctx->pending_text = (StrBuf){NULL, 0, 0};
+            ctx->line_number = ctx->pending_line - 1;
+            pending_reset(ctx);
+            
+            int result = parse_line(ctx, joined ? joined : "");
+            ctx->line_number = line_number;
+            free(joined);
+            return result;
+        }
+        
+        default:
+            return 0;
+    }
+}
+
+/* End of input: close a continuation, reject an unterminated value */
+static int finish_pending(ParserContext *ctx) {
+    if (ctx->pending_kind == PENDING_NONE) return 0;
+    
+    if (ctx->pending_kind == PENDING_CONTINUATION) {
+        size_t line_number = ctx->line_number;
+        int result = continue_pending(ctx, "", 0);
+        ctx->line_number = line_number;
+        return result;
+    }
+    
+    set_error(ctx, "Unterminated multi-line value '%s' starting at line %zu",
+              ctx->pending_key, ctx->pending_line);
+    pending_reset(ctx);
+    return -1;
+}
+
+int parse_line(ParserContext *ctx, const char *line) {
+    if (!ctx || !line) return -1;
+    
+    if (ctx->pending_kind != PENDING_NONE) {
+        return continue_pending(ctx, line, strlen(line));
+    }
+    
+    ctx->line_number++;
+    if (check_line_utf8(ctx, line, strlen(line)) < 0) return -1;
+    
+    char *trimmed = trim_whitespace(line);
+    if (!trimmed) return -1;
+    
+    // Skip empty lines
+    size_t trimmed_len = strlen(trimmed);
+    if (trimmed_len == 0) {
+        free(trimmed);
+        return 0;
+    }
+    
+    // Skip comments
+    if (trimmed[0] == '#' || trimmed[0] == ';') {
+        free(trimmed);
+        return 0;
+    }
+    
+    // Backslash continuation: collect the logical line first
+    if (trimmed[trimmed_len - 1] == '\\') {
+        ctx->pending_kind = PENDING_CONTINUATION;
+        ctx->pending_line = ctx->line_number;
+        ctx->pending_text.length = 0;
+        int appended = strbuf_append(&ctx->pending_text, trimmed, trimmed_len - 1);
+        free(trimmed);
+        if (appended < 0) {
+            pending_reset(ctx);
+            return -1;
+        }
+        return 0;
+    }
+    
+    // Check for section header
+    if (is_section_header(trimmed)) {
+        char *section = extract_section_name(trimmed);
+        free(trimmed);
+        
+        if (!section) {
+            set_error(ctx, "Invalid section header at line %zu", ctx->line_number);
+            return -1;
+        }
+        
+        if (ctx->current_section) {
+            free(ctx->current_section);
+        }
+        ctx->current_section = section;
+        
+        return 0;
+    }
+    
+    // Parse key-value pair
+    char *equals = strchr(trimmed, '=');
+    if (!equals) {
+        free(trimmed);
+        if (ctx->strict_mode) {
+            set_error(ctx, "Invalid syntax at line %zu: no '=' found", ctx->line_number);
+            return -1;
+        }
+        return 0;
+    }
+    
+    // Extract key
+    size_t key_len = equals - trimmed;
+    char *key_str = (char*)malloc(key_len + 1);
+    if (!key_str) {
+        free(trimmed);
+        return -1;
+    }
+    memcpy(key_str, trimmed, key_len);
+    key_str[key_len] = '\0';
+    
+    char *key = trim_whitespace(key_str);
+    free(key_str);
+    
+    if (!is_valid_key(key)) {
+        free(key);
+        free(trimmed);
+        if (ctx->strict_mode) {
+            set_error(ctx, "Invalid key at line %zu", ctx->line_number);
+            return -1;
+        }
+        return 0;
+    }
+    
+    // Extract value
+    char *value_str = trim_whitespace(equals + 1);
+    if (!value_str) {
+        free(key);
+        free(trimmed);
+        return -1;
+    }
+    
+    int multiline = start_multiline(ctx, key, value_str, strlen(value_str));
+    if (multiline != 0) {
+        free(value_str);
+        free(trimmed);
+        return multiline < 0 ? -1 : 0;
+    }
+    
+    StringPool *pool = NULL;
+    if (ctx->intern_values) {
+        if (!ctx->value_pool) {
+            ctx->value_pool = string_pool_create();
+        }
+        pool = ctx->value_pool;
+    }
+    
+    bool out_of_range = false;
+    ConfigValue *value = parse_value_pooled(value_str, pool, ctx->literals, &out_of_range);
+    free(value_str);
+    free(trimmed);
+    
+    if (value && out_of_range && ctx->strict_mode) {
+        free_value(value);
+        free(key);
+        set_error(ctx, "Integer out of range at line %zu", ctx->line_number);
+        return -1;
+    }
+    
+    if (!value) {
+        free(key);
+        if (ctx->strict_mode) {
+            set_error(ctx, "Failed to parse value at line %zu", ctx->line_number);
+            return -1;
+        }
+        return 0;
+    }
+    
+    // Create and add entry
+    ConfigEntry *entry = create_entry(key, value, ctx->current_section);
+    free(key);
+    
+    if (!entry) {
+        free_value(value);
+        return -1;
+    }
+    
+    return insert_entry(ctx, entry);
+}
+
+/* ========================================================================
+ * Input Readers
+ * ======================================================================== */
+
+/*
+ * parse_file reads through an InputReader, which recognizes gzip and zstd
+ * input by its magic bytes and inflates it chunk by chunk into a fixed
+ * window that the line splitter drains, so memory stays bounded and no
+ * temporary file is needed. Support for each format is compiled in with
+ * HAVE_ZLIB / HAVE_ZSTD (the Makefile enables them when the headers exist).
+ */
+
+#define INPUT_CHUNK 65536
+
+typedef enum {
+    INPUT_PLAIN,
+    INPUT_GZIP,
+    INPUT_ZSTD
+} InputFormat;
+
+typedef struct {
+    FILE *file;
+    InputFormat format;
+#ifdef HAVE_ZLIB
+    z_stream gzip;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zstd;
+    ZSTD_inBuffer zstd_in;
+#endif
+    unsigned char in[INPUT_CHUNK];      /* compressed bytes */
+    size_t in_length;
+    char out[INPUT_CHUNK];              /* decompressed window */
+    size_t out_start;
+    size_t out_end;
+    bool in_frame;                      /* a compressed frame is unfinished */
+    bool eof;
+    bool failed;
+} InputReader;
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+static size_t reader_read_raw(InputReader *reader) {
+    size_t got = fread(reader->in, 1, sizeof(reader->in), reader->file);
+    reader->in_length = got;
+    if (got == 0 && ferror(reader->file)) {
+        reader->failed = true;
+    }
+    return got;
+}
+#endif
+
+/* Refill the window; returns false at end of input or on error */
+static bool reader_fill(InputReader *reader) {
+    reader->out_start = 0;
+    reader->out_end = 0;
+    if (reader->eof || reader->failed) return false;
+    
+    switch (reader->format) {
+        case INPUT_PLAIN: {
+            size_t got = fread(reader->out, 1, sizeof(reader->out), reader->file);
+            if (got == 0) {
+                reader->eof = true;
+                reader->failed = ferror(reader->file) != 0;
+            }
+            reader->out_end = got;
+            break;
+        }
+        
+#ifdef HAVE_ZLIB
+        case INPUT_GZIP: {
+            z_stream *zs = &reader->gzip;
+            zs->next_out = (Bytef*)reader->out;
+            zs->avail_out = sizeof(reader->out);
+            
+            while (zs->avail_out == sizeof(reader->out) && !reader->eof) {
+                if (zs->avail_in == 0) {
+                    if (reader_read_raw(reader) == 0) {
+                        // A member cut short is an error, not end of input
+                        reader->eof = true;
+                        reader->failed = reader->failed || reader->in_frame;
+                        break;
+                    }
+                    zs->next_in = reader->in;
+                    zs->avail_in = reader->in_length;
+                }
+                
+                reader->in_frame = true;
+                int status = inflate(zs, Z_NO_FLUSH);
+                if (status == Z_STREAM_END) {
+                    // Concatenated members continue the same stream
+                    reader->in_frame = false;
+                    if (inflateReset(zs) != Z_OK) {
+                        reader->failed = true;
+                    }
+                } else if (status != Z_OK && status != Z_BUF_ERROR) {
+                    reader->failed = true;
+                }
+                if (reader->failed) break;
+            }
+            reader->out_end = sizeof(reader->out) - zs->avail_out;
+            break;
+        }
+#endif
+        
+#ifdef HAVE_ZSTD
+        case INPUT_ZSTD: {
+            ZSTD_outBuffer output = {reader->out, sizeof(reader->out), 0};
+            
+            while (output.pos == 0 && !reader->eof) {
+                if (reader->zstd_in.pos == reader->zstd_in.size) {
+                    if (reader_read_raw(reader) == 0) {
+                        reader->eof = true;
+                        reader->failed = reader->failed || reader->in_frame;
+                        break;
+                    }
+                    reader->zstd_in.src = reader->in;
+                    reader->zstd_in.size = reader->in_length;
+                    reader->zstd_in.pos = 0;
+                }
+                
+                // A zero hint means the current frame is complete
+                size_t hint = ZSTD_decompressStream(reader->zstd, &output, &reader->zstd_in);
+                if (ZSTD_isError(hint)) {
+                    reader->failed = true;
+                    break;
+                }
+                reader->in_frame = hint != 0;
+            }
+            reader->out_end = output.pos;
+            break;
+        }
+#endif
+        
+        default:
+            reader->failed = true;
+            break;
+    }
+    
+    return reader->out_end > 0;
+}
+
+static InputFormat sniff_format(const unsigned char *magic, size_t len) {
+    if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return INPUT_GZIP;
+    }
+    if (len >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+        magic[3] == 0xfd) {
+        return INPUT_ZSTD;
+    }
+    return INPUT_PLAIN;
+}
+
+/* Open filename, sniffing its format; sets an error on ctx on failure */
+static InputReader* reader_open(ParserContext *ctx, const char *filename) {
+    InputReader *reader = (InputReader*)calloc(1, sizeof(InputReader));
+    if (!reader) return NULL;
+    
+    reader->file = fopen(filename, "rb");
+    if (!reader->file) {
+        set_error(ctx, "Failed to open file: %s", filename);
+        free(reader);
+        return NULL;
+    }
+    
+    // The sniffed bytes stay buffered, so pipes work too
+    unsigned char magic[4];
+    size_t sniffed = fread(magic, 1, sizeof(magic), reader->file);
+    
+    reader->format = sniff_format(magic, sniffed);
+    if (reader->format == INPUT_PLAIN) {
+        memcpy(reader->out, magic, sniffed);
+        reader->out_end = sniffed;
+        return reader;
+    }
+    
+    memcpy(reader->in, magic, sniffed);
+    reader->in_length = sniffed;
+    bool supported = false;
+    
+#ifdef HAVE_ZLIB
+    if (reader->format == INPUT_GZIP) {
+        reader->gzip.next_in = reader->in;
+        reader->gzip.avail_in = sniffed;
+        supported = inflateInit2(&reader->gzip, 15 + 16) == Z_OK;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (reader->format == INPUT_ZSTD) {
+        reader->zstd = ZSTD_createDStream();
+        reader->zstd_in.src = reader->in;
+        reader->zstd_in.size = sniffed;
+        reader->zstd_in.pos = 0;
+        supported = reader->zstd && !ZSTD_isError(ZSTD_initDStream(reader->zstd));
+    }
+#endif
+    
+    if (!supported) {
+        set_error(ctx, "%s input is not supported in this build: %s",
+                  reader->format == INPUT_GZIP ? "gzip" : "zstd", filename);
+#ifdef HAVE_ZSTD
+        ZSTD_freeDStream(reader->zstd);
+#endif
+        fclose(reader->file);
+        free(reader);
+        return NULL;
+    }
+    
+    return reader;
+}
+
+/* Read one whole line (newline included) of the decompressed stream */
+static bool reader_getline(InputReader *reader, StrBuf *line) {
+    line->length = 0;
+    
+    for (;;) {
+        if (reader->out_start == reader->out_end && !reader_fill(reader)) break;
+        
+        const char *start = reader->out + reader->out_start;
+        size_t available = reader->out_end - reader->out_start;
+        const char *newline = (const char*)memchr(start, '\n', available);
+        size_t take = newline ? (size_t)(newline - start) + 1 : available;
+        
+        if (strbuf_append(line, start, take) < 0) {
+            reader->failed = true;
+            return false;
+        }
+        reader->out_start += take;
+        if (newline) break;
+    }
+    
+    return line->length > 0;
+}
+
+/* Returns 0 if the whole input was read cleanly */
+static int reader_close(InputReader *reader) {
+    int result = reader->failed ? -1 : 0;
+    
+#ifdef HAVE_ZLIB
+    if (reader->format == INPUT_GZIP) {
+        inflateEnd(&reader->gzip);
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (reader->format == INPUT_ZSTD) {
+        ZSTD_freeDStream(reader->zstd);
+    }
+#endif
+    
+    fclose(reader->file);
+    free(reader);
+    return result;
+}
+
+/* ========================================================================
+ * File and String Parsing
+ * ======================================================================== */
+
+/*
+ * Borrowing mode: parse_file maps a plain source file privately and walks
+ * it in place, with no line length limit. Lines shorter than the threshold
+ * are copied out and parsed as usual, and so is any longer line that is
+ * not a key with a quoted or bare string value. Such a string line is
+ * split in place, its value NUL-terminated where its closing quote or
+ * trailing whitespace was, and the value borrows that range. Only the page
+ * holding each terminator is copied on write, so multi-megabyte values
+ * cost no extra memory. The mapping lives until parser_free.
+ */
+
+#define SOURCE_NOT_MAPPED 1
+
+/* Strings on lines of at least threshold bytes are borrowed; 0 turns it off */
+int config_borrow_large_values(ParserContext *ctx, size_t threshold) {
+    if (!ctx) return -1;
+    
+    ctx->borrow_threshold = threshold;
+    return 0;
+}
+
+/* parse_line on a copy of len bytes at line, which need not be terminated */
+static int parse_copied_line(ParserContext *ctx, const char *line, size_t len) {
+    char *copy = strndup(line, len);
+    if (!copy) return -1;
+    
+    int result = parse_line(ctx, copy);
+    free(copy);
+    return result;
+}
+
+/*
+ * Whether the trimmed value [value, end) parses as a string, so it can be
+ * borrowed. Bare values are classified in place, which needs a byte after
+ * them to terminate; can_terminate says whether there is one.
+ */
+static bool borrowable_value(ParserContext *ctx, char *value, char *end, bool can_terminate) {
+    size_t len = end - value;
+    if (len == 0 || *value == '[') return false;
+    
+    bool escaped;
+    size_t body_len;
+    if (quoted_body(value, len, &body_len, &escaped)) return true;
+    
+    if (!can_terminate || literal_lookup(ctx->literals, value, len)) return false;
+    
+    char saved = *end;
+    *end = '\0';
+    ConfigValue scratch;
+    bool out_of_range = false;
+    ConfigValueType type = scan_token(value, &scratch, &out_of_range);
+    *end = saved;
+    return type == TYPE_STRING && !out_of_range;
+}
+
+/* Parse a long line in place; at_end means no byte follows it in the mapping */
+static int parse_long_line(ParserContext *ctx, char *line, char *end, bool at_end,
+                           size_t *borrowed) {
+    char *raw_line = line;
+    char *raw_end = end;
+    while (line < end && isspace((unsigned char)*line)) line++;
+    while (end > line && isspace((unsigned char)end[-1])) end--;
+    
+    // Headers, comments, continuations and non-string values parse as usual
+    char *equals = line < end && *line != '[' && *line != '#' && *line != ';' &&
+                   end[-1] != '\\' ? (char*)memchr(line, '=', end - line) : NULL;
+    char *value_start = equals ? equals + 1 : NULL;
+    while (value_start && value_start < end && isspace((unsigned char)*value_start)) {
+        value_start++;
+    }
+    if (!equals || !borrowable_value(ctx, value_start, end, end < raw_end || !at_end)) {
+        return parse_copied_line(ctx, raw_line, raw_end - raw_line);
+    }
+    
+    ctx->line_number++;
+    if (check_line_utf8(ctx, raw_line, raw_end - raw_line) < 0) return -1;
+    
+    char *key_end = equals;
+    while (key_end > line && isspace((unsigned char)key_end[-1])) key_end--;
+    size_t key_len = key_end - line;
+    char *key = key_len <= MAX_KEY_LENGTH ? strndup(line, key_len) : NULL;
+    
+    if (!key || !is_valid_key(key)) {
+        free(key);
+        if (ctx->strict_mode) {
+            set_error(ctx, "Invalid key at line %zu", ctx->line_number);
+            return -1;
+        }
+        return 0;
+    }
+    
+    int multiline = start_multiline(ctx, key, value_start, end - value_start);
+    if (multiline != 0) {
+        return multiline < 0 ? -1 : 0;
+    }
+    
+    char *value_end = end;
+    bool escaped = false;
+    size_t body_len;
+    char *body = (char*)quoted_body(value_start, end - value_start, &body_len, &escaped);
+    if (body) {
+        // The mapping is private, so escapes decode in place
+        value_start = body;
+        value_end = body + (escaped ? decode_escapes(body, body_len, body) : body_len);
+    }
+    
+    ConfigValue *value;
+    if (value_end == end && at_end) {
+        // Nothing after the value to overwrite with a terminator
+        char *copy = strndup(value_start, value_end - value_start);
+        value = copy ? create_string_value(copy) : NULL;
+        free(copy);
+    } else {
+        *value_end = '\0';
+        value = create_borrowed_string_value(value_start);
+        if (value) {
+            (*borrowed)++;
+        }
+    }
+    
+    ConfigEntry *entry = value ? create_entry(key, value, ctx->current_section) : NULL;
+    free(key);
+    if (!entry) {
+        free_value(value);
+        return -1;
+    }
+    
+    return insert_entry(ctx, entry);
+}
+
+/* Returns SOURCE_NOT_MAPPED if filename cannot be mapped (not a plain file) */
+static int parse_mapped_file(ParserContext *ctx, const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return SOURCE_NOT_MAPPED;
+    
+    // Compressed input is left to the streaming reader
+    struct stat st;
+    unsigned char magic[4];
+    ssize_t sniffed = pread(fd, magic, sizeof(magic), 0);
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || sniffed < 0 ||
+        sniff_format(magic, sniffed) != INPUT_PLAIN) {
+        close(fd);
+        return SOURCE_NOT_MAPPED;
+    }
+    
+    size_t size = st.st_size;
+    char *source = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (source == MAP_FAILED) return SOURCE_NOT_MAPPED;
+    
+    SourceMapping *mapping = (SourceMapping*)malloc(sizeof(SourceMapping));
+    if (!mapping) {
+        munmap(source, size);
+        return -1;
+    }
+    
+    // The rest of the last page is zero-filled and may hold a terminator
+    bool slack = size % (size_t)sysconf(_SC_PAGESIZE) != 0;
+    char line[MAX_LINE_LENGTH];
+    size_t borrowed = 0;
+    int result = 0;
+    char *cursor = source;
+    char *source_end = source + size;
+    
+    while (cursor < source_end) {
+        char *newline = (char*)memchr(cursor, '\n', source_end - cursor);
+        char *line_end = newline ? newline : source_end;
+        size_t len = line_end - cursor;
+        content_hash_update(&ctx->raw_hasher, cursor, newline ? len + 1 : len);
+        
+        int line_result;
+        if (ctx->pending_kind != PENDING_NONE) {
+            line_result = continue_pending(ctx, cursor, len);
+        } else if (len >= ctx->borrow_threshold) {
+            line_result = parse_long_line(ctx, cursor, line_end, !newline && !slack, &borrowed);
+        } else if (len < sizeof(line)) {
+            memcpy(line, cursor, len);
+            line[len] = '\0';
+            line_result = parse_line(ctx, line);
+        } else {
+            line_result = parse_copied_line(ctx, cursor, len);
+        }
+        
+        if (line_result < 0) {
+            result = -1;
+            if (ctx->strict_mode) {
+                break;
+            }
+        }
+        cursor = newline ? newline + 1 : source_end;
+    }
+    
+    if (borrowed == 0) {
+        munmap(source, size);
+        free(mapping);
+        return result;
+    }
+    
+    // Keep only what borrowed values point into, read-only
+    mprotect(source, size, PROT_READ);
+    mapping->addr = source;
+    mapping->size = size;
+    mapping->next = ctx->sources;
+    ctx->sources = mapping;
+    return result;
+}
+
+/* Unmap the source files; no value may still borrow from them */
+static void release_sources(ParserContext *ctx) {
+    while (ctx->sources) {
+        SourceMapping *next = ctx->sources->next;
+        munmap(ctx->sources->addr, ctx->sources->size);
+        free(ctx->sources);
+        ctx->sources = next;
+    }
+}
+
+/* File identity and content hash of a parse_file input (see Parse Cache) */
+typedef struct {
+    struct stat st;
+    uint64_t identity;
+    uint64_t content;
+    bool has_content;
+} CacheKey;
+
+static int cache_lookup(ParserContext *ctx, const char *filename, CacheKey *key);
+static void cache_store(ParserContext *ctx, const char *filename, CacheKey *key);
+
+/* Make what a parse added visible to snapshots, expanded, as one epoch */
+static void publish_parsed(ParserContext *ctx) {
+    if (ctx->frozen) return;
+    
+    pthread_mutex_lock(&ctx->write_lock);
+    publish_epoch(ctx, ctx->epoch + 1);
+    pthread_mutex_unlock(&ctx->write_lock);
+}
+
+int parse_file(ParserContext *ctx, const char *filename) {
+    if (!ctx || !filename) return -1;
+    
+    // The cache holds whole files, so only an empty context can use it
+    CacheKey cache_key;
+    bool cacheable = ctx->cache_dir && ctx->entry_count == 0 && !ctx->frozen;
+    ctx->from_cache = false;
+    if (cacheable) {
+        int cached = cache_lookup(ctx, filename, &cache_key);
+        if (cached > 0) {
+            return ctx->build_tree && !config_tree(ctx) ? -1 : 0;
+        }
+        cacheable = cached == 0;
+    }
+    
+    int result = ctx->borrow_threshold ? parse_mapped_file(ctx, filename) : SOURCE_NOT_MAPPED;
+    
+    if (result == SOURCE_NOT_MAPPED) {
+        InputReader *reader = reader_open(ctx, filename);
+        if (!reader) return -1;
+        
+        // Lines are read whole, so values spanning lines see them intact
+        StrBuf line = {NULL, 0, 0};
+        result = 0;
+        
+        while (reader_getline(reader, &line)) {
+            // Remove newline
+            content_hash_update(&ctx->raw_hasher, line.data, line.length);
+            if (line.data[line.length - 1] == '\n') {
+                line.data[line.length - 1] = '\0';
+            }
+            
+            if (parse_line(ctx, line.data) < 0) {
+                result = -1;
+                if (ctx->strict_mode) {
+                    break;
+                }
+            }
+        }
+        
+        free(line.data);
+        if (reader_close(reader) < 0) {
+            set_error(ctx, "Failed to read file: %s", filename);
+            result = -1;
+        }
+    }
+    ctx->raw_hash = content_hash_digest(&ctx->raw_hasher);
+    
+    if (finish_pending(ctx) < 0) {
+        result = -1;
+    }
+    if (check_interpolation_cycles(ctx) < 0) {
+        result = -1;
+    }
+    publish_parsed(ctx);
+    if (cacheable && result == 0) {
+        cache_store(ctx, filename, &cache_key);
+    }
+    if (ctx->build_tree && !config_tree(ctx)) {
+        result = -1;
+    }
+    return result;
+}
+
+int parse_string(ParserContext *ctx, const char *config_str) {
+    if (!ctx || !config_str) return -1;
+    
+    size_t length = strlen(config_str);
+    char *config_copy = (char*)malloc(length + 1);
+    if (!config_copy) return -1;
+    memcpy(config_copy, config_str, length + 1);
+    content_hash_update(&ctx->raw_hasher, config_str, length);
+    ctx->raw_hash = content_hash_digest(&ctx->raw_hasher);
+    
+    // Split on every newline: blank lines matter inside multi-line values
+    char *line = config_copy;
+    int result = 0;
+    
+    while (line && *line) {
+        char *newline = strchr(line, '\n');
+        if (newline) {
+            *newline = '\0';
+        }
+        
+        if (parse_line(ctx, line) < 0) {
+            result = -1;
+            if (ctx->strict_mode) {
+                break;
+            }
+        }
+        line = newline ? newline + 1 : NULL;
+    }
+    
+    free(config_copy);
+    
+    if (finish_pending(ctx) < 0) {
+        result = -1;
+    }
+    if (check_interpolation_cycles(ctx) < 0) {
+        result = -1;
+    }
+    publish_parsed(ctx);
+    if (ctx->build_tree && !config_tree(ctx)) {
+        result = -1;
+    }
+    return result;
+}
+
+/* ========================================================================
+ * Interpolation
+ * ======================================================================== */
+
+static int strbuf_append_value(StrBuf *sb, ConfigValue *value) {
+    char number[64];
+    
+    switch (value->type) {
+        case TYPE_STRING:
+            return strbuf_append(sb, value->data.string_val, strlen(value->data.string_val));
+        case TYPE_INTEGER:
+            snprintf(number, sizeof(number), "%" PRId64, value->data.int_val);
+            return strbuf_append(sb, number, strlen(number));
+        case TYPE_FLOAT:
+            snprintf(number, sizeof(number), "%g", value->data.float_val);
+            return strbuf_append(sb, number, strlen(number));
+        case TYPE_BOOLEAN:
+            return strbuf_append(sb, value->data.bool_val ? "true" : "false",
+                                 value->data.bool_val ? 4 : 5);
+        case TYPE_DURATION:
+        case TYPE_SIZE:
+            format_unit_literal(number, sizeof(number), value->type, value->data.int_val);
+            return strbuf_append(sb, number, strlen(number));
+        case TYPE_TIMESTAMP:
+            format_timestamp(number, sizeof(number), value->data.int_val);
+            return strbuf_append(sb, number, strlen(number));
+        default:
+            return 1; // not representable inline
+    }
+}
+
+bool has_interpolation(const char *str) {
+    if (!str) return false;
+    
+    const char *start = strstr(str, "${");
+    return start && strchr(start + 2, '}') != NULL;
+}
+
+/* Find the next ${name} in str; returns pointer past '}' or NULL */
+static const char* next_reference(const char *str, const char **ref_start,
+                                  const char **name, size_t *name_len) {
+    const char *start = strstr(str, "${");
+    while (start) {
+        const char *end = strchr(start + 2, '}');
+        if (!end) return NULL;
+        if (end > start + 2) {
+            *ref_start = start;
+            *name = start + 2;
+            *name_len = end - (start + 2);
+            return end + 1;
+        }
+        start = strstr(end + 1, "${");
+    }
+    return NULL;
+}
+
+/*
+ * Resolve a reference name relative to the section of the referencing entry.
+ * "key" and "a.b" are first tried as a key in the same section; dotted names
+ * are then split at each '.' from the right into section and key; finally
+ * the name is looked up as a global key.
+ */
+static ConfigEntry* find_reference(ParserContext *ctx, const char *from_section,
+                                   const char *name, size_t name_len) {
+    char buffer[MAX_KEY_LENGTH * 2 + 2];
+    if (name_len == 0 || name_len >= sizeof(buffer)) return NULL;
+    
+    memcpy(buffer, name, name_len);
+    buffer[name_len] = '\0';
+    
+    ConfigEntry *target = find_entry(ctx, from_section, buffer, false);
+    if (target) return target;
+    
+    for (size_t i = name_len; i > 0; i--) {
+        if (buffer[i - 1] != '.') continue;
+        
+        buffer[i - 1] = '\0';
+        target = find_entry(ctx, buffer, buffer + i, false);
+        buffer[i - 1] = '.';
+        if (target) return target;
+    }
+    
+    return from_section ? find_entry(ctx, NULL, buffer, false) : NULL;
+}
+
+static int add_dependent(ConfigEntry *target, ConfigEntry *dependent) {
+    // Only back-to-back repeats are dropped; others are harmless, since a
+    // dependent is no longer live the second time it would be refreshed
+    size_t count = target->dependent_count;
+    if (count > 0 && target->dependents[count - 1] == dependent) return 0;
+    
+    if (target->dependent_count == target->dependent_capacity) {
+        size_t new_capacity = target->dependent_capacity ? target->dependent_capacity * 2 : 4;
+        ConfigEntry **new_dependents = (ConfigEntry**)realloc(
+            target->dependents, new_capacity * sizeof(ConfigEntry*));
+        if (!new_dependents) return -1;
+        target->dependents = new_dependents;
+        target->dependent_capacity = new_capacity;
+    }
+    
+    target->dependents[target->dependent_count++] = dependent;
+    return 0;
+}
+
+/* Expand an entry's template once and memoize the result in its value */
+static int resolve_entry(ParserContext *ctx, ConfigEntry *entry, size_t depth) {
+    if (entry->interp_state == INTERP_NONE || entry->interp_state == INTERP_RESOLVED) {
+        return 0;
+    }
+    
+    if (entry->interp_state == INTERP_RESOLVING || entry->interp_state == INTERP_CYCLE) {
+        entry->interp_state = INTERP_CYCLE;
+        set_error(ctx, "Interpolation cycle detected at key '%s'", entry->key);
+        return -1;
+    }
+    
+    if (depth >= MAX_INTERPOLATION_DEPTH) {
+        set_error(ctx, "Interpolation nesting too deep at key '%s'", entry->key);
+        return -1;
+    }
+    
+    entry->interp_state = INTERP_RESOLVING;
+    
+    StrBuf sb = {NULL, 0, 0};
+    const char *cursor = entry->raw_value;
+    const char *ref_start, *name;
+    size_t name_len;
+    const char *after;
+    int result = 0;
+    
+    while ((after = next_reference(cursor, &ref_start, &name, &name_len))) {
+        if (strbuf_append(&sb, cursor, ref_start - cursor) < 0) {
+            result = -1;
+            break;
+        }
+        
+        ConfigEntry *target = find_reference(ctx, entry->section, name, name_len);
+        int appended = 1;
+        
+        if (target && target != entry) {
+            if (resolve_entry(ctx, target, depth + 1) < 0) {
+                result = -1;
+                break;
+            }
+            if (add_dependent(target, entry) < 0) {
+                result = -1;
+                break;
+            }
+            appended = strbuf_append_value(&sb, target->value);
+        } else if (target == entry) {
+            entry->interp_state = INTERP_CYCLE;
+            set_error(ctx, "Interpolation cycle detected at key '%s'", entry->key);
+            result = -1;
+            break;
+        }
+        
+        // Unknown references and non-scalar targets are kept verbatim
+        if (appended > 0 && strbuf_append(&sb, ref_start, after - ref_start) < 0) {
+            result = -1;
+            break;
+        }
+        if (appended < 0) {
+            result = -1;
+            break;
+        }
+        
+        cursor = after;
+    }
+    
+    if (result == 0 && strbuf_append(&sb, cursor, strlen(cursor)) < 0) {
+        result = -1;
+    }
+    
+    if (result < 0) {
+        free(sb.data);
+        if (entry->interp_state == INTERP_RESOLVING) {
+            entry->interp_state = INTERP_CYCLE;
+        }
+        return -1;
+    }
+    
+    if (!(entry->value->flags & (VALUE_FLAG_INTERNED | VALUE_FLAG_BORROWED))) {
+        free(entry->value->data.string_val);
+    }
+    entry->value->data.string_val = sb.data;
+    entry->value->flags &= ~(VALUE_FLAG_INTERNED | VALUE_FLAG_BORROWED);
+    entry->interp_state = INTERP_RESOLVED;
+    entry->coerce_state = COERCE_EMPTY;
+    
+    return 0;
+}
+
+/* Expand every pending template; only for versions no snapshot can see yet */
+static int resolve_pending(ParserContext *ctx) {
+    int result = 0;
+    for (ConfigEntry *current = ctx->entries; current; current = current->next) {
+        if (resolve_entry(ctx, current, 0) < 0) {
+            result = -1;
+        }
+    }
+    
+    return result;
+}
+
+/* Expand and publish entries added with parse_line or add_entry */
+int resolve_interpolations(ParserContext *ctx) {
+    if (!ctx) return -1;
+    if (ctx->interpolated_count == 0) return 0;
+    
+    pthread_mutex_lock(&ctx->write_lock);
+    int result = resolve_pending(ctx);
+    if (ctx->unexpanded) {
+        ctx->unexpanded = false;
+        publish_epoch(ctx, ctx->epoch + 1);
+    }
+    pthread_mutex_unlock(&ctx->write_lock);
+    return result;
+}
+
+/* Depth-first search over reference edges: 1 = on stack, 2 = done */
+static int visit_references(ParserContext *ctx, ConfigEntry *entry, size_t depth) {
+    if (entry->interp_state == INTERP_NONE || entry->mark == 2) return 0;
+    
+    if (entry->mark == 1 || entry->interp_state == INTERP_CYCLE) {
+        entry->interp_state = INTERP_CYCLE;
+        set_error(ctx, "Interpolation cycle detected at key '%s'", entry->key);
+        return -1;
+    }
+    
+    if (depth >= MAX_INTERPOLATION_DEPTH) {
+        set_error(ctx, "Interpolation nesting too deep at key '%s'", entry->key);
+        return -1;
+    }
+    
+    entry->mark = 1;
+    
+    const char *cursor = entry->raw_value;
+    const char *ref_start, *name;
+    size_t name_len;
+    int result = 0;
+    
+    while ((cursor = next_reference(cursor, &ref_start, &name, &name_len))) {
+        ConfigEntry *target = find_reference(ctx, entry->section, name, name_len);
+        if (target && visit_references(ctx, target, depth + 1) < 0) {
+            entry->interp_state = INTERP_CYCLE;
+            result = -1;
+            break;
+        }
+    }
+    
+    entry->mark = 2;
+    return result;
+}
+
+int check_interpolation_cycles(ParserContext *ctx) {
+    if (!ctx) return -1;
+    if (ctx->interpolated_count == 0) return 0;
+    
+    int result = 0;
+    for (ConfigEntry *current = ctx->entries; current; current = current->next) {
+        current->mark = 0;
+    }
+    for (ConfigEntry *current = ctx->entries; current; current = current->next) {
+        if (visit_references(ctx, current, 0) < 0) {
+            result = -1;
+        }
+    }
+    
+    return result;
+}
+
+/* Re-expand the dependents of (section, key) as new versions, as config_set does */
+void invalidate_value(ParserContext *ctx, const char *section, const char *key) {
+    if (!ctx || !key || ctx->frozen) return;
+    
+    pthread_mutex_lock(&ctx->write_lock);
+    ConfigEntry *entry = find_entry(ctx, section, key, false);
+    if (entry) {
+        unsigned long long epoch = ctx->epoch + 1;
+        refresh_dependents(ctx, entry, epoch);
+        publish_epoch(ctx, epoch);
+    }
+    pthread_mutex_unlock(&ctx->write_lock);
+}
+
+/* ========================================================================
+ * Prefix Index
+ * ======================================================================== */
+
+static void prefix_index_clear(ParserContext *ctx) {
+    for (size_t i = 0; i < ctx->prefix_index_count; i++) {
+        free(ctx->prefix_index[i].path);
+    }
+    free(ctx->prefix_index);
+    ctx->prefix_index = NULL;
+    ctx->prefix_index_count = 0;
+    
+    // Section items borrow their names from the entries
+    free(ctx->section_index);
+    ctx->section_index = NULL;
+    ctx->section_index_count = 0;
+}
+
+static int compare_index_items(const void *a, const void *b) {
+    const PrefixIndexItem *item_a = (const PrefixIndexItem*)a;
+    const PrefixIndexItem *item_b = (const PrefixIndexItem*)b;
+    return strcmp(item_a->path, item_b->path);
+}
+
+static char* build_entry_path(const ConfigEntry *entry) {
+    size_t key_len = strlen(entry->key);
+    size_t section_len = entry->section ? strlen(entry->section) + 1 : 0;
+    
+    char *path = (char*)malloc(section_len + key_len + 1);
+    if (!path) return NULL;
+    
+    if (entry->section) {
+        memcpy(path, entry->section, section_len - 1);
+        path[section_len - 1] = '.';
+    }
+    memcpy(path + section_len, entry->key, key_len + 1);
+    
+    return path;
+}
+
+static int prefix_index_build(ParserContext *ctx) {
+    prefix_index_clear(ctx);
+    ctx->prefix_index_dirty = false;
+    if (ctx->entry_count == 0) return 0;
+    
+    ctx->prefix_index = (PrefixIndexItem*)malloc(ctx->entry_count * sizeof(PrefixIndexItem));
+    ctx->section_index = (PrefixIndexItem*)malloc(ctx->entry_count * sizeof(PrefixIndexItem));
+    if (!ctx->prefix_index || !ctx->section_index) {
+        prefix_index_clear(ctx);
+        return -1;
+    }
+    
+    size_t sections = 0;
+    for (ConfigEntry *current = ctx->entries; current; current = current->next) {
+        char *path = build_entry_path(current);
+        if (!path) {
+            prefix_index_clear(ctx);
+            return -1;
+        }
+        ctx->prefix_index[ctx->prefix_index_count].path = path;
+        ctx->prefix_index[ctx->prefix_index_count].entry = current;
+        ctx->prefix_index_count++;
+        
+        if (current->section) {
+            ctx->section_index[sections].path = current->section;
+            ctx->section_index[sections].entry = current;
+            sections++;
+        }
+    }
+    
+    qsort(ctx->prefix_index, ctx->prefix_index_count, sizeof(PrefixIndexItem),
+          compare_index_items);
+    
+    // Sort sections and keep the first entry of each distinct name
+    qsort(ctx->section_index, sections, sizeof(PrefixIndexItem), compare_index_items);
+    for (size_t i = 0; i < sections; i++) {
+        if (ctx->section_index_count > 0 &&
+            strcmp(ctx->section_index[ctx->section_index_count - 1].path,
+                   ctx->section_index[i].path) == 0) {
+            continue;
+        }
+        ctx->section_index[ctx->section_index_count++] = ctx->section_index[i];
+    }
+    
+    return 0;
+}
+
+/* strcmp of path against the dotted path of entry, without building it */
+static int compare_entry_path(const char *path, const ConfigEntry *entry) {
+    if (entry->section) {
+        size_t section_len = strlen(entry->section);
+        int order = strncmp(path, entry->section, section_len);
+        if (order != 0) return order;
+        path += section_len;
+        if (*path != '.') return (unsigned char)*path - (unsigned char)'.';
+        path++;
+    }
+    return strcmp(path, entry->key);
+}
+
+/*
+ * Point the items of old at its new version. A new version keeps the key
+ * and section, so its place in the sorted order does not change and live
+ * cursors stay valid.
+ */
+static void prefix_index_replace(ParserContext *ctx, ConfigEntry *old, ConfigEntry *entry) {
+    size_t low = 0, high = ctx->prefix_index_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (compare_entry_path(ctx->prefix_index[mid].path, old) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    for (; low < ctx->prefix_index_count &&
+           compare_entry_path(ctx->prefix_index[low].path, old) == 0; low++) {
+        if (ctx->prefix_index[low].entry == old) {
+            ctx->prefix_index[low].entry = entry;
+            break;
+        }
+    }
+    
+    // Section items borrow the name, which goes away with the old version
+    if (!old->section) return;
+    low = 0;
+    high = ctx->section_index_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (strcmp(ctx->section_index[mid].path, old->section) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < ctx->section_index_count && ctx->section_index[low].entry == old) {
+        ctx->section_index[low].entry = entry;
+        ctx->section_index[low].path = entry->section;
+    }
+}
+
+/* Binary search for the run of items whose path starts with prefix */
+static void prefix_range(const PrefixIndexItem *items, size_t count, const char *prefix,
+                         size_t *first, size_t *last) {
+    size_t prefix_len = strlen(prefix);
+    size_t low = 0, high = count;
+    
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (strcmp(items[mid].path, prefix) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *first = low;
+    
+    high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (strncmp(items[mid].path, prefix, prefix_len) == 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *last = low;
+}
+
+static int scan_index(ParserContext *ctx, const char *prefix, ConfigCursor *cursor,
+                      bool sections) {
+    if (!ctx || !prefix || !cursor) return -1;
+    
+    cursor->items = NULL;
+    cursor->position = 0;
+    cursor->end = 0;
+    
+    // Rebuild under the write lock, so no writer updates the index meanwhile
+    if (ctx->prefix_index_dirty || (!ctx->prefix_index && ctx->entry_count > 0)) {
+        pthread_mutex_lock(&ctx->write_lock);
+        int built = 0;
+        if (ctx->prefix_index_dirty || (!ctx->prefix_index && ctx->entry_count > 0)) {
+            built = prefix_index_build(ctx);
+        }
+        pthread_mutex_unlock(&ctx->write_lock);
+        if (built < 0) {
+            set_error(ctx, "Out of memory while building prefix index");
+            return -1;
+        }
+    }
+    
+    const PrefixIndexItem *items = sections ? ctx->section_index : ctx->prefix_index;
+    size_t count = sections ? ctx->section_index_count : ctx->prefix_index_count;
+    
+    // Indexed paths are folded, so the prefix must be too
+    char *folded = NULL;
+    if (ctx->case_insensitive) {
+        folded = strdup(prefix);
+        if (!folded) return -1;
+        fold_name(folded);
+        prefix = folded;
+    }
+    
+    cursor->items = items;
+    prefix_range(items, count, prefix, &cursor->position, &cursor->end);
+    free(folded);
+    return 0;
+}
+
+int config_prefix_scan(ParserContext *ctx, const char *prefix, ConfigCursor *cursor) {
+    return scan_index(ctx, prefix, cursor, false);
+}
+
+int config_section_scan(ParserContext *ctx, const char *prefix, ConfigCursor *cursor) {
+    return scan_index(ctx, prefix, cursor, true);
+}
+
+bool config_cursor_next(ConfigCursor *cursor, const char **path, ConfigEntry **entry) {
+    if (!cursor || cursor->position >= cursor->end) return false;
+    
+    const PrefixIndexItem *item = &cursor->items[cursor->position++];
+    if (path) *path = item->path;
+    if (entry) *entry = item->entry;
+    return true;
+}
+
+size_t config_cursor_count(const ConfigCursor *cursor) {
+    if (!cursor || cursor->position >= cursor->end) return 0;
+    return cursor->end - cursor->position;
+}
+
+/* ========================================================================
+ * Tree View
+ * ======================================================================== */
+
+/* Staging node used while building; siblings are linked in insertion order */
+typedef struct {
+    const char *name;
+    size_t parent;
+    size_t first_child;
+    size_t last_child;
+    size_t next_sibling;
+    ConfigEntry *entry;
+} TreeStageNode;
+
+typedef struct {
+    TreeStageNode *nodes;
+    size_t count;
+    size_t capacity;
+    size_t *lookup;           /* (parent, segment) -> node, open addressing */
+    size_t lookup_capacity;
+    StringPool *segments;
+} TreeStage;
+
+static size_t stage_lookup_slot(const TreeStage *stage, size_t parent, const char *name) {
+    unsigned long hash = (unsigned long)parent * 2654435761UL ^ (unsigned long)(uintptr_t)name;
+    hash ^= hash >> 15;
+    return hash & (stage->lookup_capacity - 1);
+}
+
+static int stage_grow_lookup(TreeStage *stage) {
+    size_t new_capacity = stage->lookup_capacity ? stage->lookup_capacity * 2 : 256;
+    size_t *new_lookup = (size_t*)malloc(new_capacity * sizeof(size_t));
+    if (!new_lookup) return -1;
+    
+    for (size_t i = 0; i < new_capacity; i++) {
+        new_lookup[i] = CONFIG_TREE_NONE;
+    }
+    
+    free(stage->lookup);
+    stage->lookup = new_lookup;
+    stage->lookup_capacity = new_capacity;
+    
+    // The root is never looked up by name
+    for (size_t id = 1; id < stage->count; id++) {
+        size_t slot = stage_lookup_slot(stage, stage->nodes[id].parent, stage->nodes[id].name);
+        while (stage->lookup[slot] != CONFIG_TREE_NONE) {
+            slot = (slot + 1) & (stage->lookup_capacity - 1);
+        }
+        stage->lookup[slot] = id;
+    }
+    
+    return 0;
+}
+
+static size_t stage_add_node(TreeStage *stage, size_t parent, const char *name) {
+    if (stage->count == stage->capacity) {
+        size_t new_capacity = stage->capacity ? stage->capacity * 2 : 64;
+        TreeStageNode *new_nodes = (TreeStageNode*)realloc(
+            stage->nodes, new_capacity * sizeof(TreeStageNode));
+        if (!new_nodes) return CONFIG_TREE_NONE;
+        stage->nodes = new_nodes;
+        stage->capacity = new_capacity;
+    }
+    
+    size_t id = stage->count++;
+    TreeStageNode *node = &stage->nodes[id];
+    node->name = name;
+    node->parent = parent;
+    node->first_child = CONFIG_TREE_NONE;
+    node->last_child = CONFIG_TREE_NONE;
+    node->next_sibling = CONFIG_TREE_NONE;
+    node->entry = NULL;
+    
+    if (parent != CONFIG_TREE_NONE) {
+        TreeStageNode *parent_node = &stage->nodes[parent];
+        if (parent_node->last_child == CONFIG_TREE_NONE) {
+            parent_node->first_child = id;
+        } else {
+            stage->nodes[parent_node->last_child].next_sibling = id;
+        }
+        parent_node->last_child = id;
+    }
+    
+    return id;
+}
+
+static size_t stage_child(TreeStage *stage, size_t parent, const char *segment, size_t len) {
+    const char *name = string_pool_intern(stage->segments, segment, len);
+    if (!name) return CONFIG_TREE_NONE;
+    
+    if (stage->count * 2 >= stage->lookup_capacity) {
+        if (stage_grow_lookup(stage) < 0) return CONFIG_TREE_NONE;
+    }
+    
+    // Interned names compare by pointer
+    size_t slot = stage_lookup_slot(stage, parent, name);
+    while (stage->lookup[slot] != CONFIG_TREE_NONE) {
+        TreeStageNode *node = &stage->nodes[stage->lookup[slot]];
+        if (node->parent == parent && node->name == name) {
+            return stage->lookup[slot];
+        }
+        slot = (slot + 1) & (stage->lookup_capacity - 1);
+    }
+    
+    size_t id = stage_add_node(stage, parent, name);
+    if (id != CONFIG_TREE_NONE) {
+        stage->lookup[slot] = id;
+    }
+    return id;
+}
+
+static size_t stage_path(TreeStage *stage, size_t node, const char *path) {
+    const char *segment = path;
+    while (node != CONFIG_TREE_NONE) {
+        const char *dot = strchr(segment, '.');
+        size_t len = dot ? (size_t)(dot - segment) : strlen(segment);
+        node = stage_child(stage, node, segment, len);
+        if (!dot) break;
+        segment = dot + 1;
+    }
+    return node;
+}
+
+static ConfigTree* tree_build(ParserContext *ctx) {
+    TreeStage stage = {NULL, 0, 0, NULL, 0, NULL};
+    ConfigTree *tree = NULL;
+    size_t *new_ids = NULL;
+    
+    stage.segments = string_pool_create();
+    if (!stage.segments) goto fail;
+    if (stage_add_node(&stage, CONFIG_TREE_NONE, "") == CONFIG_TREE_NONE) goto fail;
+    if (stage_grow_lookup(&stage) < 0) goto fail;
+    
+    for (ConfigEntry *current = ctx->entries; current; current = current->next) {
+        size_t node = 0;
+        if (current->section) {
+            node = stage_path(&stage, node, current->section);
+        }
+        node = stage_path(&stage, node, current->key);
+        if (node == CONFIG_TREE_NONE) goto fail;
+        
+        // First definition wins, as with get_value_in_section
+        if (!stage.nodes[node].entry) {
+            stage.nodes[node].entry = current;
+        }
+    }
+    
+    tree = (ConfigTree*)malloc(sizeof(ConfigTree));
+    new_ids = (size_t*)malloc(stage.count * sizeof(size_t));
+    if (!tree || !new_ids) goto fail;
+    
+    tree->nodes = (ConfigTreeNode*)malloc(stage.count * sizeof(ConfigTreeNode));
+    if (!tree->nodes) goto fail;
+    tree->node_count = stage.count;
+    
+    // Breadth-first layout makes every node's children contiguous
+    size_t *order = new_ids;    // order[i] = staging id of output node i
+    size_t tail = 0;
+    order[tail++] = 0;
+    for (size_t i = 0; i < tail; i++) {
+        for (size_t child = stage.nodes[order[i]].first_child; child != CONFIG_TREE_NONE;
+             child = stage.nodes[child].next_sibling) {
+            order[tail++] = child;
+        }
+    }
+    
+    for (size_t i = 0; i < tree->node_count; i++) {
+        TreeStageNode *staged = &stage.nodes[order[i]];
+        tree->nodes[i].name = staged->name;
+        tree->nodes[i].entry = staged->entry;
+        tree->nodes[i].parent = CONFIG_TREE_NONE;
+        tree->nodes[i].first_child = CONFIG_TREE_NONE;
+        tree->nodes[i].child_count = 0;
+    }
+    
+    // Children follow their parent's position in breadth-first order
+    size_t next = 1;
+    for (size_t i = 0; i < tree->node_count; i++) {
+        for (size_t child = stage.nodes[order[i]].first_child; child != CONFIG_TREE_NONE;
+             child = stage.nodes[child].next_sibling) {
+            if (tree->nodes[i].child_count == 0) {
+                tree->nodes[i].first_child = next;
+            }
+            tree->nodes[i].child_count++;
+            tree->nodes[next++].parent = i;
+        }
+    }
+    
+    tree->segments = stage.segments;
+    tree->fold_case = ctx->case_insensitive;
+    free(new_ids);
+    free(stage.nodes);
+    free(stage.lookup);
+    return tree;
+    
+fail:
+    if (tree) free(tree->nodes);
+    free(tree);
+    free(new_ids);
+    free(stage.nodes);
+    free(stage.lookup);
+    string_pool_free(stage.segments);
+    return NULL;
+}
+
+const ConfigTree* config_tree(ParserContext *ctx) {
+    if (!ctx) return NULL;
+    
+    if (!ctx->tree || ctx->tree_dirty) {
+        config_tree_free(ctx->tree);
+        ctx->tree = tree_build(ctx);
+        ctx->tree_dirty = false;
+        if (!ctx->tree) {
+            set_error(ctx, "Out of memory while building tree view");
+        }
+    }
+    
+    return ctx->tree;
+}
+
+size_t config_tree_find(const ConfigTree *tree, size_t node_id, const char *path) {
+    if (!tree || !path || node_id >= tree->node_count) return CONFIG_TREE_NONE;
+    
+    const char *segment = path;
+    while (*segment) {
+        const char *dot = strchr(segment, '.');
+        size_t len = dot ? (size_t)(dot - segment) : strlen(segment);
+        
+        const ConfigTreeNode *node = &tree->nodes[node_id];
+        size_t found = CONFIG_TREE_NONE;
+        for (size_t i = 0; i < node->child_count; i++) {
+            const char *name = tree->nodes[node->first_child + i].name;
+            if ((tree->fold_case ? strncasecmp(name, segment, len) : strncmp(name, segment, len)) == 0 &&
+                name[len] == '\0') {
+                found = node->first_child + i;
+                break;
+            }
+        }
+        
+        if (found == CONFIG_TREE_NONE) return CONFIG_TREE_NONE;
+        node_id = found;
+        if (!dot) break;
+        segment = dot + 1;
+    }
+    
+    return node_id;
+}
+
+static int tree_walk(const ConfigTree *tree, size_t node_id, size_t depth,
+                     ConfigTreeVisitor visitor, void *userdata) {
+    int result = visitor(tree, node_id, depth, userdata);
+    if (result != 0) return result;
+    
+    const ConfigTreeNode *node = &tree->nodes[node_id];
+    for (size_t i = 0; i < node->child_count; i++) {
+        result = tree_walk(tree, node->first_child + i, depth + 1, visitor, userdata);
+        if (result != 0) return result;
+    }
+    
+    return 0;
+}
+
+int config_tree_walk(const ConfigTree *tree, size_t node_id, ConfigTreeVisitor visitor,
+                     void *userdata) {
+    if (!tree || !visitor || node_id >= tree->node_count) return -1;
+    return tree_walk(tree, node_id, 0, visitor, userdata);
+}
+
+void config_tree_free(ConfigTree *tree) {
+    if (!tree) return;
+    
+    free(tree->nodes);
+    string_pool_free(tree->segments);
+    free(tree);
+}
+
+/* ========================================================================
+ * Freeze / Compaction
+ * ======================================================================== */
+
+#define FREEZE_ALIGNMENT 16
+
+static size_t freeze_align(size_t size) {
+    return (size + FREEZE_ALIGNMENT - 1) & ~(size_t)(FREEZE_ALIGNMENT - 1);
+}
+
+static size_t array_element_size(ConfigValueType type, const void *element) {
+    switch (type) {
+        case TYPE_INTEGER: return sizeof(int64_t);
+        case TYPE_FLOAT:   return sizeof(double);
+        default:           return strlen((const char*)element) + 1;
+    }
+}
+
+/* Bytes a value's payload occupies in the block, beyond the ConfigValue */
+static size_t freeze_payload_size(const ConfigValue *value) {
+    if (value->type == TYPE_STRING) {
+        return freeze_align(strlen(value->data.string_val) + 1);
+    }
+    if (value->type != TYPE_ARRAY) return 0;
+    
+    ConfigValueType element_type = value->data.array_val.element_type;
+    size_t size = freeze_align(value->data.array_val.count * sizeof(void*));
+    for (size_t i = 0; i < value->data.array_val.count; i++) {
+        const void *element = value->data.array_val.elements[i];
+        if (element_type == TYPE_ARRAY) {
+            size += freeze_align(sizeof(ConfigValue)) +
+                    freeze_payload_size((const ConfigValue*)element);
+        } else {
+            size += freeze_align(array_element_size(element_type, element));
+        }
+    }
+    return size;
+}
+
+/* Bytes an entry occupies in the block: entry, value, key and payload */
+static size_t freeze_record_size(const ConfigEntry *entry) {
+    return freeze_align(sizeof(ConfigEntry)) + freeze_align(sizeof(ConfigValue)) +
+           freeze_align(strlen(entry->key) + 1) + freeze_payload_size(entry->value);
+}
+
+static void* freeze_copy(char **cursor, const void *src, size_t len) {
+    void *dst = *cursor;
+    memcpy(dst, src, len);
+    *cursor += freeze_align(len);
+    return dst;
+}
+
+/* Move a copied value's payload into the block, nested arrays included */
+static void freeze_payload(char **cursor, ConfigValue *value) {
+    value->flags &= ~(VALUE_FLAG_INTERNED | VALUE_FLAG_BORROWED);
+    
+    if (value->type == TYPE_STRING) {
+        const char *str = value->data.string_val;
+        value->data.string_val = (char*)freeze_copy(cursor, str, strlen(str) + 1);
+    } else if (value->type == TYPE_ARRAY) {
+        ConfigValueType element_type = value->data.array_val.element_type;
+        size_t count = value->data.array_val.count;
+        void **elements = (void**)freeze_copy(cursor, value->data.array_val.elements,
+                                              count * sizeof(void*));
+        for (size_t i = 0; i < count; i++) {
+            if (element_type == TYPE_ARRAY) {
+                elements[i] = freeze_copy(cursor, elements[i], sizeof(ConfigValue));
+                freeze_payload(cursor, (ConfigValue*)elements[i]);
+            } else {
+                elements[i] = freeze_copy(cursor, elements[i],
+                                          array_element_size(element_type, elements[i]));
+            }
+        }
+        value->data.array_val.elements = elements;
+    }
+}
+
+static void freeze_record(char **cursor, ConfigEntry *frozen_entry, const ConfigEntry *entry) {
+    *cursor += freeze_align(sizeof(ConfigEntry));
+    ConfigValue *value = (ConfigValue*)freeze_copy(cursor, entry->value, sizeof(ConfigValue));
+    
+    frozen_entry->key = (char*)freeze_copy(cursor, entry->key, strlen(entry->key) + 1);
+    frozen_entry->value = value;
+    frozen_entry->hash = entry->hash;
+    frozen_entry->born = 0;
+    frozen_entry->died = ENTRY_LIVE;
+    frozen_entry->unlinked = 0;
+    frozen_entry->retired_next = NULL;
+    frozen_entry->raw_value = NULL;
+    frozen_entry->interp_state = entry->interp_state;
+    frozen_entry->mark = 0;
+    frozen_entry->dependents = NULL;
+    frozen_entry->dependent_count = 0;
+    frozen_entry->dependent_capacity = 0;
+    frozen_entry->coerce_status = CONFIG_OK;
+    frozen_entry->coerce_state = COERCE_EMPTY;
+    
+    freeze_payload(cursor, value);
+}
+
+/*
+ * Pack every entry, value, string and the hash index into one mmap'd block
+ * laid out in lookup order (bucket by bucket, chain by chain), then free the
+ * individual allocations, the value pool and the mapped source files. With
+ * protect set, the block is made read-only. A frozen context rejects
+ * further entries.
+ */
+int config_freeze(ParserContext *ctx, bool protect) {
+    if (!ctx) return -1;
+    if (ctx->frozen) return 0;
+    
+    // Expand once so frozen values never need writing
+    resolve_interpolations(ctx);
+    
+    for (size_t slot = 0; slot < CONFIG_MAX_SNAPSHOTS; slot++) {
+        if (__atomic_load_n(&ctx->snapshot_slots[slot], __ATOMIC_SEQ_CST)) {
+            set_error(ctx, "Cannot freeze while snapshots are active");
+            return -1;
+        }
+    }
+    if (ctx->retired && index_grow(ctx) < 0) {
+        set_error(ctx, "Out of memory while freezing");
+        return -1;
+    }
+    
+    if (ctx->entry_count == 0 || !ctx->index) {
+        set_error(ctx, "Nothing to freeze");
+        return -1;
+    }
+    
+    size_t count = ctx->entry_count;
+    ConfigEntry **order = (ConfigEntry**)malloc(count * sizeof(ConfigEntry*));
+    size_t *offsets = (size_t*)malloc(count * sizeof(size_t));
+    StringPool *sections = string_pool_create();
+    if (!order || !offsets || !sections) {
+        free(order);
+        free(offsets);
+        string_pool_free(sections);
+        set_error(ctx, "Out of memory while freezing");
+        return -1;
+    }
+    
+    // Assign records in lookup order; sections are shared, so pool them
+    size_t ordinal = 0;
+    size_t records_size = 0;
+    int result = 0;
+    for (size_t bucket = 0; bucket < ctx->index_size; bucket++) {
+        for (ConfigEntry *current = ctx->index[bucket]; current; current = current->hash_next) {
+            current->mark = ordinal;
+            order[ordinal] = current;
+            offsets[ordinal] = records_size;
+            records_size += freeze_record_size(current);
+            ordinal++;
+            
+            if (current->section &&
+                !string_pool_intern(sections, current->section, strlen(current->section))) {
+                result = -1;
+            }
+        }
+    }
+    
+    size_t index_bytes = freeze_align(ctx->index_size * sizeof(ConfigEntry*));
+    size_t sections_bytes = 0;
+    for (size_t i = 0; i < sections->capacity; i++) {
+        if (sections->slots[i]) {
+            sections_bytes += freeze_align(strlen(sections->slots[i]) + 1);
+        }
+    }
+    
+    size_t total = index_bytes + sections_bytes + records_size;
+    void *block = MAP_FAILED;
+    if (result == 0) {
+        block = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (block == MAP_FAILED) {
+        free(order);
+        free(offsets);
+        string_pool_free(sections);
+        set_error(ctx, "Out of memory while freezing");
+        return -1;
+    }
+    
+    char *base = (char*)block;
+    ConfigEntry **frozen_index = (ConfigEntry**)base;
+    char *records = base + index_bytes + sections_bytes;
+    
+    // Copy distinct sections and point each pool slot at its frozen copy
+    char *cursor = base + index_bytes;
+    for (size_t i = 0; i < sections->capacity; i++) {
+        if (!sections->slots[i]) continue;
+        char *copy = (char*)freeze_copy(&cursor, sections->slots[i],
+                                        strlen(sections->slots[i]) + 1);
+        free(sections->slots[i] - POOL_HEADER_SIZE);
+        sections->slots[i] = copy;
+    }
+    
+    #define FROZEN_ENTRY(old) ((old) ? (ConfigEntry*)(records + offsets[(old)->mark]) : NULL)
+    
+    for (size_t i = 0; i < count; i++) {
+        ConfigEntry *entry = order[i];
+        ConfigEntry *frozen_entry = FROZEN_ENTRY(entry);
+        cursor = (char*)frozen_entry;
+        freeze_record(&cursor, frozen_entry, entry);
+        
+        frozen_entry->section = entry->section ?
+            (char*)string_pool_intern(sections, entry->section, strlen(entry->section)) : NULL;
+        frozen_entry->next = FROZEN_ENTRY(entry->next);
+        frozen_entry->prev = FROZEN_ENTRY(entry->prev);
+        frozen_entry->hash_next = FROZEN_ENTRY(entry->hash_next);
+    }
+    
+    for (size_t bucket = 0; bucket < ctx->index_size; bucket++) {
+        frozen_index[bucket] = FROZEN_ENTRY(ctx->index[bucket]);
+    }
+    
+    ConfigEntry *frozen_entries = FROZEN_ENTRY(ctx->entries);
+    ConfigEntry *frozen_tail = FROZEN_ENTRY(ctx->entries_tail);
+    
+    #undef FROZEN_ENTRY
+    
+    // The pool's slots now point into the block; release only its table
+    free(sections->slots);
+    free(sections);
+    free(offsets);
+    
+    for (size_t i = 0; i < count; i++) {
+        free_entry(order[i]);
+    }
+    free(order);
+    free(ctx->index);
+    
+    // Every string now has a copy in the block, so interned and borrowed
+    // storage is no longer referenced
+    string_pool_free(ctx->value_pool);
+    ctx->value_pool = NULL;
+    release_sources(ctx);
+    
+    // Views hold pointers to the old entries
+    prefix_index_clear(ctx);
+    config_tree_free(ctx->tree);
+    ctx->tree = NULL;
+    ctx->prefix_index_dirty = true;
+    ctx->tree_dirty = true;
+    
+    ctx->entries = frozen_entries;
+    ctx->entries_tail = frozen_tail;
+    ctx->index = frozen_index;
+    ctx->interpolated_count = 0;
+    ctx->frozen_block = block;
+    ctx->frozen_size = total;
+    ctx->frozen = true;
+    
+    if (protect && mprotect(block, total, PROT_READ) < 0) {
+        set_error(ctx, "Failed to write-protect frozen configuration");
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* ========================================================================
+ * Parse Cache
+ * ======================================================================== */
+
+/*
+ * With a cache directory set, parse_file stores the frozen block of every
+ * file it parses as "<content hash>.cfgc" and links "<identity hash>.id"
+ * to it, where the identity covers (path, device, inode, mtime, size).
+ * A later parse_file of an unchanged file, or of any file with the same
+ * bytes, maps the image instead of parsing, so the context comes back
+ * frozen.
+ *
+ * Images are linked at a preferred address derived from the content hash.
+ * When that range is free the image is mapped there read-only and used as
+ * is; otherwise its pointers are rebased once after mapping. Files are
+ * written to a temporary name and renamed into place, and the least
+ * recently used images are removed once the directory exceeds its bound.
+ */
+
+#define CACHE_MAGIC "CFGCACHE"
+#define CACHE_VERSION 2
+#define CACHE_LINK_REGION 0x600000000000ULL
+#define CACHE_LINK_STRIDE (1ULL << 24)
+#define CACHE_LINK_SLOTS (1ULL << 20)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;           /* page aligned; the block follows */
+    uint64_t layout;                /* sizes of the linked structures */
+    uint64_t link_base;             /* address the block's pointers assume */
+    uint64_t block_size;
+    uint64_t index_size;
+    uint64_t entry_count;
+    uint64_t entries;               /* offsets into the block */
+    uint64_t entries_tail;
+    uint64_t source_size;
+    uint64_t raw_hash;
+    uint64_t canonical_hash;
+} CacheHeader;
+
+static int write_all(int fd, const void *data, size_t len);
+
+static uint64_t cache_layout(void) {
+    return ((uint64_t)sizeof(ConfigEntry) << 32) | ((uint64_t)sizeof(ConfigValue) << 16) |
+           sizeof(void*);
+}
+
+static size_t cache_header_size(void) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (sizeof(CacheHeader) + page - 1) & ~(page - 1);
+}
+
+/* Shift every pointer of a block from from_base to to_base; block holds the data */
+#define CACHE_REBASE(ptr) ((ptr) ? (void*)((uintptr_t)(ptr) - from_base + to_base) : NULL)
+#define CACHE_LOCAL(ptr) ((void*)(block + ((uintptr_t)(ptr) - from_base)))
+
+static void cache_relocate_value(char *block, ConfigValue *value, uintptr_t from_base,
+                                 uintptr_t to_base) {
+    if (value->type == TYPE_STRING) {
+        value->data.string_val = (char*)CACHE_REBASE(value->data.string_val);
+    } else if (value->type == TYPE_ARRAY) {
+        void **elements = (void**)CACHE_LOCAL(value->data.array_val.elements);
+        for (size_t i = 0; i < value->data.array_val.count; i++) {
+            if (value->data.array_val.element_type == TYPE_ARRAY) {
+                cache_relocate_value(block, (ConfigValue*)CACHE_LOCAL(elements[i]),
+                                     from_base, to_base);
+            }
+            elements[i] = CACHE_REBASE(elements[i]);
+        }
+        value->data.array_val.elements = (void**)CACHE_REBASE(value->data.array_val.elements);
+    }
+}
+
+static void cache_relocate(char *block, size_t index_size, ConfigEntry *first,
+                           uintptr_t from_base, uintptr_t to_base) {
+    ConfigEntry **index = (ConfigEntry**)block;
+    for (size_t bucket = 0; bucket < index_size; bucket++) {
+        index[bucket] = (ConfigEntry*)CACHE_REBASE(index[bucket]);
+    }
+    
+    ConfigEntry *current = first ? (ConfigEntry*)CACHE_LOCAL(first) : NULL;
+    while (current) {
+        ConfigEntry *next = current->next ? (ConfigEntry*)CACHE_LOCAL(current->next) : NULL;
+        cache_relocate_value(block, (ConfigValue*)CACHE_LOCAL(current->value),
+                             from_base, to_base);
+        
+        current->key = (char*)CACHE_REBASE(current->key);
+        current->value = (ConfigValue*)CACHE_REBASE(current->value);
+        current->section = (char*)CACHE_REBASE(current->section);
+        current->next = (ConfigEntry*)CACHE_REBASE(current->next);
+        current->prev = (ConfigEntry*)CACHE_REBASE(current->prev);
+        current->hash_next = (ConfigEntry*)CACHE_REBASE(current->hash_next);
+        current = next;
+    }
+}
+
+#undef CACHE_REBASE
+#undef CACHE_LOCAL
+
+static char* cache_path(const char *dir, uint64_t hash, const char *suffix) {
+    size_t size = strlen(dir) + 32;
+    char *path = (char*)malloc(size);
+    if (path) {
+        snprintf(path, size, "%s/%016llx%s", dir, (unsigned long long)hash, suffix);
+    }
+    return path;
+}
+
+/* Enable the cache for later parse_file calls; max_bytes 0 means unbounded */
+int config_cache_enable(ParserContext *ctx, const char *dir, size_t max_bytes) {
+    if (!ctx || !dir) return -1;
+    
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+        set_error(ctx, "Failed to create cache directory: %s", dir);
+        return -1;
+    }
+    
+    char *copy = strdup(dir);
+    if (!copy) return -1;
+    
+    free(ctx->cache_dir);
+    ctx->cache_dir = copy;
+    ctx->cache_max_bytes = max_bytes;
+    return 0;
+}
+
+static uint64_t cache_identity(const char *filename, const struct stat *st) {
+    ContentHasher hasher;
+    content_hash_init(&hasher, 0);
+    hash_field(&hasher, filename);
+    hash_u64(&hasher, st->st_dev);
+    hash_u64(&hasher, st->st_ino);
+    hash_u64(&hasher, st->st_mtim.tv_sec);
+    hash_u64(&hasher, st->st_mtim.tv_nsec);
+    hash_u64(&hasher, st->st_size);
+    return content_hash_digest(&hasher);
+}
+
+/*
+ * Every setting that can change what a file parses to, or whether it
+ * parses at all, so each combination gets images of its own. Literals
+ * are summed, since definition order does not matter.
+ */
+static uint64_t cache_variant(const ParserContext *ctx) {
+    ContentHasher hasher;
+    content_hash_init(&hasher, 0);
+    hash_u64(&hasher, ctx->strict_mode);
+    hash_u64(&hasher, ctx->validate_utf8);
+    hash_u64(&hasher, ctx->intern_values);
+    hash_u64(&hasher, ctx->borrow_threshold);
+    hash_u64(&hasher, ctx->case_insensitive);
+    hash_u64(&hasher, ctx->duplicate_policy);
+    hash_u64(&hasher, ctx->max_entries);
+    
+    uint64_t literals = 0;
+    for (size_t bucket = 0; bucket < CONFIG_LITERAL_BUCKETS; bucket++) {
+        for (const ConfigLiteral *literal = ctx->literals[bucket]; literal;
+             literal = literal->next) {
+            ContentHasher literal_hasher;
+            content_hash_init(&literal_hasher, 0);
+            hash_field(&literal_hasher, literal->word);
+            hash_value(&literal_hasher, literal->value);
+            literals += content_hash_digest(&literal_hasher);
+        }
+    }
+    hash_u64(&hasher, literals);
+    return content_hash_digest(&hasher);
+}
+
+static int cache_hash_file(const char *filename, uint64_t *hash) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+    
+    ContentHasher hasher;
+    content_hash_init(&hasher, 0);
+    
+    char buffer[65536];
+    ssize_t got;
+    while ((got = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            return -1;
+        }
+        content_hash_update(&hasher, buffer, got);
+    }
+    
+    close(fd);
+    *hash = content_hash_digest(&hasher);
+    return 0;
+}
+
+/* Map an image into ctx. Returns 1 on success, 0 if it is missing or unusable */
+static int cache_map(ParserContext *ctx, const char *path, off_t source_size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    
+    CacheHeader header;
+    struct stat st;
+    size_t header_size = cache_header_size();
+    if (fstat(fd, &st) < 0 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CACHE_VERSION || header.layout != cache_layout() ||
+        header.header_size != header_size || header.source_size != (uint64_t)source_size ||
+        (uint64_t)st.st_size != header_size + header.block_size || header.entry_count == 0) {
+        close(fd);
+        return 0;
+    }
+    
+    size_t total = st.st_size;
+    void *preferred = (void*)(uintptr_t)(header.link_base - header_size);
+    int flags = MAP_PRIVATE;
+#ifdef MAP_FIXED_NOREPLACE
+    flags |= MAP_FIXED_NOREPLACE;
+#endif
+    
+    void *mapping = mmap(preferred, total, PROT_READ, flags, fd, 0);
+    if (mapping != MAP_FAILED && mapping != preferred) {
+        munmap(mapping, total);
+        mapping = MAP_FAILED;
+    }
+    
+    if (mapping == MAP_FAILED) {
+        // Preferred range taken: map anywhere and rebase the pointers
+        mapping = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            return 0;
+        }
+        char *block = (char*)mapping + header_size;
+        cache_relocate(block, header.index_size,
+                       (ConfigEntry*)(uintptr_t)(header.link_base + header.entries),
+                       header.link_base, (uintptr_t)block);
+        mprotect(mapping, total, PROT_READ);
+    }
+    
+    // Record the use for LRU eviction
+    futimens(fd, NULL);
+    close(fd);
+    
+    char *block = (char*)mapping + header_size;
+    ctx->index = (ConfigEntry**)block;
+    ctx->index_size = header.index_size;
+    ctx->entries = (ConfigEntry*)(block + header.entries);
+    ctx->entries_tail = (ConfigEntry*)(block + header.entries_tail);
+    ctx->entry_count = header.entry_count;
+    ctx->interpolated_count = 0;
+    ctx->raw_hash = header.raw_hash;
+    ctx->canonical_hash = header.canonical_hash;
+    ctx->frozen_block = mapping;
+    ctx->frozen_size = total;
+    ctx->frozen = true;
+    ctx->from_cache = true;
+    ctx->prefix_index_dirty = true;
+    ctx->tree_dirty = true;
+    
+    return 1;
+}
+
+/* Returns 1 when ctx was loaded from the cache, 0 to parse, -1 to parse uncached */
+static int cache_lookup(ParserContext *ctx, const char *filename, CacheKey *key) {
+    if (stat(filename, &key->st) < 0 || !S_ISREG(key->st.st_mode)) return -1;
+    
+    key->identity = cache_identity(filename, &key->st) ^ cache_variant(ctx);
+    key->has_content = false;
+    
+    char *id_path = cache_path(ctx->cache_dir, key->identity, ".id");
+    if (!id_path) return -1;
+    if (cache_map(ctx, id_path, key->st.st_size)) {
+        free(id_path);
+        return 1;
+    }
+    
+    // Unknown identity: the same bytes may have been cached under another name
+    if (cache_hash_file(filename, &key->content) < 0) {
+        free(id_path);
+        return -1;
+    }
+    key->content ^= cache_variant(ctx);
+    key->has_content = true;
+    
+    char *image_path = cache_path(ctx->cache_dir, key->content, ".cfgc");
+    int result = 0;
+    if (image_path && cache_map(ctx, image_path, key->st.st_size)) {
+        unlink(id_path);
+        if (symlink(strrchr(image_path, '/') + 1, id_path) < 0) {
+            // A missing link only costs a content hash next time
+        }
+        result = 1;
+    }
+    
+    free(image_path);
+    free(id_path);
+    return result;
+}
+
+typedef struct {
+    char *path;
+    time_t used;
+    off_t size;
+} CacheFile;
+
+static int compare_cache_files(const void *a, const void *b) {
+    time_t used_a = ((const CacheFile*)a)->used;
+    time_t used_b = ((const CacheFile*)b)->used;
+    return (used_a > used_b) - (used_a < used_b);
+}
+
+/* Drop least recently used images past the bound, and links to dropped images */
+static void cache_evict(ParserContext *ctx) {
+    DIR *dir = opendir(ctx->cache_dir);
+    if (!dir) return;
+    
+    CacheFile *files = NULL;
+    size_t count = 0, capacity = 0;
+    off_t total = 0;
+    size_t dir_len = strlen(ctx->cache_dir);
+    struct dirent *dirent;
+    
+    while ((dirent = readdir(dir))) {
+        const char *dot = strrchr(dirent->d_name, '.');
+        if (!dot || strcmp(dot, ".cfgc") != 0) continue;
+        
+        char *path = (char*)malloc(dir_len + strlen(dirent->d_name) + 2);
+        if (!path) break;
+        sprintf(path, "%s/%s", ctx->cache_dir, dirent->d_name);
+        
+        struct stat st;
+        if (stat(path, &st) < 0) {
+            free(path);
+            continue;
+        }
+        
+        if (count == capacity) {
+            size_t new_capacity = capacity ? capacity * 2 : 16;
+            CacheFile *grown = (CacheFile*)realloc(files, new_capacity * sizeof(CacheFile));
+            if (!grown) {
+                free(path);
+                break;
+            }
+            files = grown;
+            capacity = new_capacity;
+        }
+        files[count].path = path;
+        files[count].used = st.st_mtime;
+        files[count].size = st.st_size;
+        total += st.st_size;
+        count++;
+    }
+    
+    bool removed = false;
+    if (ctx->cache_max_bytes && (size_t)total > ctx->cache_max_bytes) {
+        qsort(files, count, sizeof(CacheFile), compare_cache_files);
+        for (size_t i = 0; i < count && (size_t)total > ctx->cache_max_bytes; i++) {
+            if (unlink(files[i].path) == 0) {
+                total -= files[i].size;
+                removed = true;
+            }
+        }
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        free(files[i].path);
+    }
+    free(files);
+    
+    if (removed) {
+        rewinddir(dir);
+        while ((dirent = readdir(dir))) {
+            const char *dot = strrchr(dirent->d_name, '.');
+            if (!dot || strcmp(dot, ".id") != 0) continue;
+            
+            char *path = (char*)malloc(dir_len + strlen(dirent->d_name) + 2);
+            if (!path) break;
+            sprintf(path, "%s/%s", ctx->cache_dir, dirent->d_name);
+            
+            struct stat st;
+            if (stat(path, &st) < 0 && errno == ENOENT) {
+                unlink(path);
+            }
+            free(path);
+        }
+    }
+    
+    closedir(dir);
+}
+
+/* Write the image to a temporary file and rename it into place */
+static int cache_write_image(ParserContext *ctx, const char *image_path, const CacheKey *key) {
+    size_t header_size = cache_header_size();
+    size_t block_size = ctx->frozen_size;
+    char *block = (char*)ctx->frozen_block;
+    
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.header_size = header_size;
+    header.layout = cache_layout();
+    header.link_base = CACHE_LINK_REGION +
+                       (key->content % CACHE_LINK_SLOTS) * CACHE_LINK_STRIDE + header_size;
+    header.block_size = block_size;
+    header.index_size = ctx->index_size;
+    header.entry_count = ctx->entry_count;
+    header.entries = (char*)ctx->entries - block;
+    header.entries_tail = (char*)ctx->entries_tail - block;
+    header.source_size = key->st.st_size;
+    header.raw_hash = ctx->raw_hash;
+    header.canonical_hash = ctx->canonical_hash;
+    
+    char *linked = (char*)malloc(block_size);
+    if (!linked) return -1;
+    memcpy(linked, block, block_size);
+    cache_relocate(linked, ctx->index_size, ctx->entries, (uintptr_t)block,
+                   (uintptr_t)header.link_base);
+    
+    size_t tmp_size = strlen(image_path) + 8;
+    char *tmp_path = (char*)malloc(tmp_size);
+    if (!tmp_path) {
+        free(linked);
+        return -1;
+    }
+    snprintf(tmp_path, tmp_size, "%sXXXXXX", image_path);
+    
+    int fd = mkstemp(tmp_path);
+    int result = fd < 0 ? -1 : 0;
+    
+    if (result == 0) {
+        char *padded = (char*)calloc(1, header_size);
+        if (!padded) {
+            result = -1;
+        } else {
+            memcpy(padded, &header, sizeof(header));
+            result = write_all(fd, padded, header_size);
+            free(padded);
+        }
+    }
+    if (result == 0) {
+        result = write_all(fd, linked, block_size);
+    }
+    if (result == 0) {
+        fchmod(fd, 0644);
+        result = fsync(fd);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (result == 0) {
+        result = rename(tmp_path, image_path);
+    }
+    if (result < 0 && fd >= 0) {
+        unlink(tmp_path);
+    }
+    
+    free(tmp_path);
+    free(linked);
+    return result;
+}
+
+/* Freeze ctx after a successful parse and store it; failures only skip caching */
+static void cache_store(ParserContext *ctx, const char *filename, CacheKey *key) {
+    struct stat st;
+    if (stat(filename, &st) < 0 || st.st_ino != key->st.st_ino ||
+        st.st_size != key->st.st_size || st.st_mtim.tv_sec != key->st.st_mtim.tv_sec ||
+        st.st_mtim.tv_nsec != key->st.st_mtim.tv_nsec) {
+        return;     // changed while parsing
+    }
+    
+    if (!key->has_content) {
+        key->content = ctx->raw_hash ^ cache_variant(ctx);
+        key->has_content = true;
+    }
+    
+    if (ctx->entry_count == 0 || config_freeze(ctx, false) < 0) {
+        return;
+    }
+    
+    char *image_path = cache_path(ctx->cache_dir, key->content, ".cfgc");
+    char *id_path = cache_path(ctx->cache_dir, key->identity, ".id");
+    
+    if (image_path && id_path && cache_write_image(ctx, image_path, key) == 0) {
+        size_t tmp_size = strlen(id_path) + 8;
+        char *tmp_path = (char*)malloc(tmp_size);
+        if (tmp_path) {
+            snprintf(tmp_path, tmp_size, "%s.%d", id_path, (int)getpid());
+            if (symlink(strrchr(image_path, '/') + 1, tmp_path) == 0 &&
+                rename(tmp_path, id_path) < 0) {
+                unlink(tmp_path);
+            }
+            free(tmp_path);
+        }
+        cache_evict(ctx);
+    }
+    
+    free(image_path);
+    free(id_path);
+}
+
+/* ========================================================================
+ * Shared-Memory Publication
+ * ======================================================================== */
+
+/*
+ * A published configuration is a position-independent image (all links are
+ * offsets) in its own POSIX shm segment "<name>.<generation>". A small
+ * control segment "<name>" names the current image and is updated under a
+ * seqlock, so a republish swaps images atomically for new readers while
+ * existing mappings stay valid until they are refreshed.
+ */
+
+#define IMAGE_MAGIC 0x47464343UL    /* "CCFG" */
+#define IMAGE_VERSION 3
+#define IMAGE_FLAG_FOLDED 0x1       /* keys and sections are case-folded */
+#define SHM_CONTROL_MAGIC 0x4c525443UL
+#define SHM_READ_RETRIES 10000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    uint64_t entry_count;
+    uint64_t bucket_count;          /* power of two */
+    uint64_t buckets;               /* offset of uint64_t[bucket_count] */
+    uint64_t entries;               /* offset of ImageEntry[entry_count] */
+    uint64_t flags;
+} ImageHeader;
+
+/* Arrays hold 8-byte slots; with element_type TYPE_ARRAY, ImageValue offsets */
+typedef struct {
+    uint32_t type;
+    uint32_t element_type;
+    uint64_t count;
+    union {
+        int64_t int_val;
+        double float_val;
+        uint64_t bool_val;
+        uint64_t offset;            /* string or array payload */
+    } data;
+} ImageValue;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t next;                  /* chain successor as index + 1, 0 = end */
+    uint64_t key;                   /* string offsets; section 0 = global */
+    uint64_t section;
+    ImageValue value;
+} ImageEntry;
+
+typedef struct {
+    uint32_t magic;
+    _Atomic uint64_t sequence;      /* odd while the publisher is writing */
+    uint64_t generation;
+    char image_name[CONFIG_SHM_NAME_MAX];
+} ShmControl;
+
+static size_t image_align(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+static bool image_array_has_strings(ConfigValueType element_type) {
+    return element_type != TYPE_INTEGER && element_type != TYPE_FLOAT &&
+           element_type != TYPE_ARRAY;
+}
+
+static uint64_t image_string(const StringPool *pool, const uint64_t *offsets, const char *str) {
+    return offsets[string_pool_slot(pool, str, strlen(str))];
+}
+
+/* Intern a value's strings and count the array bytes it needs */
+static bool image_collect(StringPool *strings, const ConfigValue *value, size_t *arrays_size) {
+    if (value->type == TYPE_STRING) {
+        return string_pool_intern(strings, value->data.string_val,
+                                  strlen(value->data.string_val)) != NULL;
+    }
+    if (value->type != TYPE_ARRAY) return true;
+    
+    ConfigValueType element_type = value->data.array_val.element_type;
+    size_t count = value->data.array_val.count;
+    *arrays_size += image_align(count * sizeof(uint64_t));
+    if (element_type == TYPE_ARRAY) {
+        *arrays_size += count * sizeof(ImageValue);
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        const void *element = value->data.array_val.elements[i];
+        bool ok = true;
+        if (element_type == TYPE_ARRAY) {
+            ok = image_collect(strings, (const ConfigValue*)element, arrays_size);
+        } else if (image_array_has_strings(element_type)) {
+            ok = string_pool_intern(strings, (const char*)element,
+                                    strlen((const char*)element)) != NULL;
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+static void image_write_value(char *image, size_t *array_cursor, const StringPool *strings,
+                              const uint64_t *string_offsets, const ConfigValue *value,
+                              ImageValue *out) {
+    out->type = value->type;
+    
+    switch (value->type) {
+        case TYPE_STRING:
+            out->data.offset = image_string(strings, string_offsets, value->data.string_val);
+            break;
+        case TYPE_INTEGER:
+        case TYPE_DURATION:
+        case TYPE_SIZE:
+        case TYPE_TIMESTAMP:
+            out->data.int_val = value->data.int_val;
+            break;
+        case TYPE_FLOAT:
+            out->data.float_val = value->data.float_val;
+            break;
+        case TYPE_BOOLEAN:
+            out->data.bool_val = value->data.bool_val;
+            break;
+        case TYPE_ARRAY: {
+            ConfigValueType element_type = value->data.array_val.element_type;
+            out->element_type = element_type;
+            out->count = value->data.array_val.count;
+            out->data.offset = *array_cursor;
+            
+            char *slots = image + *array_cursor;
+            *array_cursor += image_align(out->count * sizeof(uint64_t));
+            size_t records = *array_cursor;
+            if (element_type == TYPE_ARRAY) {
+                *array_cursor += out->count * sizeof(ImageValue);
+            }
+            
+            for (size_t i = 0; i < out->count; i++) {
+                void *element = value->data.array_val.elements[i];
+                if (element_type == TYPE_INTEGER) {
+                    int64_t int_val = *(int64_t*)element;
+                    memcpy(slots + i * 8, &int_val, 8);
+                } else if (element_type == TYPE_FLOAT) {
+                    memcpy(slots + i * 8, element, 8);
+                } else if (element_type == TYPE_ARRAY) {
+                    uint64_t offset = records + i * sizeof(ImageValue);
+                    image_write_value(image, array_cursor, strings, string_offsets,
+                                      (const ConfigValue*)element, (ImageValue*)(image + offset));
+                    memcpy(slots + i * 8, &offset, 8);
+                } else {
+                    uint64_t offset = image_string(strings, string_offsets, (char*)element);
+                    memcpy(slots + i * 8, &offset, 8);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/* Build an image of ctx in a malloc'd buffer; strings are stored once */
+static char* image_build(ParserContext *ctx, size_t *out_size) {
+    resolve_interpolations(ctx);
+    
+    size_t count = ctx->entry_count;
+    size_t bucket_count = 1;
+    while (bucket_count * 3 < count * 4) {
+        bucket_count *= 2;
+    }
+    
+    StringPool *strings = string_pool_create();
+    if (!strings) return NULL;
+    
+    size_t arrays_size = 0;
+    bool ok = true;
+    for (ConfigEntry *current = ctx->entries; current && ok; current = current->next) {
+        ConfigValue *value = current->value;
+        ok = string_pool_intern(strings, current->key, strlen(current->key)) != NULL;
+        if (ok && current->section) {
+            ok = string_pool_intern(strings, current->section, strlen(current->section)) != NULL;
+        }
+        if (ok) {
+            ok = image_collect(strings, value, &arrays_size);
+        }
+    }
+    
+    uint64_t *string_offsets = ok ? (uint64_t*)malloc(strings->capacity * sizeof(uint64_t)) : NULL;
+    if (!string_offsets) {
+        string_pool_free(strings);
+        return NULL;
+    }
+    
+    size_t buckets_offset = image_align(sizeof(ImageHeader));
+    size_t entries_offset = buckets_offset + image_align(bucket_count * sizeof(uint64_t));
+    size_t arrays_offset = entries_offset + image_align(count * sizeof(ImageEntry));
+    size_t strings_offset = arrays_offset + arrays_size;
+    
+    size_t size = strings_offset;
+    for (size_t i = 0; i < strings->capacity; i++) {
+        if (strings->slots[i]) {
+            string_offsets[i] = size;
+            size += strlen(strings->slots[i]) + 1;
+        }
+    }
+    size = image_align(size);
+    
+    char *image = (char*)calloc(1, size);
+    if (!image) {
+        free(string_offsets);
+        string_pool_free(strings);
+        return NULL;
+    }
+    
+    for (size_t i = 0; i < strings->capacity; i++) {
+        if (strings->slots[i]) {
+            memcpy(image + string_offsets[i], strings->slots[i], strlen(strings->slots[i]) + 1);
+        }
+    }
+    
+    ImageHeader *header = (ImageHeader*)image;
+    header->magic = IMAGE_MAGIC;
+    header->version = IMAGE_VERSION;
+    header->size = size;
+    header->entry_count = count;
+    header->bucket_count = bucket_count;
+    header->buckets = buckets_offset;
+    header->entries = entries_offset;
+    header->flags = ctx->case_insensitive ? IMAGE_FLAG_FOLDED : 0;
+    
+    uint64_t *buckets = (uint64_t*)(image + buckets_offset);
+    ImageEntry *entries = (ImageEntry*)(image + entries_offset);
+    uint64_t *bucket_tails = (uint64_t*)calloc(bucket_count, sizeof(uint64_t));
+    if (!bucket_tails) {
+        free(image);
+        free(string_offsets);
+        string_pool_free(strings);
+        return NULL;
+    }
+    
+    // Entries keep list order so chains preserve first-match semantics
+    size_t index = 0;
+    size_t array_cursor = arrays_offset;
+    for (ConfigEntry *current = ctx->entries; current; current = current->next, index++) {
+        ConfigValue *value = current->value;
+        ImageEntry *entry = &entries[index];
+        
+        entry->hash = current->hash;
+        entry->key = image_string(strings, string_offsets, current->key);
+        entry->section = current->section ?
+            image_string(strings, string_offsets, current->section) : 0;
+        image_write_value(image, &array_cursor, strings, string_offsets, value, &entry->value);
+        
+        size_t bucket = current->hash & (bucket_count - 1);
+        if (bucket_tails[bucket]) {
+            entries[bucket_tails[bucket] - 1].next = index + 1;
+        } else {
+            buckets[bucket] = index + 1;
+        }
+        bucket_tails[bucket] = index + 1;
+    }
+    
+    free(bucket_tails);
+    free(string_offsets);
+    string_pool_free(strings);
+    
+    *out_size = size;
+    return image;
+}
+
+static void image_view(const char *image, const ImageValue *value, ConfigValueView *view) {
+    view->type = (ConfigValueType)value->type;
+    view->base = image;
+    
+    switch (view->type) {
+        case TYPE_STRING:
+            view->data.string_val = image + value->data.offset;
+            break;
+        case TYPE_INTEGER:
+        case TYPE_DURATION:
+        case TYPE_SIZE:
+        case TYPE_TIMESTAMP:
+            view->data.int_val = value->data.int_val;
+            break;
+        case TYPE_FLOAT:
+            view->data.float_val = value->data.float_val;
+            break;
+        case TYPE_BOOLEAN:
+            view->data.bool_val = value->data.bool_val != 0;
+            break;
+        case TYPE_ARRAY:
+            view->data.array_val.elements = image + value->data.offset;
+            view->data.array_val.count = value->count;
+            view->data.array_val.element_type = (ConfigValueType)value->element_type;
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Images come from another process, so a reader checks one completely
+ * before using it: every offset must land inside the mapping, chains must
+ * move forward (no cycles) and strings must end before the mapping does.
+ * Lookups can then follow links without further checks.
+ */
+static bool image_offset_valid(size_t image_size, uint64_t offset, uint64_t count,
+                               size_t record_size) {
+    return offset <= image_size && (offset & 7) == 0 &&
+           count <= (image_size - offset) / record_size;
+}
+
+static bool image_value_valid(const char *image, size_t image_size, const ImageValue *value,
+                              size_t depth) {
+    switch (value->type) {
+        case TYPE_STRING:
+            return value->data.offset < image_size;
+        case TYPE_ARRAY:
+            break;
+        default:
+            return true;
+    }
+    
+    if (depth > MAX_ARRAY_DEPTH ||
+        !image_offset_valid(image_size, value->data.offset, value->count, sizeof(uint64_t))) {
+        return false;
+    }
+    
+    ConfigValueType element_type = (ConfigValueType)value->element_type;
+    if (element_type == TYPE_INTEGER || element_type == TYPE_FLOAT) return true;
+    
+    const char *slots = image + value->data.offset;
+    for (uint64_t i = 0; i < value->count; i++) {
+        uint64_t offset;
+        memcpy(&offset, slots + i * 8, 8);
+        if (element_type != TYPE_ARRAY) {
+            if (offset >= image_size) return false;
+        } else if (!image_offset_valid(image_size, offset, 1, sizeof(ImageValue)) ||
+                   !image_value_valid(image, image_size, (const ImageValue*)(image + offset),
+                                      depth + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool image_valid(const char *image, size_t image_size) {
+    const ImageHeader *header = (const ImageHeader*)image;
+    if (image_size < sizeof(ImageHeader) || header->magic != IMAGE_MAGIC ||
+        header->version != IMAGE_VERSION || header->size > image_size) {
+        return false;
+    }
+    
+    // A NUL in the last byte bounds every string that starts inside
+    image_size = header->size;
+    uint64_t bucket_count = header->bucket_count;
+    uint64_t entry_count = header->entry_count;
+    if (image[image_size - 1] != '\0' ||
+        bucket_count == 0 || (bucket_count & (bucket_count - 1)) != 0 ||
+        !image_offset_valid(image_size, header->buckets, bucket_count, sizeof(uint64_t)) ||
+        !image_offset_valid(image_size, header->entries, entry_count, sizeof(ImageEntry))) {
+        return false;
+    }
+    
+    const uint64_t *buckets = (const uint64_t*)(image + header->buckets);
+    for (uint64_t i = 0; i < bucket_count; i++) {
+        if (buckets[i] > entry_count) return false;
+    }
+    
+    const ImageEntry *entries = (const ImageEntry*)(image + header->entries);
+    for (uint64_t i = 0; i < entry_count; i++) {
+        const ImageEntry *entry = &entries[i];
+        if ((entry->next != 0 && (entry->next <= i + 1 || entry->next > entry_count)) ||
+            entry->key >= image_size || entry->section >= image_size ||
+            !image_value_valid(image, image_size, &entry->value, 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool image_lookup(const char *image, size_t image_size, const char *section,
+                         const char *key, ConfigValueView *view) {
+    const ImageHeader *header = (const ImageHeader*)image;
+    if (image_size < sizeof(ImageHeader) || header->magic != IMAGE_MAGIC) return false;
+    
+    const uint64_t *buckets = (const uint64_t*)(image + header->buckets);
+    const ImageEntry *entries = (const ImageEntry*)(image + header->entries);
+    
+    bool fold = (header->flags & IMAGE_FLAG_FOLDED) != 0;
+    unsigned long hash = lookup_hash(key, fold);
+    uint64_t index = buckets[hash & (header->bucket_count - 1)];
+    while (index) {
+        const ImageEntry *entry = &entries[index - 1];
+        const char *entry_section = entry->section ? image + entry->section : NULL;
+        
+        if (entry->hash == hash && lookup_names_equal(image + entry->key, key, fold) &&
+            lookup_names_equal(entry_section, section, fold)) {
+            image_view(image, &entry->value, view);
+            return true;
+        }
+        index = entry->next;
+    }
+    
+    return false;
+}
+
+static ShmControl* shm_map_control(const char *name, bool create) {
+    int fd = shm_open(name, create ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+    if (fd < 0) return NULL;
+    
+    if (create) {
+        struct stat st;
+        if (fstat(fd, &st) < 0 ||
+            ((size_t)st.st_size < sizeof(ShmControl) && ftruncate(fd, sizeof(ShmControl)) < 0)) {
+            close(fd);
+            return NULL;
+        }
+    }
+    
+    void *control = mmap(NULL, sizeof(ShmControl), create ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                         MAP_SHARED, fd, 0);
+    close(fd);
+    return control == MAP_FAILED ? NULL : (ShmControl*)control;
+}
+
+int config_publish(ParserContext *ctx, const char *name) {
+    if (!ctx || !name) return -1;
+    
+    size_t size = 0;
+    char *image = image_build(ctx, &size);
+    if (!image) {
+        set_error(ctx, "Out of memory while building shared image");
+        return -1;
+    }
+    
+    ShmControl *control = shm_map_control(name, true);
+    if (!control) {
+        free(image);
+        set_error(ctx, "Failed to open shared control segment: %s", name);
+        return -1;
+    }
+    
+    if (control->magic != SHM_CONTROL_MAGIC) {
+        control->magic = SHM_CONTROL_MAGIC;
+        control->generation = 0;
+        control->image_name[0] = '\0';
+    }
+    
+    unsigned long long generation = control->generation + 1;
+    char image_name[CONFIG_SHM_NAME_MAX];
+    int written = snprintf(image_name, sizeof(image_name), "%s.%llu", name, generation);
+    if (written < 0 || (size_t)written >= sizeof(image_name)) {
+        munmap(control, sizeof(ShmControl));
+        free(image);
+        set_error(ctx, "Shared segment name too long: %s", name);
+        return -1;
+    }
+    
+    int fd = shm_open(image_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd >= 0 && ftruncate(fd, size) == 0;
+    void *mapping = ok ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (fd >= 0) close(fd);
+    
+    if (mapping == MAP_FAILED) {
+        if (fd >= 0) shm_unlink(image_name);
+        munmap(control, sizeof(ShmControl));
+        free(image);
+        set_error(ctx, "Failed to create shared image segment: %s", image_name);
+        return -1;
+    }
+    
+    memcpy(mapping, image, size);
+    munmap(mapping, size);
+    free(image);
+    
+    // Seqlock: readers retry while the sequence is odd or has moved. A
+    // publisher that died mid-update left it odd; this one takes over.
+    char previous[CONFIG_SHM_NAME_MAX];
+    memcpy(previous, control->image_name, sizeof(previous));
+    
+    uint64_t sequence = atomic_load_explicit(&control->sequence, memory_order_relaxed) | 1;
+    atomic_store_explicit(&control->sequence, sequence, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    control->generation = generation;
+    memcpy(control->image_name, image_name, sizeof(image_name));
+    atomic_store_explicit(&control->sequence, sequence + 1, memory_order_release);
+    
+    // Existing readers keep their mapping of the old image alive
+    if (previous[0]) {
+        shm_unlink(previous);
+    }
+    
+    munmap(control, sizeof(ShmControl));
+    return 0;
+}
+
+int config_unpublish(const char *name) {
+    if (!name) return -1;
+    
+    ShmControl *control = shm_map_control(name, false);
+    if (control) {
+        if (control->magic == SHM_CONTROL_MAGIC && control->image_name[0]) {
+            shm_unlink(control->image_name);
+        }
+        munmap(control, sizeof(ShmControl));
+    }
+    
+    return shm_unlink(name);
+}
+
+/*
+ * Read the current image name under the seqlock. A publisher that died
+ * mid-update leaves the sequence odd for good, so readers give up after
+ * SHM_READ_RETRIES attempts instead of spinning forever.
+ */
+static int shm_read_control(const ShmControl *control, char *image_name,
+                            unsigned long long *generation) {
+    ShmControl *shared = (ShmControl*)control;
+    for (int attempt = 0; attempt < SHM_READ_RETRIES; attempt++) {
+        uint64_t before = atomic_load_explicit(&shared->sequence, memory_order_acquire);
+        if (!(before & 1)) {
+            unsigned long long current = control->generation;
+            memcpy(image_name, control->image_name, CONFIG_SHM_NAME_MAX);
+            
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&shared->sequence, memory_order_relaxed) == before) {
+                image_name[CONFIG_SHM_NAME_MAX - 1] = '\0';
+                *generation = current;
+                return 0;
+            }
+        }
+        sched_yield();
+    }
+    return -1;
+}
+
+static int shm_map_image(ConfigShmReader *reader) {
+    char image_name[CONFIG_SHM_NAME_MAX];
+    unsigned long long generation;
+    if (shm_read_control((const ShmControl*)reader->control, image_name, &generation) < 0) {
+        return -1;
+    }
+    if (generation == reader->generation && reader->image) return 0;
+    
+    int fd = shm_open(image_name, O_RDONLY, 0);
+    if (fd < 0) return -1;
+    
+    struct stat st;
+    void *image = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ImageHeader)) {
+        image = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    
+    if (image == MAP_FAILED) return -1;
+    if (!image_valid((const char*)image, st.st_size)) {
+        munmap(image, st.st_size);
+        return -1;
+    }
+    
+    if (reader->image) {
+        munmap((void*)reader->image, reader->image_size);
+    }
+    reader->image = (const char*)image;
+    reader->image_size = st.st_size;
+    reader->generation = generation;
+    return 1;
+}
+
+ConfigShmReader* config_shm_open(const char *name) {
+    if (!name || strlen(name) >= CONFIG_SHM_NAME_MAX) return NULL;
+    
+    ConfigShmReader *reader = (ConfigShmReader*)calloc(1, sizeof(ConfigShmReader));
+    if (!reader) return NULL;
+    
+    strcpy(reader->name, name);
+    reader->control = shm_map_control(name, false);
+    if (!reader->control || ((ShmControl*)reader->control)->magic != SHM_CONTROL_MAGIC ||
+        shm_map_image(reader) < 0) {
+        config_shm_close(reader);
+        return NULL;
+    }
+    
+    return reader;
+}
+
+/*
+ * Switch to the latest published image. Returns 1 if a new image was
+ * mapped, 0 if already current, -1 on error. Views obtained before a
+ * switch become invalid.
+ */
+int config_shm_refresh(ConfigShmReader *reader) {
+    if (!reader || !reader->control) return -1;
+    return shm_map_image(reader);
+}
+
+bool config_shm_get(ConfigShmReader *reader, const char *section, const char *key,
+                    ConfigValueView *view) {
+    if (!reader || !reader->image || !key || !view) return false;
+    return image_lookup(reader->image, reader->image_size, section, key, view);
+}
+
+const char* config_view_string_element(const ConfigValueView *view, size_t index) {
+    if (!view || view->type != TYPE_ARRAY || index >= view->data.array_val.count ||
+        !image_array_has_strings(view->data.array_val.element_type)) {
+        return NULL;
+    }
+    
+    uint64_t offset;
+    memcpy(&offset, (const char*)view->data.array_val.elements + index * 8, 8);
+    return view->base + offset;
+}
+
+/* Element of an array view as a view of its own; nested arrays included */
+bool config_view_element(const ConfigValueView *view, size_t index, ConfigValueView *element) {
+    if (!view || !element || view->type != TYPE_ARRAY || index >= view->data.array_val.count) {
+        return false;
+    }
+    
+    const char *slot = (const char*)view->data.array_val.elements + index * 8;
+    ConfigValueType element_type = view->data.array_val.element_type;
+    uint64_t bits;
+    memcpy(&bits, slot, 8);
+    
+    element->base = view->base;
+    element->type = element_type;
+    switch (element_type) {
+        case TYPE_INTEGER:
+            element->data.int_val = (int64_t)bits;
+            break;
+        case TYPE_FLOAT:
+            memcpy(&element->data.float_val, slot, 8);
+            break;
+        case TYPE_ARRAY:
+            image_view(view->base, (const ImageValue*)(view->base + bits), element);
+            break;
+        case TYPE_BOOLEAN:
+            element->data.bool_val = keyword_bool(view->base + bits,
+                                                  strlen(view->base + bits)) == 1;
+            break;
+        default:
+            element->type = TYPE_STRING;
+            element->data.string_val = view->base + bits;
+            break;
+    }
+    return true;
+}
+
+void config_shm_close(ConfigShmReader *reader) {
+    if (!reader) return;
+    
+    if (reader->image) {
+        munmap((void*)reader->image, reader->image_size);
+    }
+    if (reader->control) {
+        munmap(reader->control, sizeof(ShmControl));
+    }
+    free(reader);
+}
+
+/* ========================================================================
+ * Serialization
+ * ======================================================================== */
+
+/* Append str as a quoted string, escaping what the string lexer decodes */
+static int strbuf_append_quoted(StrBuf *sb, const char *str) {
+    if (strbuf_append(sb, "\"", 1) < 0) return -1;
+    
+    const char *run = str;
+    for (const char *p = str; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        
+        char escape[8];
+        switch (c) {
+            case '"':  strcpy(escape, "\\\""); break;
+            case '\\': strcpy(escape, "\\\\"); break;
+            case '\n': strcpy(escape, "\\n"); break;
+            case '\t': strcpy(escape, "\\t"); break;
+            case '\r': strcpy(escape, "\\r"); break;
+            default:   snprintf(escape, sizeof(escape), "\\u%04x", c); break;
+        }
+        if (strbuf_append(sb, run, p - run) < 0 ||
+            strbuf_append(sb, escape, strlen(escape)) < 0) {
+            return -1;
+        }
+        run = p + 1;
+    }
+    
+    if (strbuf_append(sb, run, strlen(run)) < 0) return -1;
+    return strbuf_append(sb, "\"", 1);
+}
+
+/*
+ * Append value in config syntax, so that parsing with the same literals
+ * reads it back. Null has no syntax of its own and is written as the
+ * word defined for it.
+ */
+static int strbuf_append_literal(StrBuf *sb, const ConfigValue *value,
+                                 ConfigLiteral *const *literals) {
+    char number[64];
+    
+    switch (value->type) {
+        case TYPE_STRING:
+            return strbuf_append_quoted(sb, value->data.string_val);
+            
+        case TYPE_FLOAT: {
+            snprintf(number, sizeof(number), "%.17g", value->data.float_val);
+            // Keep a float looking like one so it is not re-read as an integer
+            if (!strpbrk(number, ".eEni")) {
+                strcat(number, ".0");
+            }
+            return strbuf_append(sb, number, strlen(number));
+        }
+        
+        case TYPE_ARRAY: {
+            if (strbuf_append(sb, "[", 1) < 0) return -1;
+            for (size_t i = 0; i < value->data.array_val.count; i++) {
+                const void *element = value->data.array_val.elements[i];
+                if (i > 0 && strbuf_append(sb, ", ", 2) < 0) return -1;
+                
+                switch (value->data.array_val.element_type) {
+                    case TYPE_INTEGER:
+                        snprintf(number, sizeof(number), "%" PRId64, *(const int64_t*)element);
+                        break;
+                    case TYPE_FLOAT:
+                        snprintf(number, sizeof(number), "%.17g", *(const double*)element);
+                        if (!strpbrk(number, ".eEni")) {
+                            strcat(number, ".0");
+                        }
+                        break;
+                    case TYPE_STRING:
+                        if (strbuf_append_quoted(sb, (const char*)element) < 0) return -1;
+                        continue;
+                    case TYPE_ARRAY:
+                        if (strbuf_append_literal(sb, (const ConfigValue*)element,
+                                                  literals) < 0) {
+                            return -1;
+                        }
+                        continue;
+                    default:
+                        if (strbuf_append(sb, (const char*)element, strlen((const char*)element)) < 0) {
+                            return -1;
+                        }
+                        continue;
+                }
+                if (strbuf_append(sb, number, strlen(number)) < 0) return -1;
+            }
+            return strbuf_append(sb, "]", 1);
+        }
+        
+        case TYPE_NULL: {
+            const char *word = literal_word(literals, value);
+            if (!word) word = "null";
+            return strbuf_append(sb, word, strlen(word));
+        }
+            
+        default:
+            return strbuf_append_value(sb, (ConfigValue*)value) == 0 ? 0 : -1;
+    }
+}
+
+/* Literal for an entry: interpolated values keep their ${...} template */
+static int strbuf_append_entry_literal(StrBuf *sb, const ConfigEntry *entry,
+                                       ConfigLiteral *const *literals) {
+    if (entry->raw_value) {
+        ConfigValue template_value;
+        template_value.type = TYPE_STRING;
+        template_value.flags = 0;
+        template_value.data.string_val = entry->raw_value;
+        return strbuf_append_literal(sb, &template_value, literals);
+    }
+    return strbuf_append_literal(sb, entry->value, literals);
+}
+
+static int write_entry_line(FILE *out, StrBuf *sb, const ConfigEntry *entry,
+                            ConfigLiteral *const *literals) {
+    const char *text = entry->raw_value ? entry->raw_value :
+                       entry->value->type == TYPE_STRING ? entry->value->data.string_val : NULL;
+    
+    // Strings spanning lines go out triple-quoted so they read back whole
+    if (text && strchr(text, '\n') && !strstr(text, "\"\"\"")) {
+        return fprintf(out, "%s = \"\"\"\n%s\"\"\"\n", entry->key, text) < 0 ? -1 : 0;
+    }
+    
+    sb->length = 0;
+    if (strbuf_append_entry_literal(sb, entry, literals) < 0) return -1;
+    return fprintf(out, "%s = %s\n", entry->key, sb->data) < 0 ? -1 : 0;
+}
+
+/*
+ * Write the configuration in the syntax parse_file reads. Global entries
+ * come first, since a key after a section header belongs to that section.
+ */
+int config_write(ParserContext *ctx, FILE *out) {
+    if (!ctx || !out) return -1;
+    
+    StrBuf sb = {NULL, 0, 0};
+    const char *open_section = NULL;
+    int result = 0;
+    
+    for (ConfigEntry *current = ctx->entries; current && result == 0; current = current->next) {
+        if (!current->section) {
+            result = write_entry_line(out, &sb, current, ctx->literals);
+        }
+    }
+    
+    for (ConfigEntry *current = ctx->entries; current && result == 0; current = current->next) {
+        if (!current->section) continue;
+        
+        if (!open_section || strcmp(open_section, current->section) != 0) {
+            if (fprintf(out, "\n[%s]\n", current->section) < 0) {
+                result = -1;
+                break;
+            }
+            open_section = current->section;
+        }
+        result = write_entry_line(out, &sb, current, ctx->literals);
+    }
+    
+    free(sb.data);
+    return result;
+}
+
+/* Write atomically: to a temporary file next to filename, then rename */
+int config_write_file(ParserContext *ctx, const char *filename) {
+    if (!ctx || !filename) return -1;
+    
+    size_t len = strlen(filename);
+    char *tmp_path = (char*)malloc(len + 5);
+    if (!tmp_path) return -1;
+    memcpy(tmp_path, filename, len);
+    memcpy(tmp_path + len, ".tmp", 5);
+    
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) {
+        set_error(ctx, "Failed to open file: %s", tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+    
+    int result = config_write(ctx, out);
+    if (fflush(out) != 0 || fsync(fileno(out)) != 0) {
+        result = -1;
+    }
+    if (fclose(out) != 0) {
+        result = -1;
+    }
+    
+    if (result == 0 && rename(tmp_path, filename) != 0) {
+        result = -1;
+    }
+    if (result < 0) {
+        set_error(ctx, "Failed to write file: %s", filename);
+        unlink(tmp_path);
+    }
+    
+    free(tmp_path);
+    return result;
+}
+
+/* ========================================================================
+ * Override Journal
+ * ======================================================================== */
+
+/*
+ * The journal is an append-only file of set/remove records applied after
+ * the base config. Each record is
+ *
+ *   op:u8 section_len:u32 key_len:u32 value_len:u32 section key value check:u32
+ *
+ * (little endian; section_len 0xFFFFFFFF means the global section, the
+ * value is the literal text of the new value). Replay stops at the first
+ * torn or corrupt record. Compaction rotates the journal to
+ * "<journal>.compacting", writes a new base file and then drops the
+ * rotated journal; replay applies a leftover rotated journal first.
+ */
+
+#define JOURNAL_MAGIC "CFGJ0001"
+#define JOURNAL_MAGIC_LEN 8
+#define JOURNAL_SET 1
+#define JOURNAL_REMOVE 2
+#define JOURNAL_NO_SECTION 0xFFFFFFFFU
+#define JOURNAL_RECORD_OVERHEAD 17
+
+static void put_u32(unsigned char *out, uint32_t val) {
+    out[0] = (unsigned char)val;
+    out[1] = (unsigned char)(val >> 8);
+    out[2] = (unsigned char)(val >> 16);
+    out[3] = (unsigned char)(val >> 24);
+}
+
+static uint32_t get_u32(const unsigned char *in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) |
+           ((uint32_t)in[3] << 24);
+}
+
+static uint32_t journal_check(const unsigned char *data, size_t len) {
+    return (uint32_t)hash_bytes((const char*)data, len);
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *cursor = (const char*)data;
+    while (len > 0) {
+        ssize_t written = write(fd, cursor, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        cursor += written;
+        len -= written;
+    }
+    return 0;
+}
+
+static int journal_open_fd(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return -1;
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        (st.st_size == 0 && write_all(fd, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) < 0)) {
+        close(fd);
+        return -1;
+    }
+    
+    return fd;
+}
+
+/* Append one record; called with write_lock held */
+static int journal_append(ParserContext *ctx, int op, const char *section, const char *key,
+                          const ConfigEntry *entry) {
+    if (ctx->journal_fd < 0) return 0;
+    
+    StrBuf sb = {NULL, 0, 0};
+    if (entry && strbuf_append_entry_literal(&sb, entry, ctx->literals) < 0) {
+        free(sb.data);
+        return -1;
+    }
+    
+    size_t section_len = section ? strlen(section) : 0;
+    size_t key_len = strlen(key);
+    size_t value_len = sb.length;
+    size_t size = JOURNAL_RECORD_OVERHEAD + section_len + key_len + value_len;
+    
+    unsigned char *record = (unsigned char*)malloc(size);
+    if (!record) {
+        free(sb.data);
+        return -1;
+    }
+    
+    record[0] = (unsigned char)op;
+    put_u32(record + 1, section ? (uint32_t)section_len : JOURNAL_NO_SECTION);
+    put_u32(record + 5, (uint32_t)key_len);
+    put_u32(record + 9, (uint32_t)value_len);
+    unsigned char *payload = record + 13;
+    if (section_len) memcpy(payload, section, section_len);
+    memcpy(payload + section_len, key, key_len);
+    if (value_len) memcpy(payload + section_len + key_len, sb.data, value_len);
+    put_u32(record + size - 4, journal_check(record, size - 4));
+    free(sb.data);
+    
+    // One write per record keeps appends atomic with O_APPEND
+    int result = write_all(ctx->journal_fd, record, size);
+    if (result == 0 && ctx->journal_sync) {
+        result = fsync(ctx->journal_fd);
+    }
+    free(record);
+    
+    if (result < 0) {
+        set_error(ctx, "Failed to append to journal: %s", ctx->journal_path);
+    }
+    return result;
+}
+
+int config_journal_open(ParserContext *ctx, const char *path) {
+    if (!ctx || !path) return -1;
+    
+    config_journal_close(ctx);
+    
+    ctx->journal_path = strdup(path);
+    if (!ctx->journal_path) return -1;
+    
+    ctx->journal_fd = journal_open_fd(path);
+    if (ctx->journal_fd < 0) {
+        set_error(ctx, "Failed to open journal: %s", path);
+        free(ctx->journal_path);
+        ctx->journal_path = NULL;
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int set_entry(ParserContext *ctx, const char *section, const char *key,
+                     ConfigValue *value, bool journaled);
+static int remove_entry(ParserContext *ctx, const char *section, const char *key,
+                        bool journaled);
+
+static long journal_replay_file(ParserContext *ctx, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return errno == ENOENT ? 0 : -1;
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    
+    size_t size = st.st_size;
+    if (size < JOURNAL_MAGIC_LEN) {
+        close(fd);
+        return 0;
+    }
+    
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return -1;
+    posix_madvise(mapping, size, POSIX_MADV_SEQUENTIAL);
+    
+    const unsigned char *data = (const unsigned char*)mapping;
+    if (memcmp(data, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) != 0) {
+        munmap(mapping, size);
+        set_error(ctx, "Not a journal file: %s", path);
+        return -1;
+    }
+    
+    long applied = 0;
+    size_t offset = JOURNAL_MAGIC_LEN;
+    char *scratch = NULL;
+    size_t scratch_size = 0;
+    
+    while (size - offset >= JOURNAL_RECORD_OVERHEAD) {
+        const unsigned char *record = data + offset;
+        uint32_t raw_section_len = get_u32(record + 1);
+        size_t section_len = raw_section_len == JOURNAL_NO_SECTION ? 0 : raw_section_len;
+        size_t key_len = get_u32(record + 5);
+        size_t value_len = get_u32(record + 9);
+        
+        size_t payload_len = section_len + key_len + value_len;
+        if (payload_len > size - offset - JOURNAL_RECORD_OVERHEAD) break;
+        
+        size_t record_len = JOURNAL_RECORD_OVERHEAD + payload_len;
+        if (get_u32(record + record_len - 4) != journal_check(record, record_len - 4)) break;
+        
+        // NUL-terminated copies of the three fields
+        size_t needed = payload_len + 3;
+        if (needed > scratch_size) {
+            char *grown = (char*)realloc(scratch, needed);
+            if (!grown) break;
+            scratch = grown;
+            scratch_size = needed;
+        }
+        char *section = scratch;
+        char *key = section + section_len + 1;
+        char *value_text = key + key_len + 1;
+        const unsigned char *payload = record + 13;
+        memcpy(section, payload, section_len);
+        section[section_len] = '\0';
+        memcpy(key, payload + section_len, key_len);
+        key[key_len] = '\0';
+        memcpy(value_text, payload + section_len + key_len, value_len);
+        value_text[value_len] = '\0';
+        
+        const char *section_name = raw_section_len == JOURNAL_NO_SECTION ? NULL : section;
+        if (record[0] == JOURNAL_SET) {
+            set_entry(ctx, section_name, key,
+                      parse_value_pooled(value_text, NULL, ctx->literals, NULL), false);
+        } else if (record[0] == JOURNAL_REMOVE) {
+            remove_entry(ctx, section_name, key, false);
+        }
+        
+        applied++;
+        offset += record_len;
+    }
+    
+    free(scratch);
+    munmap(mapping, size);
+    return applied;
+}
+
+/*
+ * Apply the journal at path (and a rotated journal left by an interrupted
+ * compaction) on top of the parsed base. Values are read with ctx's
+ * literals, like the base file, so define them before replaying. Records
+ * are not re-journaled. Returns the number of records applied.
+ */
+long config_journal_replay(ParserContext *ctx, const char *path) {
+    if (!ctx || !path) return -1;
+    
+    size_t len = strlen(path);
+    char *rotated = (char*)malloc(len + sizeof(".compacting"));
+    if (!rotated) return -1;
+    memcpy(rotated, path, len);
+    memcpy(rotated + len, ".compacting", sizeof(".compacting"));
+    
+    long applied = 0;
+    long result = journal_replay_file(ctx, rotated);
+    if (result >= 0) {
+        applied += result;
+        result = journal_replay_file(ctx, path);
+        if (result >= 0) applied += result;
+    }
+    
+    free(rotated);
+    
+    if (result < 0) {
+        set_error(ctx, "Failed to replay journal: %s", path);
+        return -1;
+    }
+    return applied;
+}
+
+/*
+ * Fold the journal into a new base file. The writer lock is held only to
+ * serialize the current state into memory and rotate the journal; the
+ * base file is written afterwards.
+ */
+int config_journal_compact(ParserContext *ctx, const char *base_path) {
+    if (!ctx || !base_path || !ctx->journal_path) return -1;
+    
+    size_t len = strlen(ctx->journal_path);
+    char *rotated = (char*)malloc(len + sizeof(".compacting"));
+    if (!rotated) return -1;
+    memcpy(rotated, ctx->journal_path, len);
+    memcpy(rotated + len, ".compacting", sizeof(".compacting"));
+    
+    char *contents = NULL;
+    size_t contents_len = 0;
+    FILE *memory = open_memstream(&contents, &contents_len);
+    if (!memory) {
+        free(rotated);
+        return -1;
+    }
+    
+    pthread_mutex_lock(&ctx->write_lock);
+    
+    int result = config_write(ctx, memory);
+    if (fclose(memory) != 0) {
+        result = -1;
+    }
+    
+    if (result == 0) {
+        // New records go to a fresh journal from here on
+        int fd = -1;
+        if (rename(ctx->journal_path, rotated) == 0) {
+            fd = journal_open_fd(ctx->journal_path);
+        }
+        if (fd < 0) {
+            result = -1;
+        } else {
+            close(ctx->journal_fd);
+            ctx->journal_fd = fd;
+        }
+    }
+    
+    pthread_mutex_unlock(&ctx->write_lock);
+    
+    if (result == 0) {
+        size_t base_len = strlen(base_path);
+        char *tmp_path = (char*)malloc(base_len + 5);
+        FILE *out = NULL;
+        if (tmp_path) {
+            memcpy(tmp_path, base_path, base_len);
+            memcpy(tmp_path + base_len, ".tmp", 5);
+            out = fopen(tmp_path, "w");
+        }
+        
+        if (!out || fwrite(contents, 1, contents_len, out) != contents_len ||
+            fflush(out) != 0 || fsync(fileno(out)) != 0) {
+            result = -1;
+        }
+        if (out && fclose(out) != 0) {
+            result = -1;
+        }
+        if (result == 0 && rename(tmp_path, base_path) != 0) {
+            result = -1;
+        }
+        
+        // The rotated journal is covered by the new base only after the rename
+        if (result == 0) {
+            unlink(rotated);
+        } else if (tmp_path) {
+            unlink(tmp_path);
+        }
+        free(tmp_path);
+    }
+    
+    if (result < 0) {
+        set_error(ctx, "Failed to compact journal into %s", base_path);
+    }
+    
+    free(contents);
+    free(rotated);
+    return result;
+}
+
+static void* compactor_main(void *arg) {
+    ParserContext *ctx = (ParserContext*)arg;
+    
+    pthread_mutex_lock(&ctx->compactor_lock);
+    while (ctx->compactor_running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += ctx->compactor_interval;
+        
+        while (ctx->compactor_running &&
+               pthread_cond_timedwait(&ctx->compactor_wake, &ctx->compactor_lock, &deadline) == 0) {
+        }
+        if (!ctx->compactor_running) break;
+        
+        struct stat st;
+        if (stat(ctx->journal_path, &st) == 0 && (size_t)st.st_size >= ctx->compactor_min_bytes) {
+            pthread_mutex_unlock(&ctx->compactor_lock);
+            config_journal_compact(ctx, ctx->compactor_base_path);
+            pthread_mutex_lock(&ctx->compactor_lock);
+        }
+    }
+    pthread_mutex_unlock(&ctx->compactor_lock);
+    
+    return NULL;
+}
+
+/* Compact in a background thread every interval once the journal reaches min_bytes */
+int config_journal_start_compaction(ParserContext *ctx, const char *base_path,
+                                    unsigned int interval_seconds, size_t min_bytes) {
+    if (!ctx || !base_path || !ctx->journal_path || interval_seconds == 0) return -1;
+    if (ctx->compactor_running) return -1;
+    
+    ctx->compactor_base_path = strdup(base_path);
+    if (!ctx->compactor_base_path) return -1;
+    ctx->compactor_interval = interval_seconds;
+    ctx->compactor_min_bytes = min_bytes;
+    ctx->compactor_running = true;
+    
+    if (pthread_create(&ctx->compactor, NULL, compactor_main, ctx) != 0) {
+        ctx->compactor_running = false;
+        free(ctx->compactor_base_path);
+        ctx->compactor_base_path = NULL;
+        return -1;
+    }
+    
+    return 0;
+}
+
+void config_journal_stop_compaction(ParserContext *ctx) {
+    if (!ctx) return;
+    
+    pthread_mutex_lock(&ctx->compactor_lock);
+    bool running = ctx->compactor_running;
+    ctx->compactor_running = false;
+    pthread_cond_signal(&ctx->compactor_wake);
+    pthread_mutex_unlock(&ctx->compactor_lock);
+    
+    if (running) {
+        pthread_join(ctx->compactor, NULL);
+    }
+    free(ctx->compactor_base_path);
+    ctx->compactor_base_path = NULL;
+}
+
+void config_journal_close(ParserContext *ctx) {
+    if (!ctx) return;
+    
+    config_journal_stop_compaction(ctx);
+    if (ctx->journal_fd >= 0) {
+        close(ctx->journal_fd);
+        ctx->journal_fd = -1;
+    }
+    free(ctx->journal_path);
+    ctx->journal_path = NULL;
+}
+
+/* ========================================================================
+ * Runtime Mutation and Snapshots
+ * ======================================================================== */
+
+/*
+ * config_set/config_remove never modify an entry a reader can see. They
+ * create a new version (copy-on-write of only the touched entry and its
+ * interpolation dependents), link it in front of the old one in the hash
+ * chain, stamp the old one dead at the next epoch and then publish that
+ * epoch. A snapshot sees the versions with born <= epoch < died, so it
+ * stays consistent while writers proceed. Replaced versions are unlinked
+ * once no snapshot can see them and freed once no snapshot can still be
+ * walking past them.
+ *
+ * Only the config_snapshot_* functions may run concurrently with writers;
+ * everything else needs external synchronization. Values with ${...}
+ * references are expanded before the epoch that holds them is published,
+ * so readers never see a template or a value being rewritten.
+ */
+
+static void wait_for_snapshots(ParserContext *ctx) {
+    for (size_t slot = 0; slot < CONFIG_MAX_SNAPSHOTS; slot++) {
+        while (__atomic_load_n(&ctx->snapshot_slots[slot], __ATOMIC_SEQ_CST)) {
+            sched_yield();
+        }
+    }
+}
+
+static unsigned long long oldest_snapshot(ParserContext *ctx) {
+    unsigned long long oldest = ctx->epoch;
+    for (size_t slot = 0; slot < CONFIG_MAX_SNAPSHOTS; slot++) {
+        unsigned long long held = __atomic_load_n(&ctx->snapshot_slots[slot], __ATOMIC_SEQ_CST);
+        if (held && held - 1 < oldest) {
+            oldest = held - 1;
+        }
+    }
+    return oldest;
+}
+
+static ConfigEntry** chain_slot(ParserContext *ctx, ConfigEntry *entry) {
+    ConfigEntry **slot = &ctx->index[entry->hash & (ctx->index_size - 1)];
+    while (*slot && *slot != entry) {
+        slot = &(*slot)->hash_next;
+    }
+    return slot;
+}
+
+static void list_unlink(ParserContext *ctx, ConfigEntry *entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        ctx->entries = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        ctx->entries_tail = entry->prev;
+    }
+}
+
+/*
+ * Drop retired versions from every dependents list, in one pass for all
+ * templates retired since the last one; must run before any is freed.
+ */
+static void scrub_dependents(ParserContext *ctx) {
+    if (!ctx->retired_dependents) return;
+    ctx->retired_dependents = false;
+    
+    for (ConfigEntry *current = ctx->entries; current; current = current->next) {
+        size_t kept = 0;
+        for (size_t i = 0; i < current->dependent_count; i++) {
+            if (current->dependents[i]->died == ENTRY_LIVE) {
+                current->dependents[kept++] = current->dependents[i];
+            }
+        }
+        current->dependent_count = kept;
+    }
+}
+
+static void retire_entry(ParserContext *ctx, ConfigEntry *entry, unsigned long long epoch) {
+    STORE_RELEASE(entry->died, epoch);
+    list_unlink(ctx, entry);
+    
+    if (entry->raw_value) {
+        ctx->retired_dependents = true;
+        ctx->interpolated_count--;
+    }
+    
+    entry->retired_next = ctx->retired;
+    ctx->retired = entry;
+}
+
+/* Unlink versions no snapshot can see; free those no snapshot can reach */
+static void reclaim_versions(ParserContext *ctx, unsigned long long next_epoch) {
+    scrub_dependents(ctx);
+    unsigned long long oldest = oldest_snapshot(ctx);
+    
+    ConfigEntry **link = &ctx->retired;
+    while (*link) {
+        ConfigEntry *entry = *link;
+        
+        if (entry->unlinked && entry->unlinked <= oldest) {
+            *link = entry->retired_next;
+            free_entry(entry);
+            continue;
+        }
+        
+        if (!entry->unlinked && entry->died <= oldest) {
+            ConfigEntry **slot = chain_slot(ctx, entry);
+            STORE_RELEASE(*slot, entry->hash_next);
+            entry->unlinked = next_epoch;
+        }
+        
+        link = &entry->retired_next;
+    }
+}
+
+/* Put a new version of old in its place, in the list and in front of it in its chain */
+static ConfigEntry* replace_version(ParserContext *ctx, ConfigEntry *old, ConfigValue *value,
+                                    unsigned long long epoch) {
+    ConfigEntry *entry = create_entry(old->key, value, old->section);
+    if (!entry) return NULL;
+    
+    entry->hash = old->hash;
+    entry->born = epoch;
+    entry->hash_next = old;
+    
+    entry->prev = old;
+    entry->next = old->next;
+    if (old->next) {
+        old->next->prev = entry;
+    } else {
+        ctx->entries_tail = entry;
+    }
+    old->next = entry;
+    
+    ConfigEntry **slot = chain_slot(ctx, old);
+    STORE_RELEASE(*slot, entry);
+    
+    if (ctx->prefix_index && !ctx->prefix_index_dirty) {
+        prefix_index_replace(ctx, old, entry);
+    }
+    retire_entry(ctx, old, epoch);
+    return entry;
+}
+
+/* Give every (transitive) dependent of a changed entry a re-expanded version */
+static void refresh_dependents(ParserContext *ctx, ConfigEntry *changed,
+                               unsigned long long epoch) {
+    ConfigEntry **dependents = changed->dependents;
+    size_t count = changed->dependent_count;
+    changed->dependents = NULL;
+    changed->dependent_count = 0;
+    changed->dependent_capacity = 0;
+    
+    for (size_t i = 0; i < count; i++) {
+        ConfigEntry *dependent = dependents[i];
+        if (dependent->died != ENTRY_LIVE || !dependent->raw_value) continue;
+        
+        ConfigValue *value = create_string_value(dependent->raw_value);
+        ConfigEntry *fresh = value ? replace_version(ctx, dependent, value, epoch) : NULL;
+        if (!fresh) {
+            free_value(value);
+            continue;
+        }
+        
+        track_interpolation(ctx, fresh);
+        refresh_dependents(ctx, dependent, epoch);
+        resolve_entry(ctx, fresh, 0);
+    }
+    
+    free(dependents);
+}
+
+/*
+ * Grow the index ahead of count insertions. Growing relinks every chain,
+ * so it waits out active snapshots; called with write_lock held.
+ */
+static int reserve_entries(ParserContext *ctx, size_t count) {
+    int result = 0;
+    
+    while (result == 0 && (ctx->entry_count + count) * 4 > ctx->index_size * 3) {
+        __atomic_store_n(&ctx->resizing, 1, __ATOMIC_SEQ_CST);
+        wait_for_snapshots(ctx);
+        result = index_grow(ctx);
+        __atomic_store_n(&ctx->resizing, 0, __ATOMIC_SEQ_CST);
+    }
+    
+    return result;
+}
+
+static void publish_epoch(ParserContext *ctx, unsigned long long epoch) {
+    // Templates parsed since the last epoch are expanded in place while
+    // they still belong to the unpublished one
+    if (ctx->unexpanded) {
+        ctx->unexpanded = false;
+        resolve_pending(ctx);
+    }
+    ctx->tree_dirty = true;
+    reclaim_versions(ctx, epoch);
+    __atomic_store_n(&ctx->epoch, epoch, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * config_set and config_remove with the journal record optional. Replay
+ * and reload apply changes that must not be journaled again; they pass
+ * journaled = false instead of detaching the journal other writers use.
+ */
+static int set_entry(ParserContext *ctx, const char *section, const char *key,
+                     ConfigValue *value, bool journaled) {
+    if (!ctx || !key || !value) {
+        free_value(value);
+        return -1;
+    }
+    
+    if (ctx->frozen) {
+        set_error(ctx, "Configuration is frozen");
+        free_value(value);
+        return -1;
+    }
+    
+    if (!is_valid_key(key)) {
+        set_error(ctx, "Invalid key '%s'", key);
+        free_value(value);
+        return -1;
+    }
+    
+    pthread_mutex_lock(&ctx->write_lock);
+    
+    unsigned long long epoch = ctx->epoch + 1;
+    ConfigEntry *old = find_entry(ctx, section, key, false);
+    ConfigEntry *entry = NULL;
+    
+    if (old) {
+        entry = replace_version(ctx, old, value, epoch);
+    } else if (ctx->max_entries && ctx->entry_count >= ctx->max_entries) {
+        set_error(ctx, "Maximum number of configuration entries exceeded");
+    } else {
+        if (reserve_entries(ctx, 1) < 0) {
+            set_error(ctx, "Out of memory while indexing key '%s'", key);
+            pthread_mutex_unlock(&ctx->write_lock);
+            free_value(value);
+            return -1;
+        }
+        
+        entry = create_entry(key, value, section);
+        if (entry) {
+            if (ctx->case_insensitive) {
+                fold_name(entry->key);
+                fold_name(entry->section);
+            }
+            entry->born = epoch;
+            entry->hash = hash_key(entry->key);
+            entry->prev = ctx->entries_tail;
+            if (ctx->entries_tail) {
+                ctx->entries_tail->next = entry;
+            } else {
+                ctx->entries = entry;
+            }
+            ctx->entries_tail = entry;
+            ctx->entry_count++;
+            ctx->prefix_index_dirty = true;
+            index_link(ctx->index, ctx->index_size, entry);
+        }
+    }
+    
+    if (!entry) {
+        pthread_mutex_unlock(&ctx->write_lock);
+        free_value(value);
+        return -1;
+    }
+    
+    // New versions are fully expanded before any snapshot can see them
+    track_interpolation(ctx, entry);
+    ctx->canonical_hash += entry_fingerprint(entry);
+    if (old) {
+        ctx->canonical_hash -= entry_fingerprint(old);
+    }
+    if (old) {
+        refresh_dependents(ctx, old, epoch);
+    }
+    resolve_entry(ctx, entry, 0);
+    
+    publish_epoch(ctx, epoch);
+    int result = journaled ? journal_append(ctx, JOURNAL_SET, section, key, entry) : 0;
+    pthread_mutex_unlock(&ctx->write_lock);
+    return result;
+}
+
+static int remove_entry(ParserContext *ctx, const char *section, const char *key,
+                        bool journaled) {
+    if (!ctx || !key) return -1;
+    
+    if (ctx->frozen) {
+        set_error(ctx, "Configuration is frozen");
+        return -1;
+    }
+    
+    pthread_mutex_lock(&ctx->write_lock);
+    
+    ConfigEntry *entry = find_entry(ctx, section, key, false);
+    if (!entry) {
+        pthread_mutex_unlock(&ctx->write_lock);
+        return -1;
+    }
+    
+    unsigned long long epoch = ctx->epoch + 1;
+    ctx->canonical_hash -= entry_fingerprint(entry);
+    retire_entry(ctx, entry, epoch);
+    ctx->entry_count--;
+    ctx->prefix_index_dirty = true;
+    refresh_dependents(ctx, entry, epoch);
+    
+    publish_epoch(ctx, epoch);
+    int result = journaled ? journal_append(ctx, JOURNAL_REMOVE, section, key, NULL) : 0;
+    pthread_mutex_unlock(&ctx->write_lock);
+    return result;
+}
+
+/*
+ * Insert or replace (section, key). Takes ownership of value, which is
+ * freed on failure.
+ */
+int config_set(ParserContext *ctx, const char *section, const char *key, ConfigValue *value) {
+    return set_entry(ctx, section, key, value, true);
+}
+
+int config_remove(ParserContext *ctx, const char *section, const char *key) {
+    return remove_entry(ctx, section, key, true);
+}
+
+int config_snapshot_acquire(ParserContext *ctx, ConfigSnapshot *snapshot) {
+    if (!ctx || !snapshot) return -1;
+    
+    for (size_t slot = 0; slot < CONFIG_MAX_SNAPSHOTS; slot++) {
+        unsigned long long expected = 0;
+        unsigned long long epoch = __atomic_load_n(&ctx->epoch, __ATOMIC_SEQ_CST);
+        if (!__atomic_compare_exchange_n(&ctx->snapshot_slots[slot], &expected, epoch + 1,
+                                         false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            continue;
+        }
+        
+        for (;;) {
+            // Let an index resize finish before reading any chain
+            if (__atomic_load_n(&ctx->resizing, __ATOMIC_SEQ_CST)) {
+                __atomic_store_n(&ctx->snapshot_slots[slot], 0, __ATOMIC_SEQ_CST);
+                while (__atomic_load_n(&ctx->resizing, __ATOMIC_SEQ_CST)) {
+                    sched_yield();
+                }
+                return config_snapshot_acquire(ctx, snapshot);
+            }
+            
+            // Re-check so a writer's reclaim scan cannot have missed this slot
+            unsigned long long current = __atomic_load_n(&ctx->epoch, __ATOMIC_SEQ_CST);
+            if (current == epoch) break;
+            epoch = current;
+            __atomic_store_n(&ctx->snapshot_slots[slot], epoch + 1, __ATOMIC_SEQ_CST);
+        }
+        
+        snapshot->ctx = ctx;
+        snapshot->epoch = epoch;
+        snapshot->slot = slot;
+        return 0;
+    }
+    
+    return -1;
+}
+
+/*
+ * Look up (section, key) as of the snapshot's epoch. The returned value
+ * stays valid until the snapshot is released.
+ */
+ConfigValue* config_snapshot_get(const ConfigSnapshot *snapshot, const char *section,
+                                 const char *key) {
+    if (!snapshot || !snapshot->ctx || !key) return NULL;
+    
+    ParserContext *ctx = snapshot->ctx;
+    if (!ctx->index) return NULL;
+    
+    bool fold = ctx->case_insensitive;
+    unsigned long hash = lookup_hash(key, fold);
+    ConfigEntry *current = LOAD_ACQUIRE(ctx->index[hash & (ctx->index_size - 1)]);
+    while (current) {
+        if (current->hash == hash && LOAD_ACQUIRE(current->born) <= snapshot->epoch &&
+            snapshot->epoch < LOAD_ACQUIRE(current->died) &&
+            lookup_names_equal(current->key, key, fold) &&
+            lookup_names_equal(current->section, section, fold)) {
+            return current->value;
+        }
+        current = LOAD_ACQUIRE(current->hash_next);
+    }
+    
+    return NULL;
+}
+
+void config_snapshot_release(ConfigSnapshot *snapshot) {
+    if (!snapshot || !snapshot->ctx) return;
+    
+    __atomic_store_n(&snapshot->ctx->snapshot_slots[snapshot->slot], 0, __ATOMIC_SEQ_CST);
+    snapshot->ctx = NULL;
+}
+
+/* ========================================================================
+ * Diff, Subscriptions and Reload
+ * ======================================================================== */
+
+/*
+ * config_diff is a hash join on the key index: each live entry of one side
+ * is probed in the other side's index once, so the cost is linear in the
+ * number of entries. Values are compared expanded, with ${...} resolved.
+ * The changes point into both contexts and stay valid while neither is
+ * modified.
+ */
+
+static int diff_push(ConfigDiff *diff, ConfigChangeKind kind, const ConfigEntry *entry,
+                     const ConfigValue *old_value, const ConfigValue *new_value) {
+    if (diff->count == diff->capacity) {
+        size_t new_capacity = diff->capacity ? diff->capacity * 2 : 16;
+        ConfigChange *grown = (ConfigChange*)realloc(diff->changes,
+                                                     new_capacity * sizeof(ConfigChange));
+        if (!grown) return -1;
+        diff->changes = grown;
+        diff->capacity = new_capacity;
+    }
+    
+    ConfigChange *change = &diff->changes[diff->count++];
+    change->kind = kind;
+    change->section = entry->section;
+    change->key = entry->key;
+    change->old_value = old_value;
+    change->new_value = new_value;
+    return 0;
+}
+
+/* Changes in old_ctx list order (removed, modified), then additions in new_ctx order */
+int config_diff(ParserContext *old_ctx, ParserContext *new_ctx, ConfigDiff *diff) {
+    if (!old_ctx || !new_ctx || !diff) return -1;
+    
+    diff->changes = NULL;
+    diff->count = 0;
+    diff->capacity = 0;
+    
+    resolve_interpolations(old_ctx);
+    resolve_interpolations(new_ctx);
+    
+    for (ConfigEntry *current = old_ctx->entries; current; current = current->next) {
+        ConfigEntry *match = find_entry(new_ctx, current->section, current->key, false);
+        int result = 0;
+        
+        if (!match) {
+            result = diff_push(diff, CONFIG_CHANGE_REMOVED, current, current->value, NULL);
+        } else if (!config_value_equals(current->value, match->value)) {
+            result = diff_push(diff, CONFIG_CHANGE_MODIFIED, current, current->value,
+                               match->value);
+        }
+        
+        if (result < 0) {
+            config_diff_free(diff);
+            return -1;
+        }
+    }
+    
+    for (ConfigEntry *current = new_ctx->entries; current; current = current->next) {
+        if (find_entry(old_ctx, current->section, current->key, false)) continue;
+        
+        if (diff_push(diff, CONFIG_CHANGE_ADDED, current, NULL, current->value) < 0) {
+            config_diff_free(diff);
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+void config_diff_free(ConfigDiff *diff) {
+    if (!diff) return;
+    
+    free(diff->changes);
+    diff->changes = NULL;
+    diff->count = 0;
+    diff->capacity = 0;
+}
+
+typedef struct {
+    ParserContext *ctx;
+    const char *filename;
+    int result;
+} ParseJob;
+
+static void* parse_job_main(void *arg) {
+    ParseJob *job = (ParseJob*)arg;
+    job->result = parse_file(job->ctx, job->filename);
+    return NULL;
+}
+
+/*
+ * Parse count files into their own contexts, one thread per file (the
+ * last on the calling thread). Returns 0 if every file parsed; errors are
+ * left in the failing contexts.
+ */
+int parse_files_parallel(ParserContext **contexts, const char **filenames, size_t count) {
+    if (!contexts || !filenames || count == 0) return -1;
+    
+    ParseJob *jobs = (ParseJob*)malloc(count * sizeof(ParseJob));
+    pthread_t *threads = (pthread_t*)malloc(count * sizeof(pthread_t));
+    bool *started = (bool*)calloc(count, sizeof(bool));
+    if (!jobs || !threads || !started) {
+        free(jobs);
+        free(threads);
+        free(started);
+        return -1;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        jobs[i].ctx = contexts[i];
+        jobs[i].filename = filenames[i];
+        jobs[i].result = -1;
         
-        case TYPE_STRING:
-        default: {
-            // Remove quotes if present
-            size_t len = strlen(trimmed);
-            if (len >= 2 && trimmed[0] == '"' && trimmed[len - 1] == '"') {
-                char *unquoted = (char*)malloc(len - 1);
-                if (unquoted) {
-                    memcpy(unquoted, trimmed + 1, len - 2);
-                    unquoted[len - 2] = '\0';
-                    value = create_string_value(unquoted);
-                    free(unquoted);
-                }
-            } else {
-                value = create_string_value(trimmed);
-            }
-            break;
+        // Fall back to parsing inline if a thread cannot be started
+        if (i + 1 < count && pthread_create(&threads[i], NULL, parse_job_main, &jobs[i]) == 0) {
+            started[i] = true;
+        } else {
+            parse_job_main(&jobs[i]);
         }
     }
     
-    free(trimmed);
-    return value;
+    int result = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+        if (jobs[i].result < 0) {
+            result = -1;
+        }
+    }
+    
+    free(jobs);
+    free(threads);
+    free(started);
+    return result;
 }
 
-/* ========================================================================
- * Line Parsing
- * ======================================================================== */
-
-int parse_line(ParserContext *ctx, const char *line) {
-    if (!ctx || !line) return -1;
+/* Returns the subscription id, or -1 */
+int config_subscribe(ParserContext *ctx, ConfigWatchKind kind, const char *section,
+                     const char *pattern, ConfigChangeCallback callback, void *user_data) {
+    if (!ctx || !callback) return -1;
+    if (kind != CONFIG_WATCH_SECTION && !pattern) return -1;
     
-    ctx->line_number++;
+    ConfigSubscription *subscription = (ConfigSubscription*)calloc(1, sizeof(ConfigSubscription));
+    if (!subscription) return -1;
     
-    char *trimmed = trim_whitespace(line);
-    if (!trimmed) return -1;
+    subscription->section = section ? strdup(section) : NULL;
+    subscription->pattern = pattern ? strdup(pattern) : NULL;
+    if ((section && !subscription->section) || (pattern && !subscription->pattern)) {
+        free(subscription->section);
+        free(subscription->pattern);
+        free(subscription);
+        return -1;
+    }
     
-    // Skip empty lines
-    if (strlen(trimmed) == 0) {
-        free(trimmed);
-        return 0;
+    // Changes carry stored (folded) names
+    if (ctx->case_insensitive) {
+        fold_name(subscription->section);
+        fold_name(subscription->pattern);
     }
     
-    // Skip comments
-    if (trimmed[0] == '#' || trimmed[0] == ';') {
-        free(trimmed);
-        return 0;
+    subscription->id = ctx->next_subscription_id++;
+    subscription->kind = kind;
+    subscription->callback = callback;
+    subscription->user_data = user_data;
+    
+    // Append so callbacks run in registration order
+    ConfigSubscription **link = &ctx->subscriptions;
+    while (*link) {
+        link = &(*link)->next;
     }
+    *link = subscription;
     
-    // Check for section header
-    if (is_section_header(trimmed)) {
-        char *section = extract_section_name(trimmed);
-        free(trimmed);
-        
-        if (!section) {
-            set_error(ctx, "Invalid section header at line %zu", ctx->line_number);
-            return -1;
-        }
-        
-        if (ctx->current_section) {
-            free(ctx->current_section);
+    return subscription->id;
+}
+
+int config_unsubscribe(ParserContext *ctx, int id) {
+    if (!ctx) return -1;
+    
+    for (ConfigSubscription **link = &ctx->subscriptions; *link; link = &(*link)->next) {
+        if ((*link)->id == id) {
+            ConfigSubscription *subscription = *link;
+            *link = subscription->next;
+            free(subscription->section);
+            free(subscription->pattern);
+            free(subscription);
+            return 0;
         }
-        ctx->current_section = section;
-        
-        return 0;
     }
     
-    // Parse key-value pair
-    char *equals = strchr(trimmed, '=');
-    if (!equals) {
-        free(trimmed);
-        if (ctx->strict_mode) {
-            set_error(ctx, "Invalid syntax at line %zu: no '=' found", ctx->line_number);
-            return -1;
+    return -1;
+}
+
+/* Does "section.key" (or "key" in the global section) start with prefix? */
+static bool path_has_prefix(const char *section, const char *key, const char *prefix) {
+    if (section) {
+        size_t section_len = strlen(section);
+        size_t prefix_len = strlen(prefix);
+        if (prefix_len <= section_len) {
+            return strncmp(section, prefix, prefix_len) == 0;
         }
-        return 0;
+        if (strncmp(section, prefix, section_len) != 0 || prefix[section_len] != '.') {
+            return false;
+        }
+        prefix += section_len + 1;
     }
-    
-    // Extract key
-    size_t key_len = equals - trimmed;
-    char *key_str = (char*)malloc(key_len + 1);
-    if (!key_str) {
-        free(trimmed);
-        return -1;
+    return strncmp(key, prefix, strlen(prefix)) == 0;
+}
+
+static bool subscription_matches(const ConfigSubscription *subscription,
+                                 const ConfigChange *change) {
+    switch (subscription->kind) {
+        case CONFIG_WATCH_KEY:
+            return section_equals(change->section, subscription->section) &&
+                   strcmp(change->key, subscription->pattern) == 0;
+        case CONFIG_WATCH_SECTION:
+            return section_equals(change->section, subscription->section);
+        case CONFIG_WATCH_PREFIX:
+            return path_has_prefix(change->section, change->key, subscription->pattern);
     }
-    memcpy(key_str, trimmed, key_len);
-    key_str[key_len] = '\0';
+    return false;
+}
+
+/* Hand each subscriber the changes it watches, in one call per reload */
+static int dispatch_changes(ParserContext *ctx, const ConfigDiff *diff) {
+    if (!ctx->subscriptions || diff->count == 0) return 0;
     
-    char *key = trim_whitespace(key_str);
-    free(key_str);
+    ConfigChange *matched = (ConfigChange*)malloc(diff->count * sizeof(ConfigChange));
+    if (!matched) return -1;
     
-    if (!is_valid_key(key)) {
-        free(key);
-        free(trimmed);
-        if (ctx->strict_mode) {
-            set_error(ctx, "Invalid key at line %zu", ctx->line_number);
-            return -1;
+    for (ConfigSubscription *subscription = ctx->subscriptions; subscription;
+         subscription = subscription->next) {
+        size_t count = 0;
+        for (size_t i = 0; i < diff->count; i++) {
+            if (subscription_matches(subscription, &diff->changes[i])) {
+                matched[count++] = diff->changes[i];
+            }
+        }
+        if (count > 0) {
+            subscription->callback(matched, count, subscription->user_data);
         }
-        return 0;
     }
     
-    // Extract value
-    char *value_str = trim_whitespace(equals + 1);
-    if (!value_str) {
-        free(key);
-        free(trimmed);
-        return -1;
+    free(matched);
+    return 0;
+}
+
+/* Apply one change through config_set/config_remove */
+static int apply_change(ParserContext *ctx, ParserContext *fresh, const ConfigChange *change) {
+    if (change->kind == CONFIG_CHANGE_REMOVED) {
+        return remove_entry(ctx, change->section, change->key, false);
     }
     
-    ConfigValue *value = parse_value(value_str);
-    free(value_str);
-    free(trimmed);
+    ConfigEntry *source = find_entry(fresh, change->section, change->key, false);
+    if (!source) return -1;
     
-    if (!value) {
-        free(key);
-        if (ctx->strict_mode) {
-            set_error(ctx, "Failed to parse value at line %zu", ctx->line_number);
-            return -1;
+    if (source->raw_value) {
+        // Same template: the new value follows from a changed reference,
+        // which refreshes this entry when it is applied
+        ConfigEntry *current = find_entry(ctx, change->section, change->key, false);
+        if (current && current->raw_value && strcmp(current->raw_value, source->raw_value) == 0) {
+            return 0;
         }
-        return 0;
+        return set_entry(ctx, change->section, change->key,
+                         create_string_value(source->raw_value), false);
     }
     
-    // Create and add entry
-    ConfigEntry *entry = create_entry(key, value, ctx->current_section);
-    free(key);
+    return set_entry(ctx, change->section, change->key, copy_value(source->value), false);
+}
+
+/* Everything that decides how text parses, so fresh reads like ctx did */
+static int copy_parse_settings(ParserContext *fresh, const ParserContext *ctx) {
+    fresh->max_entries = ctx->max_entries;
+    fresh->borrow_threshold = ctx->borrow_threshold;
+    fresh->intern_values = ctx->intern_values;
+    fresh->validate_utf8 = ctx->validate_utf8;
+    fresh->coerce_values = ctx->coerce_values;
+    fresh->case_insensitive = ctx->case_insensitive;
+    fresh->duplicate_policy = ctx->duplicate_policy;
     
-    if (!entry) {
-        free_value(value);
-        return -1;
+    for (size_t bucket = 0; bucket < CONFIG_LITERAL_BUCKETS; bucket++) {
+        for (const ConfigLiteral *literal = ctx->literals[bucket]; literal;
+             literal = literal->next) {
+            ConfigValue *value = copy_value(literal->value);
+            if (!value || config_define_literal(fresh, literal->word, value) < 0) {
+                free_value(value);
+                return -1;
+            }
+        }
     }
-    
-    add_entry(ctx, entry);
-    
     return 0;
 }
 
-/* ========================================================================
- * File and String Parsing
- * ======================================================================== */
-
-int parse_file(ParserContext *ctx, const char *filename) {
+/*
+ * Re-read filename into ctx. Only changed keys get new versions, so
+ * memoized ${...} expansions are redone just for their dependents, and
+ * subscribers receive the diff once the new state is visible. Changes are
+ * not written to the journal: they describe a new base, not an override.
+ */
+int config_reload(ParserContext *ctx, const char *filename) {
     if (!ctx || !filename) return -1;
     
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        set_error(ctx, "Failed to open file: %s", filename);
+    if (ctx->frozen) {
+        set_error(ctx, "Configuration is frozen");
         return -1;
     }
     
-    char line[MAX_LINE_LENGTH];
-    int result = 0;
+    ParserContext *fresh = parser_init(ctx->strict_mode);
+    if (!fresh) return -1;
     
-    while (fgets(line, sizeof(line), file)) {
-        // Remove newline
-        size_t len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') {
-            line[len - 1] = '\0';
-        }
-        
-        if (parse_line(ctx, line) < 0) {
-            result = -1;
-            if (ctx->strict_mode) {
-                break;
-            }
-        }
+    if (copy_parse_settings(fresh, ctx) < 0) {
+        set_error(ctx, "Out of memory while preparing reload of %s", filename);
+        parser_free(fresh);
+        return -1;
     }
     
-    fclose(file);
-    return result;
-}
-
-int parse_string(ParserContext *ctx, const char *config_str) {
-    if (!ctx || !config_str) return -1;
+    if (parse_file(fresh, filename) < 0) {
+        set_error(ctx, "%s", get_error(fresh));
+        parser_free(fresh);
+        return -1;
+    }
     
-    char *config_copy = strdup(config_str);
-    if (!config_copy) return -1;
+    ConfigDiff diff;
+    if (config_diff(ctx, fresh, &diff) < 0) {
+        set_error(ctx, "Out of memory while computing reload diff");
+        parser_free(fresh);
+        return -1;
+    }
     
-    char *line = strtok(config_copy, "\n");
-    int result = 0;
+    // Grow the index up front: growing waits for snapshots, including the
+    // one below, which keeps replaced versions (and so the old values)
+    // alive until the subscribers have seen them
+    size_t added = 0;
+    for (size_t i = 0; i < diff.count; i++) {
+        if (diff.changes[i].kind == CONFIG_CHANGE_ADDED) added++;
+    }
     
-    while (line) {
-        if (parse_line(ctx, line) < 0) {
+    pthread_mutex_lock(&ctx->write_lock);
+    int reserved = reserve_entries(ctx, added);
+    pthread_mutex_unlock(&ctx->write_lock);
+    
+    ConfigSnapshot snapshot;
+    if (reserved < 0 || config_snapshot_acquire(ctx, &snapshot) < 0) {
+        set_error(ctx, "Failed to prepare reload of %s", filename);
+        config_diff_free(&diff);
+        parser_free(fresh);
+        return -1;
+    }
+    
+    int result = 0;
+    for (size_t i = 0; i < diff.count; i++) {
+        if (apply_change(ctx, fresh, &diff.changes[i]) < 0) {
             result = -1;
-            if (ctx->strict_mode) {
-                break;
-            }
         }
-        line = strtok(NULL, "\n");
     }
     
-    free(config_copy);
+    if (dispatch_changes(ctx, &diff) < 0) {
+        result = -1;
+    }
+    
+    config_diff_free(&diff);
+    config_snapshot_release(&snapshot);
+    parser_free(fresh);
     return result;
 }
 
@@ -672,35 +7210,21 @@ int parse_string(ParserContext *ctx, const char *config_str) {
  * Query Functions
  * ======================================================================== */
 
-ConfigValue* get_value(ParserContext *ctx, const char *key) {
+static ConfigEntry* lookup_entry(ParserContext *ctx, const char *key) {
     if (!ctx || !key) return NULL;
-    
-    ConfigEntry *current = ctx->entries;
-    while (current) {
-        if (strcmp(current->key, key) == 0) {
-            return current->value;
-        }
-        current = current->next;
-    }
-    
-    return NULL;
+    return find_entry(ctx, NULL, key, true);
+}
+
+ConfigValue* get_value(ParserContext *ctx, const char *key) {
+    ConfigEntry *entry = lookup_entry(ctx, key);
+    return entry ? entry->value : NULL;
 }
 
 ConfigValue* get_value_in_section(ParserContext *ctx, const char *section, const char *key) {
     if (!ctx || !key) return NULL;
     
-    ConfigEntry *current = ctx->entries;
-    while (current) {
-        if (strcmp(current->key, key) == 0) {
-            if ((section == NULL && current->section == NULL) ||
-                (section != NULL && current->section != NULL && strcmp(current->section, section) == 0)) {
-                return current->value;
-            }
-        }
-        current = current->next;
-    }
-    
-    return NULL;
+    ConfigEntry *entry = find_entry(ctx, section, key, false);
+    return entry ? entry->value : NULL;
 }
 
 char* get_string(ParserContext *ctx, const char *key, const char *default_val) {
@@ -711,28 +7235,147 @@ char* get_string(ParserContext *ctx, const char *key, const char *default_val) {
     return strdup(value->data.string_val);
 }
 
-long get_int(ParserContext *ctx, const char *key, long default_val) {
+/*
+ * Coercion rules for typed reads: a string converts when its whole text
+ * is a literal of the target type (integers in any base the parser
+ * accepts, floats, boolean keywords), and an integer widens to float.
+ */
+static ConfigStatus coerce_value(const ConfigValue *value, ConfigValueType target,
+                                 ConfigValue *out) {
+    out->type = target;
+    out->flags = 0;
+    
+    if (value->type == TYPE_STRING) {
+        const char *text = value->data.string_val;
+        ConfigValue scanned;
+        ConfigValueType type = scan_token(text, &scanned, NULL);
+        
+        switch (target) {
+            case TYPE_INTEGER:
+                if (type != TYPE_INTEGER) return CONFIG_COERCE_FAILED;
+                out->data.int_val = scanned.data.int_val;
+                return CONFIG_OK;
+            case TYPE_FLOAT:
+                if (type == TYPE_INTEGER) {
+                    out->data.float_val = (double)scanned.data.int_val;
+                } else if (type == TYPE_FLOAT) {
+                    out->data.float_val = scanned.data.float_val;
+                } else {
+                    return CONFIG_COERCE_FAILED;
+                }
+                return CONFIG_OK;
+            case TYPE_BOOLEAN:
+                if (type != TYPE_BOOLEAN) return CONFIG_COERCE_FAILED;
+                out->data.bool_val = scanned.data.bool_val;
+                return CONFIG_OK;
+            default:
+                return CONFIG_TYPE_MISMATCH;
+        }
+    }
+    
+    if (value->type == TYPE_INTEGER && target == TYPE_FLOAT) {
+        out->data.float_val = (double)value->data.int_val;
+        return CONFIG_OK;
+    }
+    return CONFIG_TYPE_MISMATCH;
+}
+
+/*
+ * Read key as target. Stored values of that type are returned as is;
+ * with coerce_values set, others go through coerce_value once and the
+ * outcome (value or failure) is cached in the entry, so later reads are
+ * a single load. Concurrent readers may race to fill the cache: the one
+ * that claims it (EMPTY -> FILLING) writes the payload and publishes it
+ * with a release store of READY, and the rest, or any read for a type
+ * other than the cached one, just coerce without caching. Frozen entries
+ * may be read-only and are not cached.
+ */
+static ConfigStatus read_typed(ParserContext *ctx, const char *key, ConfigValueType target,
+                               ConfigValue *out) {
+    ConfigEntry *entry = lookup_entry(ctx, key);
+    if (!entry) return CONFIG_NOT_FOUND;
+    
+    if (entry->value->type == target) {
+        *out = *entry->value;
+        return CONFIG_OK;
+    }
+    if (!ctx->coerce_values) return CONFIG_TYPE_MISMATCH;
+    
+    unsigned state = LOAD_ACQUIRE(entry->coerce_state);
+    if (state == COERCE_READY(target)) {
+        *out = entry->coerced;
+        return entry->coerce_status;
+    }
+    
+    ConfigStatus status = coerce_value(entry->value, target, out);
+    if (state == COERCE_EMPTY && !ctx->frozen &&
+        __atomic_compare_exchange_n(&entry->coerce_state, &state, COERCE_FILLING, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        entry->coerced = *out;
+        entry->coerce_status = status;
+        STORE_RELEASE(entry->coerce_state, COERCE_READY(target));
+    }
+    return status;
+}
+
+ConfigStatus config_get_int(ParserContext *ctx, const char *key, int64_t *out) {
+    ConfigValue value;
+    ConfigStatus status = read_typed(ctx, key, TYPE_INTEGER, &value);
+    if (status == CONFIG_OK && out) *out = value.data.int_val;
+    return status;
+}
+
+ConfigStatus config_get_float(ParserContext *ctx, const char *key, double *out) {
+    ConfigValue value;
+    ConfigStatus status = read_typed(ctx, key, TYPE_FLOAT, &value);
+    if (status == CONFIG_OK && out) *out = value.data.float_val;
+    return status;
+}
+
+ConfigStatus config_get_bool(ParserContext *ctx, const char *key, bool *out) {
+    ConfigValue value;
+    ConfigStatus status = read_typed(ctx, key, TYPE_BOOLEAN, &value);
+    if (status == CONFIG_OK && out) *out = value.data.bool_val;
+    return status;
+}
+
+int64_t get_int(ParserContext *ctx, const char *key, int64_t default_val) {
+    int64_t value;
+    return config_get_int(ctx, key, &value) == CONFIG_OK ? value : default_val;
+}
+
+double get_float(ParserContext *ctx, const char *key, double default_val) {
+    double value;
+    return config_get_float(ctx, key, &value) == CONFIG_OK ? value : default_val;
+}
+
+bool get_bool(ParserContext *ctx, const char *key, bool default_val) {
+    bool value;
+    return config_get_bool(ctx, key, &value) == CONFIG_OK ? value : default_val;
+}
+
+int64_t get_duration(ParserContext *ctx, const char *key, int64_t default_ns) {
     ConfigValue *value = get_value(ctx, key);
-    if (!value || value->type != TYPE_INTEGER) {
-        return default_val;
+    if (!value || value->type != TYPE_DURATION) {
+        return default_ns;
     }
     return value->data.int_val;
 }
 
-double get_float(ParserContext *ctx, const char *key, double default_val) {
+int64_t get_size(ParserContext *ctx, const char *key, int64_t default_bytes) {
     ConfigValue *value = get_value(ctx, key);
-    if (!value || value->type != TYPE_FLOAT) {
-        return default_val;
+    if (!value || value->type != TYPE_SIZE) {
+        return default_bytes;
     }
-    return value->data.float_val;
+    return value->data.int_val;
 }
 
-bool get_bool(ParserContext *ctx, const char *key, bool default_val) {
+int64_t get_timestamp(ParserContext *ctx, const char *key, int64_t default_ns) {
     ConfigValue *value = get_value(ctx, key);
-    if (!value || value->type != TYPE_BOOLEAN) {
-        return default_val;
+    if (!value || value->type != TYPE_TIMESTAMP) {
+        return default_ns;
     }
-    return value->data.bool_val;
+    return value->data.int_val;
 }
 
 /* ========================================================================
@@ -747,13 +7390,14 @@ bool validate_key_value(const char *key, ConfigValue *value) {
     switch (value->type) {
         case TYPE_STRING:
             if (!value->data.string_val) return false;
-            if (strlen(value->data.string_val) > MAX_VALUE_LENGTH) return false;
+            // Borrowed values exist to hold what the copying path cannot
+            if (!(value->flags & VALUE_FLAG_BORROWED) &&
+                strlen(value->data.string_val) > MAX_VALUE_LENGTH) return false;
             break;
             
         case TYPE_ARRAY:
             if (!value->data.array_val.elements) return false;
-            if (value->data.array_val.count == 0 || 
-                value->data.array_val.count > MAX_ARRAY_ELEMENTS) return false;
+            if (value->data.array_val.count == 0) return false;
             break;
             
         default:
@@ -810,7 +7454,7 @@ void print_value(ConfigValue *value) {
             break;
             
         case TYPE_INTEGER:
-            printf("%ld", value->data.int_val);
+            printf("%" PRId64, value->data.int_val);
             break;
             
         case TYPE_FLOAT:
@@ -821,6 +7465,25 @@ void print_value(ConfigValue *value) {
             printf("%s", value->data.bool_val ? "true" : "false");
             break;
             
+        case TYPE_NULL:
+            printf("null");
+            break;
+            
+        case TYPE_DURATION:
+        case TYPE_SIZE: {
+            char literal[64];
+            format_unit_literal(literal, sizeof(literal), value->type, value->data.int_val);
+            printf("%s", literal);
+            break;
+        }
+            
+        case TYPE_TIMESTAMP: {
+            char literal[64];
+            format_timestamp(literal, sizeof(literal), value->data.int_val);
+            printf("%s", literal);
+            break;
+        }
+            
         case TYPE_ARRAY:
             printf("[");
             for (size_t i = 0; i < value->data.array_val.count; i++) {
@@ -830,8 +7493,11 @@ void print_value(ConfigValue *value) {
                     case TYPE_STRING:
                         printf("\"%s\"", (char*)value->data.array_val.elements[i]);
                         break;
+                    case TYPE_ARRAY:
+                        print_value((ConfigValue*)value->data.array_val.elements[i]);
+                        break;
                     case TYPE_INTEGER:
-                        printf("%ld", *(long*)value->data.array_val.elements[i]);
+                        printf("%" PRId64, *(int64_t*)value->data.array_val.elements[i]);
                         break;
                     case TYPE_FLOAT:
                         printf("%f", *(double*)value->data.array_val.elements[i]);
@@ -865,6 +7531,8 @@ void print_entry(ConfigEntry *entry) {
 void print_config(ParserContext *ctx) {
     if (!ctx) return;
     
+    resolve_interpolations(ctx);
+    
     printf("Configuration (%zu entries):\n", ctx->entry_count);
     printf("================================\n");
     
@@ -877,6 +7545,32 @@ void print_config(ParserContext *ctx) {
     printf("================================\n");
 }
 
+/* Print a diff as "+ added", "- removed" and "~ changed: old -> new" lines */
+void print_diff(const ConfigDiff *diff) {
+    if (!diff) return;
+    
+    static const char markers[] = {'+', '-', '~'};
+    
+    for (size_t i = 0; i < diff->count; i++) {
+        const ConfigChange *change = &diff->changes[i];
+        
+        printf("%c ", markers[change->kind]);
+        if (change->section) {
+            printf("[%s] ", change->section);
+        }
+        printf("%s = ", change->key);
+        
+        if (change->kind == CONFIG_CHANGE_MODIFIED) {
+            print_value((ConfigValue*)change->old_value);
+            printf(" -> ");
+            print_value((ConfigValue*)change->new_value);
+        } else {
+            print_value((ConfigValue*)(change->new_value ? change->new_value : change->old_value));
+        }
+        printf("\n");
+    }
+}
+
 /* ========================================================================
  * Error Handling
  * ======================================================================== */
@@ -899,9 +7593,49 @@ const char* get_error(ParserContext *ctx) {
  * Main Function (for testing)
  * ======================================================================== */
 
+/* --diff mode: exit 0 if the configs are equal, 1 if they differ, 2 on error */
+static int diff_main(const char *old_file, const char *new_file) {
+    ParserContext *contexts[2] = {parser_init(false), parser_init(false)};
+    const char *filenames[2] = {old_file, new_file};
+    
+    if (!contexts[0] || !contexts[1]) {
+        fprintf(stderr, "Failed to initialize parser\n");
+        parser_free(contexts[0]);
+        parser_free(contexts[1]);
+        return 2;
+    }
+    
+    int status = 2;
+    if (parse_files_parallel(contexts, filenames, 2) < 0) {
+        for (size_t i = 0; i < 2; i++) {
+            if (contexts[i]->error_message[0]) {
+                fprintf(stderr, "Parse error in %s: %s\n", filenames[i], get_error(contexts[i]));
+            }
+        }
+    } else {
+        ConfigDiff diff;
+        if (config_diff(contexts[0], contexts[1], &diff) < 0) {
+            fprintf(stderr, "Failed to compute diff\n");
+        } else {
+            print_diff(&diff);
+            status = diff.count > 0 ? 1 : 0;
+            config_diff_free(&diff);
+        }
+    }
+    
+    parser_free(contexts[0]);
+    parser_free(contexts[1]);
+    return status;
+}
+
 int main(int argc, char *argv[]) {
+    if (argc == 4 && strcmp(argv[1], "--diff") == 0) {
+        return diff_main(argv[2], argv[3]);
+    }
+    
     if (argc < 2) {
         fprintf(stderr, "Usage: %s <config_file>\n", argv[0]);
+        fprintf(stderr, "       %s --diff <old_config> <new_config>\n", argv[0]);
         return 1;
     }
     
@@ -940,8 +7674,8 @@ int main(int argc, char *argv[]) {
         free(str_val);
     }
     
-    long int_val = get_int(ctx, "port", 8080);
-    printf("port = %ld\n", int_val);
+    int64_t int_val = get_int(ctx, "port", 8080);
+    printf("port = %" PRId64 "\n", int_val);
     
     bool bool_val = get_bool(ctx, "debug", false);
     printf("debug = %s\n", bool_val ? "true" : "false");
@@ -6,13 +6,20 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #define MAX_KEY_LENGTH 256
 #define MAX_VALUE_LENGTH 1024
 #define MAX_LINE_LENGTH 2048
 #define MAX_SECTION_DEPTH 10
-#define MAX_ARRAY_ELEMENTS 100
-#define MAX_CONFIG_ENTRIES 1000
+#define MAX_ARRAY_DEPTH 16
+#define MAX_CONFIG_ENTRIES (1u << 20)   /* default for ctx->max_entries */
+#define MAX_INTERPOLATION_DEPTH 64
+#define INITIAL_INDEX_SIZE 64
+#define CONFIG_MAX_SNAPSHOTS 64
+#define CONFIG_LITERAL_BUCKETS 64
+#define ENTRY_LIVE (~0ULL)
 
 /* Data types supported by the parser */
 typedef enum {
@@ -22,38 +29,316 @@ typedef enum {
     TYPE_BOOLEAN,
     TYPE_ARRAY,
     TYPE_SECTION,
-    TYPE_NULL
+    TYPE_NULL,
+    TYPE_DURATION,      /* int_val in nanoseconds ("30s", "1h30m") */
+    TYPE_SIZE,          /* int_val in bytes ("512MB", 1KB = 1024) */
+    TYPE_TIMESTAMP      /* int_val in nanoseconds since the epoch (RFC 3339) */
 } ConfigValueType;
 
+/* Value flags */
+#define VALUE_FLAG_INTERNED 0x1     /* string payload(s) owned by a StringPool */
+#define VALUE_FLAG_BORROWED 0x2     /* string points into a mapped source file */
+#define VALUE_FLAG_PACKED 0x4       /* array payloads live in the elements block */
+#define VALUE_FLAG_COLLECTED 0x8    /* array gathered from repeated keys */
+
 /* Value structure to hold different types */
 typedef struct {
     ConfigValueType type;
+    unsigned int flags;
     union {
         char *string_val;
-        long int_val;
+        int64_t int_val;
         double float_val;
         bool bool_val;
         struct {
-            void **elements;
-            size_t count;
+            void **elements;        /* int64_t*, double* or char*; ConfigValue* when */
+            size_t count;           /* element_type is TYPE_ARRAY (nested or mixed) */
             ConfigValueType element_type;
         } array_val;
     } data;
 } ConfigValue;
 
+/* Interpolation state of a ${section.key} string value */
+typedef enum {
+    INTERP_NONE,        /* plain value, nothing to expand */
+    INTERP_PENDING,     /* has references, not expanded yet */
+    INTERP_RESOLVING,   /* expansion in progress (cycle guard) */
+    INTERP_RESOLVED,    /* expanded and memoized in value */
+    INTERP_CYCLE        /* part of a reference cycle, left unexpanded */
+} InterpolationState;
+
+/* Result of a typed read */
+typedef enum {
+    CONFIG_OK,
+    CONFIG_NOT_FOUND,
+    CONFIG_TYPE_MISMATCH,   /* stored type does not convert to the requested one */
+    CONFIG_COERCE_FAILED    /* string that is not a literal of the requested type */
+} ConfigStatus;
+
 /* Configuration entry */
 typedef struct ConfigEntry {
     char *key;
     ConfigValue *value;
     char *section;
     struct ConfigEntry *next;
+    struct ConfigEntry *prev;
+    
+    /* Version lifetime for snapshots: visible at epochs [born, died) */
+    unsigned long long born;
+    unsigned long long died;
+    unsigned long long unlinked;    /* epoch it left its hash chain, 0 = linked */
+    struct ConfigEntry *retired_next;
+    
+    /* Hash index chaining (bucket chains keep insertion order) */
+    unsigned long hash;
+    struct ConfigEntry *hash_next;
+    
+    /* Interpolation: raw template and reverse dependency edges */
+    char *raw_value;
+    InterpolationState interp_state;
+    size_t mark;                     /* scratch mark for graph walks */
+    struct ConfigEntry **dependents;
+    size_t dependent_count;
+    size_t dependent_capacity;
+    
+    /* Last coercion for a typed read, published through coerce_state
+       (COERCE_EMPTY, COERCE_FILLING or COERCE_READY(type)) */
+    ConfigValue coerced;
+    ConfigStatus coerce_status;
+    unsigned coerce_state;
 } ConfigEntry;
 
-/* Parser state */
+/* Sorted index item: dotted path ("section.key") and its entry */
+typedef struct {
+    char *path;
+    ConfigEntry *entry;
+} PrefixIndexItem;
+
+/* Cursor over a contiguous run of the sorted prefix index */
+typedef struct {
+    const PrefixIndexItem *items;
+    size_t position;
+    size_t end;
+} ConfigCursor;
+
+/* Interning table: each distinct string is stored once */
+typedef struct {
+    char **slots;
+    size_t capacity;
+    size_t count;
+    size_t bytes;           /* bytes held by distinct strings */
+    size_t hits;            /* interns that reused an existing string */
+    size_t saved_bytes;     /* bytes those reuses would have duplicated */
+} StringPool;
+
+#define CONFIG_TREE_NONE ((size_t)-1)
+#define CONFIG_SHM_NAME_MAX 64
+
+/* Tree node; children of a node are nodes [first_child, first_child + child_count) */
+typedef struct {
+    const char *name;       /* interned path segment ("" for the root) */
+    size_t parent;
+    size_t first_child;
+    size_t child_count;
+    ConfigEntry *entry;     /* value stored at this path, if any */
+} ConfigTreeNode;
+
+/* Hierarchical view of sections and dotted keys, node 0 is the root */
+typedef struct {
+    ConfigTreeNode *nodes;
+    size_t node_count;
+    StringPool *segments;
+    bool fold_case;         /* names are folded, so lookups ignore case */
+} ConfigTree;
+
+typedef int (*ConfigTreeVisitor)(const ConfigTree *tree, size_t node_id, size_t depth,
+                                 void *userdata);
+
+/* Read-only view of a value inside a published image */
+typedef struct {
+    ConfigValueType type;
+    const char *base;               /* image base, for string array elements */
+    union {
+        const char *string_val;
+        int64_t int_val;
+        double float_val;
+        bool bool_val;
+        struct {
+            const void *elements;   /* int64_t[], double[] or uint64_t offsets */
+            size_t count;
+            ConfigValueType element_type;
+        } array_val;
+    } data;
+} ConfigValueView;
+
+/* Reader attached to a configuration published in shared memory */
+typedef struct {
+    char name[CONFIG_SHM_NAME_MAX];
+    void *control;                  /* shared control block (seqlock) */
+    const char *image;              /* read-only mapping of the current image */
+    size_t image_size;
+    unsigned long long generation;
+} ConfigShmReader;
+
+struct ParserContext;
+
+/* Consistent read view of a context at one epoch */
+typedef struct {
+    struct ParserContext *ctx;
+    unsigned long long epoch;
+    size_t slot;
+} ConfigSnapshot;
+
+/* Growable string used to assemble expanded and multi-line values */
 typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} StrBuf;
+
+/* Value spanning several lines, collected until its end is seen */
+typedef enum {
+    PENDING_NONE,
+    PENDING_TRIPLE_QUOTE,       /* key = """ ... """ */
+    PENDING_HEREDOC,            /* key = <<TAG ... TAG */
+    PENDING_CONTINUATION        /* line ending in a backslash */
+} PendingKind;
+
+/* A source file kept mapped for values that borrow from it */
+typedef struct SourceMapping {
+    void *addr;
+    size_t size;
+    struct SourceMapping *next;
+} SourceMapping;
+
+/* Streaming 64-bit content hash (XXH64) */
+typedef struct {
+    uint64_t acc[4];
+    uint64_t total_len;
+    unsigned char buffer[32];
+    size_t buffered;
+    uint64_t seed;
+} ContentHasher;
+
+/* One key-level difference between two configurations */
+typedef enum {
+    CONFIG_CHANGE_ADDED,
+    CONFIG_CHANGE_REMOVED,
+    CONFIG_CHANGE_MODIFIED
+} ConfigChangeKind;
+
+typedef struct {
+    ConfigChangeKind kind;
+    const char *section;            /* NULL for the global section */
+    const char *key;
+    const ConfigValue *old_value;   /* NULL when added */
+    const ConfigValue *new_value;   /* NULL when removed */
+} ConfigChange;
+
+typedef struct {
+    ConfigChange *changes;
+    size_t count;
+    size_t capacity;
+} ConfigDiff;
+
+/* What a subscription watches */
+typedef enum {
+    CONFIG_WATCH_KEY,               /* one (section, key) */
+    CONFIG_WATCH_SECTION,           /* every key of one section */
+    CONFIG_WATCH_PREFIX             /* every key whose dotted path has the prefix */
+} ConfigWatchKind;
+
+typedef void (*ConfigChangeCallback)(const ConfigChange *changes, size_t count,
+                                     void *user_data);
+
+typedef struct ConfigSubscription {
+    int id;
+    ConfigWatchKind kind;
+    char *section;
+    char *pattern;                  /* key or path prefix */
+    ConfigChangeCallback callback;
+    void *user_data;
+    struct ConfigSubscription *next;
+} ConfigSubscription;
+
+/* User-defined literal word and the value it stands for */
+typedef struct ConfigLiteral {
+    char *word;
+    size_t length;
+    ConfigValue *value;
+    struct ConfigLiteral *next;
+} ConfigLiteral;
+
+/* What add_entry does with a key already defined in the same section */
+typedef enum {
+    CONFIG_DUP_KEEP_ALL,            /* append; lookups see the first (default) */
+    CONFIG_DUP_FIRST_WINS,          /* later definitions are dropped */
+    CONFIG_DUP_LAST_WINS,           /* later definitions replace the value */
+    CONFIG_DUP_ERROR,               /* a repeated key is an error */
+    CONFIG_DUP_COLLECT              /* values are gathered into an array */
+} ConfigDuplicatePolicy;
+
+/* Parser state */
+typedef struct ParserContext {
     ConfigEntry *entries;
+    ConfigEntry *entries_tail;
+    ConfigEntry **index;
+    size_t index_size;
+    size_t interpolated_count;
+    bool unexpanded;                    /* templates await the next publish */
+    PrefixIndexItem *prefix_index;      /* entries sorted by dotted path */
+    size_t prefix_index_count;
+    PrefixIndexItem *section_index;     /* distinct sections, sorted */
+    size_t section_index_count;
+    bool prefix_index_dirty;
+    ConfigTree *tree;
+    bool build_tree;                    /* build the tree view after parsing */
+    bool tree_dirty;
+    void *frozen_block;                 /* single read-only block after freeze */
+    size_t frozen_size;
+    bool frozen;
+    char *cache_dir;                    /* opt-in parse cache, NULL if off */
+    size_t cache_max_bytes;             /* LRU bound on cached images */
+    bool from_cache;                    /* last parse_file mapped a cached image */
+    size_t borrow_threshold;            /* lines this long borrow their value, 0 = off */
+    struct SourceMapping *sources;      /* mapped files borrowed values point into */
+    StringPool *value_pool;             /* interned string values */
+    bool intern_values;                 /* share storage of repeated strings */
+    bool validate_utf8;                 /* reject lines that are not valid UTF-8 */
+    bool coerce_values;                 /* typed reads convert strings and ints */
+    bool case_insensitive;              /* keys and sections fold to lower case */
+    ConfigDuplicatePolicy duplicate_policy;
+    ConfigLiteral *literals[CONFIG_LITERAL_BUCKETS];  /* by length and first byte */
+    pthread_mutex_t write_lock;         /* serializes config_set/config_remove */
+    unsigned long long epoch;           /* last published version epoch */
+    unsigned long long snapshot_slots[CONFIG_MAX_SNAPSHOTS];  /* epoch + 1, 0 = free */
+    int resizing;                       /* index growth waiting for snapshots */
+    ConfigEntry *retired;               /* replaced versions awaiting reclaim */
+    bool retired_dependents;            /* dependents lists may name retired versions */
+    int journal_fd;                     /* override journal, -1 if none */
+    char *journal_path;
+    bool journal_sync;                  /* fsync after each journal record */
+    pthread_t compactor;
+    pthread_mutex_t compactor_lock;
+    pthread_cond_t compactor_wake;
+    bool compactor_running;
+    char *compactor_base_path;
+    unsigned int compactor_interval;    /* seconds between compactions */
+    size_t compactor_min_bytes;         /* journal size that triggers one */
+    ContentHasher raw_hasher;           /* over every byte parsed so far */
+    uint64_t raw_hash;                  /* digest of raw_hasher after the last parse */
+    uint64_t canonical_hash;            /* order-independent sum over live entries */
+    ConfigSubscription *subscriptions;
+    int next_subscription_id;
+    PendingKind pending_kind;
+    char *pending_key;
+    char *pending_tag;                  /* heredoc terminator */
+    StrBuf pending_text;
+    bool pending_has_text;
+    size_t pending_line;                /* line the pending value started on */
     char *current_section;
     size_t entry_count;
+    size_t max_entries;                 /* 0 = unlimited */
     size_t line_number;
     bool strict_mode;
     char error_message[512];
@@ -69,6 +354,8 @@ void parser_free(ParserContext *ctx);
 int parse_file(ParserContext *ctx, const char *filename);
 int parse_line(ParserContext *ctx, const char *line);
 int parse_string(ParserContext *ctx, const char *config_str);
+int parse_files_parallel(ParserContext **contexts, const char **filenames, size_t count);
+int config_borrow_large_values(ParserContext *ctx, size_t threshold);
 
 /* Entry management */
 ConfigEntry* create_entry(const char *key, ConfigValue *value, const char *section);
@@ -78,11 +365,15 @@ void add_entry(ParserContext *ctx, ConfigEntry *entry);
 /* Value parsing and creation */
 ConfigValue* parse_value(const char *value_str);
 ConfigValue* create_string_value(const char *str);
-ConfigValue* create_int_value(long val);
+ConfigValue* create_int_value(int64_t val);
 ConfigValue* create_float_value(double val);
 ConfigValue* create_bool_value(bool val);
+ConfigValue* create_duration_value(int64_t nanoseconds);
+ConfigValue* create_size_value(int64_t bytes);
+ConfigValue* create_timestamp_value(int64_t nanoseconds);
 ConfigValue* create_array_value(void **elements, size_t count, ConfigValueType type);
 void free_value(ConfigValue *value);
+int config_define_literal(ParserContext *ctx, const char *word, ConfigValue *value);
 
 /* Utility functions */
 char* trim_whitespace(const char *str);
@@ -95,9 +386,96 @@ ConfigValueType infer_type(const char *value_str);
 ConfigValue* get_value(ParserContext *ctx, const char *key);
 ConfigValue* get_value_in_section(ParserContext *ctx, const char *section, const char *key);
 char* get_string(ParserContext *ctx, const char *key, const char *default_val);
-long get_int(ParserContext *ctx, const char *key, long default_val);
+int64_t get_int(ParserContext *ctx, const char *key, int64_t default_val);
 double get_float(ParserContext *ctx, const char *key, double default_val);
 bool get_bool(ParserContext *ctx, const char *key, bool default_val);
+ConfigStatus config_get_int(ParserContext *ctx, const char *key, int64_t *out);
+ConfigStatus config_get_float(ParserContext *ctx, const char *key, double *out);
+ConfigStatus config_get_bool(ParserContext *ctx, const char *key, bool *out);
+int64_t get_duration(ParserContext *ctx, const char *key, int64_t default_ns);
+int64_t get_size(ParserContext *ctx, const char *key, int64_t default_bytes);
+int64_t get_timestamp(ParserContext *ctx, const char *key, int64_t default_ns);
+
+/* Interpolation of ${section.key} references */
+bool has_interpolation(const char *str);
+int resolve_interpolations(ParserContext *ctx);
+int check_interpolation_cycles(ParserContext *ctx);
+void invalidate_value(ParserContext *ctx, const char *section, const char *key);
+
+/*
+ * Prefix queries over dotted paths. A cursor survives value changes to
+ * existing keys; adding or removing a key invalidates every cursor, since
+ * the next scan rebuilds the sorted index it points into.
+ */
+int config_prefix_scan(ParserContext *ctx, const char *prefix, ConfigCursor *cursor);
+int config_section_scan(ParserContext *ctx, const char *prefix, ConfigCursor *cursor);
+bool config_cursor_next(ConfigCursor *cursor, const char **path, ConfigEntry **entry);
+size_t config_cursor_count(const ConfigCursor *cursor);
+
+/* String interning */
+StringPool* string_pool_create(void);
+const char* string_pool_intern(StringPool *pool, const char *str, size_t len);
+void string_pool_free(StringPool *pool);
+bool config_value_equals(const ConfigValue *a, const ConfigValue *b);
+
+/* Hierarchical tree view */
+const ConfigTree* config_tree(ParserContext *ctx);
+size_t config_tree_find(const ConfigTree *tree, size_t node_id, const char *path);
+int config_tree_walk(const ConfigTree *tree, size_t node_id, ConfigTreeVisitor visitor,
+                     void *userdata);
+void config_tree_free(ConfigTree *tree);
+
+/* Compaction */
+int config_freeze(ParserContext *ctx, bool protect);
+
+/* On-disk parse cache */
+int config_cache_enable(ParserContext *ctx, const char *dir, size_t max_bytes);
+
+/* Shared-memory publication */
+int config_publish(ParserContext *ctx, const char *name);
+int config_unpublish(const char *name);
+ConfigShmReader* config_shm_open(const char *name);
+int config_shm_refresh(ConfigShmReader *reader);
+bool config_shm_get(ConfigShmReader *reader, const char *section, const char *key,
+                    ConfigValueView *view);
+const char* config_view_string_element(const ConfigValueView *view, size_t index);
+bool config_view_element(const ConfigValueView *view, size_t index, ConfigValueView *element);
+void config_shm_close(ConfigShmReader *reader);
+
+/* Serialization */
+int config_write(ParserContext *ctx, FILE *out);
+int config_write_file(ParserContext *ctx, const char *filename);
+
+/* Override journal */
+int config_journal_open(ParserContext *ctx, const char *path);
+long config_journal_replay(ParserContext *ctx, const char *path);
+int config_journal_compact(ParserContext *ctx, const char *base_path);
+int config_journal_start_compaction(ParserContext *ctx, const char *base_path,
+                                    unsigned int interval_seconds, size_t min_bytes);
+void config_journal_stop_compaction(ParserContext *ctx);
+void config_journal_close(ParserContext *ctx);
+
+/* Runtime mutation and snapshots */
+int config_set(ParserContext *ctx, const char *section, const char *key, ConfigValue *value);
+int config_remove(ParserContext *ctx, const char *section, const char *key);
+int config_snapshot_acquire(ParserContext *ctx, ConfigSnapshot *snapshot);
+ConfigValue* config_snapshot_get(const ConfigSnapshot *snapshot, const char *section,
+                                 const char *key);
+void config_snapshot_release(ConfigSnapshot *snapshot);
+
+/* Content fingerprints */
+void content_hash_init(ContentHasher *hasher, uint64_t seed);
+void content_hash_update(ContentHasher *hasher, const void *data, size_t len);
+uint64_t content_hash_digest(const ContentHasher *hasher);
+uint64_t content_hash(const void *data, size_t len, uint64_t seed);
+
+/* Diff, subscriptions and reload */
+int config_diff(ParserContext *old_ctx, ParserContext *new_ctx, ConfigDiff *diff);
+void config_diff_free(ConfigDiff *diff);
+int config_subscribe(ParserContext *ctx, ConfigWatchKind kind, const char *section,
+                     const char *pattern, ConfigChangeCallback callback, void *user_data);
+int config_unsubscribe(ParserContext *ctx, int id);
+int config_reload(ParserContext *ctx, const char *filename);
 
 /* Validation functions */
 bool validate_config(ParserContext *ctx);
@@ -108,6 +486,7 @@ bool validate_section(const char *section);
 void print_config(ParserContext *ctx);
 void print_entry(ConfigEntry *entry);
 void print_value(ConfigValue *value);
+void print_diff(const ConfigDiff *diff);
 
 /* Error handling */
 void set_error(ParserContext *ctx, const char *format, ...);
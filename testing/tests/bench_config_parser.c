@@ -0,0 +1,889 @@
+/*
+ * Micro-benchmarks for the config parser's fast paths, each next to the
+ * slow path it replaces. Built with optimizations by "make bench"; the
+ * numbers are per operation and only meaningful relative to each other.
+ */
+
+#define _XOPEN_SOURCE 700     /* strptime, for the timestamp baseline */
+#define main config_parser_main
+#include "../src/config_parser.c"
+#undef main
+
+#include <stdint.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double elapsed_ns, size_t ops) {
+    printf("  %-36s %12.1f ns/op\n", name, elapsed_ns / (double)ops);
+}
+
+static void report_bytes(const char *name, size_t bytes) {
+    printf("  %-36s %12.1f MiB\n", name, bytes / 1048576.0);
+}
+
+/* Resident set size, after handing freed heap back to the system */
+static size_t resident_bytes(void) {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    size_t pages = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%zu %zu", &pages, &resident) != 2) resident = 0;
+        fclose(statm);
+    }
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+/* Keeps results alive so the loops are not optimized away */
+static volatile uintptr_t sink;
+
+static char* generated_config(size_t sections, size_t keys) {
+    StrBuf sb = {NULL, 0, 0};
+    char line[128];
+    for (size_t s = 0; s < sections; s++) {
+        int len = snprintf(line, sizeof(line), "[s%zu]\n", s);
+        strbuf_append(&sb, line, len);
+        for (size_t k = 0; k < keys; k++) {
+            len = snprintf(line, sizeof(line), "key.k%zu = \"value %zu\"\n", k, s * keys + k);
+            strbuf_append(&sb, line, len);
+        }
+    }
+    return sb.data;
+}
+
+/* Parse and expand 100k values referring to two base keys, then change one */
+static void bench_interpolation(void) {
+    const size_t count = 100000;
+    StrBuf templated = {NULL, 0, 0}, plain = {NULL, 0, 0};
+    char line[128];
+    const char *header = "[base]\nhost = example.org\nport = 5432\n[s0]\n";
+    strbuf_append(&templated, header, strlen(header));
+    strbuf_append(&plain, header, strlen(header));
+    for (size_t i = 0; i < count; i++) {
+        int len = snprintf(line, sizeof(line), "key.k%zu = pg://${base.host}:${base.port}/%zu\n", i, i);
+        strbuf_append(&templated, line, len);
+        len = snprintf(line, sizeof(line), "key.k%zu = pg://example.org:5432/%zu\n", i, i);
+        strbuf_append(&plain, line, len);
+    }
+
+    for (int expand = 0; expand < 2; expand++) {
+        ParserContext *ctx = parser_init(false);
+        double start = now_ns();
+        parse_string(ctx, expand ? templated.data : plain.data);
+        report(expand ? "parse 100k interpolated, per value" : "parse 100k plain, per value",
+               now_ns() - start, count);
+
+        if (expand) {
+            // Every value depends on base.host, so each gets a new version
+            start = now_ns();
+            config_set(ctx, "base", "host", create_string_value("db.internal"));
+            report("re-expand 100k dependents, per value", now_ns() - start, count);
+        }
+        sink += ctx->entry_count;
+        parser_free(ctx);
+    }
+    free(templated.data);
+    free(plain.data);
+}
+
+static void bench_lookup(ParserContext *ctx) {
+    const size_t lookups = 2000;
+    char key[64], section[64];
+
+    double start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+        snprintf(section, sizeof(section), "s%zu", (i * 7919) % 100);
+        snprintf(key, sizeof(key), "key.k%zu", (i * 104729) % 1000);
+        sink += (uintptr_t)find_entry(ctx, section, key, false);
+    }
+    report("hash index lookup", now_ns() - start, lookups);
+
+    start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+        snprintf(section, sizeof(section), "s%zu", (i * 7919) % 100);
+        snprintf(key, sizeof(key), "key.k%zu", (i * 104729) % 1000);
+        for (ConfigEntry *e = ctx->entries; e; e = e->next) {
+            if (strcmp(e->key, key) == 0 && section_equals(e->section, section)) {
+                sink += (uintptr_t)e;
+                break;
+            }
+        }
+    }
+    report("entry list scan", now_ns() - start, lookups);
+}
+
+/*
+ * Keys written as "port_k1", "Port_k2" or "PORT_K3": one probe on a
+ * case-insensitive context against trying the three spellings in turn.
+ */
+static void case_variant(char *out, size_t size, size_t i, int variant) {
+    static const char *forms[3] = {"port_k%zu", "Port_k%zu", "PORT_K%zu"};
+    snprintf(out, size, forms[variant], i);
+}
+
+static void bench_case_folding(void) {
+    const size_t keys = 100000, lookups = 1000000;
+    StrBuf sb = {NULL, 0, 0};
+    char key[64], line[96];
+    for (size_t i = 0; i < keys; i++) {
+        case_variant(key, sizeof(key), i, (int)(i % 3));
+        int len = snprintf(line, sizeof(line), "%s = %zu\n", key, i);
+        strbuf_append(&sb, line, (size_t)len);
+    }
+    strbuf_append(&sb, "", 0);
+
+    ParserContext *exact = parser_init(false);
+    ParserContext *folded = parser_init(false);
+    folded->case_insensitive = true;
+    parse_string(exact, sb.data);
+    parse_string(folded, sb.data);
+    free(sb.data);
+
+    size_t misses = 0;
+    double start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+        size_t k = (i * 104729) % keys;
+        const ConfigValue *value = NULL;
+        for (int variant = 0; variant < 3 && !value; variant++) {
+            case_variant(key, sizeof(key), k, variant);
+            value = get_value(exact, key);
+        }
+        misses += !value;
+    }
+    report("three case-variant lookups", now_ns() - start, lookups);
+
+    start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+        case_variant(key, sizeof(key), (i * 104729) % keys, 0);
+        misses += !get_value(folded, key);
+    }
+    report("one case-insensitive lookup", now_ns() - start, lookups);
+
+    if (misses) printf("  case-folded lookups missed %zu keys\n", misses);
+    parser_free(exact);
+    parser_free(folded);
+}
+
+static void bench_prefix(ParserContext *ctx) {
+    const size_t rounds = 200;
+    ConfigCursor cursor;
+    config_prefix_scan(ctx, "s42.key.k1", &cursor);
+
+    double start = now_ns();
+    for (size_t i = 0; i < rounds; i++) {
+        config_prefix_scan(ctx, "s42.key.k1", &cursor);
+        sink += config_cursor_count(&cursor);
+    }
+    report("sorted prefix scan", now_ns() - start, rounds);
+
+    start = now_ns();
+    for (size_t i = 0; i < rounds; i++) {
+        size_t count = 0;
+        for (ConfigEntry *e = ctx->entries; e; e = e->next) {
+            if (e->section && strcmp(e->section, "s42") == 0 &&
+                strncmp(e->key, "key.k1", 6) == 0) {
+                count++;
+            }
+        }
+        sink += count;
+    }
+    report("filtering list scan", now_ns() - start, rounds);
+}
+
+static void bench_snapshot(ParserContext *ctx) {
+    const size_t reads = 200000;
+    ConfigSnapshot snapshot;
+    config_snapshot_acquire(ctx, &snapshot);
+
+    double start = now_ns();
+    for (size_t i = 0; i < reads; i++) {
+        sink += (uintptr_t)config_snapshot_get(&snapshot, "s1", "key.k1");
+    }
+    report("snapshot read", now_ns() - start, reads);
+    config_snapshot_release(&snapshot);
+
+    start = now_ns();
+    for (size_t i = 0; i < reads; i++) {
+        sink += (uintptr_t)get_value_in_section(ctx, "s1", "key.k1");
+    }
+    report("live read", now_ns() - start, reads);
+}
+
+typedef struct {
+    ParserContext *ctx;
+    int *stop;
+    size_t reads;
+    uintptr_t found;
+} ReaderJob;
+
+/* Reads through short-lived snapshots until told to stop */
+static void* snapshot_reader(void *arg) {
+    ReaderJob *job = (ReaderJob*)arg;
+    char key[64];
+
+    while (!__atomic_load_n(job->stop, __ATOMIC_ACQUIRE)) {
+        ConfigSnapshot snapshot;
+        if (config_snapshot_acquire(job->ctx, &snapshot) < 0) continue;
+        for (size_t r = 0; r < 64; r++, job->reads++) {
+            snprintf(key, sizeof(key), "key.k%zu", (job->reads * 104729) % 1000);
+            job->found += (uintptr_t)config_snapshot_get(&snapshot, "s1", key);
+        }
+        config_snapshot_release(&snapshot);
+    }
+    return NULL;
+}
+
+/* Snapshot readers with and without one thread calling config_set */
+static void bench_mixed(ParserContext *ctx) {
+    enum { READERS = 4 };
+    const size_t writes = 20000;
+    const char *names[2] = {"snapshot read, 4 readers", "snapshot read, 4 readers + writer"};
+    char key[64];
+
+    for (int writing = 0; writing < 2; writing++) {
+        int stop = 0;
+        pthread_t threads[READERS];
+        ReaderJob jobs[READERS];
+        for (size_t t = 0; t < READERS; t++) {
+            jobs[t] = (ReaderJob){ctx, &stop, 0, 0};
+            pthread_create(&threads[t], NULL, snapshot_reader, &jobs[t]);
+        }
+
+        double start = now_ns();
+        for (size_t i = 0; i < writes; i++) {
+            if (writing) {
+                snprintf(key, sizeof(key), "key.k%zu", (i * 7919) % 1000);
+                config_set(ctx, "s1", key, create_int_value((int64_t)i));
+            } else {
+                sink += i;
+            }
+        }
+        // Give the readers the same window as the writes took, at least 50 ms
+        while (now_ns() - start < 5e7) {
+            sched_yield();
+        }
+        double elapsed = now_ns() - start;
+        __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+
+        size_t reads = 0;
+        for (size_t t = 0; t < READERS; t++) {
+            pthread_join(threads[t], NULL);
+            reads += jobs[t].reads;
+            sink += jobs[t].found;
+        }
+        report(names[writing], elapsed * READERS, reads);
+        if (writing) {
+            report("config_set under readers", elapsed, writes);
+        }
+    }
+}
+
+static void bench_cache(const char *text) {
+    char dir[] = "/tmp/config_parser_bench.XXXXXX";
+    if (!mkdtemp(dir)) return;
+    char path[256], cache[256];
+    snprintf(path, sizeof(path), "%s/bench.conf", dir);
+    snprintf(cache, sizeof(cache), "%s/cache", dir);
+
+    FILE *file = fopen(path, "w");
+    if (!file) return;
+    fputs(text, file);
+    fclose(file);
+
+    const size_t rounds = 3;
+    for (int cached = 0; cached < 2; cached++) {
+        double elapsed = 0;
+        for (size_t i = 0; i <= rounds; i++) {
+            ParserContext *ctx = parser_init(false);
+            if (cached) config_cache_enable(ctx, cache, 0);
+            double start = now_ns();
+            parse_file(ctx, path);
+            if (i > 0) elapsed += now_ns() - start;    // first round fills the cache
+            parser_free(ctx);
+        }
+        report(cached ? "parse_file, cache hit" : "parse_file, no cache", elapsed, rounds);
+    }
+
+    char command[300];
+    snprintf(command, sizeof(command), "rm -rf %s", dir);
+    if (system(command) != 0) {
+        fprintf(stderr, "failed to remove %s\n", dir);
+    }
+}
+
+static void bench_utf8(void) {
+    const size_t len = 1 << 20;
+    char *text = (char*)malloc(len);
+    if (!text) return;
+    for (size_t i = 0; i < len; i++) {
+        text[i] = (char)(i % 61 == 60 ? 0xC3 : i % 61 == 0 && i ? 0xA9 : 'a' + i % 26);
+    }
+
+    const size_t rounds = 50;
+    double start = now_ns();
+    for (size_t i = 0; i < rounds; i++) {
+        sink += utf8_scan_scalar((const unsigned char*)text, len);
+    }
+    report("UTF-8 scalar, per MiB", now_ns() - start, rounds);
+
+    start = now_ns();
+    for (size_t i = 0; i < rounds; i++) {
+        sink += utf8_validate(text, len);
+    }
+    report("UTF-8 utf8_validate, per MiB", now_ns() - start, rounds);
+
+#ifdef HAVE_SSSE3_DISPATCH
+    if (__builtin_cpu_supports("ssse3")) {
+        start = now_ns();
+        for (size_t i = 0; i < rounds; i++) {
+            sink += utf8_valid_simd((const unsigned char*)text, len);
+        }
+        report("UTF-8 SSSE3, per MiB", now_ns() - start, rounds);
+    }
+#endif
+    free(text);
+
+    // The cost of validation to a whole parse, best of a few alternating runs
+    const size_t keys = 200000;
+    double best[2] = {0, 0};
+    text = generated_config(1, keys);
+    for (int run = 0; run < 6; run++) {
+        int validate = run % 2;
+        ParserContext *ctx = parser_init(false);
+        ctx->validate_utf8 = validate;
+        start = now_ns();
+        sink += parse_string(ctx, text);
+        double elapsed = now_ns() - start;
+        if (best[validate] == 0 || elapsed < best[validate]) best[validate] = elapsed;
+        parser_free(ctx);
+    }
+    report("parse_string, validate_utf8 off", best[0], keys);
+    report("parse_string, validate_utf8 on", best[1], keys);
+    free(text);
+}
+
+static void bench_strings(void) {
+    const size_t rounds = 200000;
+    const char *tokens[2] = {"\"a plain quoted value with no escapes\"",
+                             "\"a quoted value\\twith \\\"escapes\\\"\""};
+    const char *names[2] = {"quoted string, no escapes", "quoted string, escapes"};
+
+    for (int i = 0; i < 2; i++) {
+        double start = now_ns();
+        for (size_t r = 0; r < rounds; r++) {
+            ConfigValue *value = parse_value(tokens[i]);
+            sink += (uintptr_t)value;
+            free_value(value);
+        }
+        report(names[i], now_ns() - start, rounds);
+    }
+}
+
+/* 10k heredoc values of 64 KB each, streamed in 64-byte lines */
+static void bench_heredoc(void) {
+    const size_t values = 10000, lines = 1024;
+    const char *line = "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcde\n";
+    StrBuf sb = {NULL, 0, 0};
+    char head[64];
+    for (size_t i = 0; i < values; i++) {
+        int len = snprintf(head, sizeof(head), "v%zu = <<EOT\n", i);
+        strbuf_append(&sb, head, (size_t)len);
+        for (size_t j = 0; j < lines; j++) {
+            strbuf_append(&sb, line, 64);
+        }
+        strbuf_append(&sb, "EOT\n", 4);
+    }
+    strbuf_append(&sb, "", 0);
+
+    ParserContext *ctx = parser_init(false);
+    double start = now_ns();
+    int status = parse_string(ctx, sb.data);
+    double elapsed = now_ns() - start;
+    if (status < 0 || ctx->entry_count != values) {
+        printf("  heredoc parse failed\n");
+    }
+    report("parse 64 KB heredoc, per value", elapsed, values);
+    printf("  %-36s %12.1f MiB/s\n", "heredoc throughput",
+           (sb.length / 1048576.0) / (elapsed / 1e9));
+    parser_free(ctx);
+    free(sb.data);
+}
+
+/* The boolean test keyword_bool replaced, as it read before */
+static int keyword_strcmp(const char *token) {
+    if (strcmp(token, "true") == 0 || strcmp(token, "false") == 0 ||
+        strcmp(token, "True") == 0 || strcmp(token, "False") == 0 ||
+        strcmp(token, "TRUE") == 0 || strcmp(token, "FALSE") == 0 ||
+        strcmp(token, "yes") == 0 || strcmp(token, "no") == 0) {
+        return strcasecmp(token, "true") == 0 || strcasecmp(token, "yes") == 0;
+    }
+    return -1;
+}
+
+static void bench_keywords(void) {
+    const char *tokens[] = {"true", "False", "no", "localhost", "42", "TRUE",
+                            "yes", "nothing", "fals", "debug"};
+    const size_t count = sizeof(tokens) / sizeof(tokens[0]);
+    size_t lengths[sizeof(tokens) / sizeof(tokens[0])];
+    for (size_t i = 0; i < count; i++) lengths[i] = strlen(tokens[i]);
+    const size_t rounds = 10000000;
+
+    double start = now_ns();
+    for (size_t r = 0; r < rounds; r++) {
+        sink += keyword_strcmp(tokens[r % count]);
+    }
+    report("keyword strcmp chain, per value", now_ns() - start, rounds);
+
+    start = now_ns();
+    for (size_t r = 0; r < rounds; r++) {
+        sink += keyword_bool(tokens[r % count], lengths[r % count]);
+    }
+    report("keyword_bool, per value", now_ns() - start, rounds);
+}
+
+/*
+ * A numeric-heavy config: 200k keys whose values are integers in every
+ * accepted form, against the same integers all written in decimal.
+ */
+static void bench_numeric(void) {
+    const size_t keys = 200000;
+    StrBuf forms = {NULL, 0, 0}, decimal = {NULL, 0, 0};
+    char line[128];
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < keys; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        long long n = (long long)(x >> 20);
+        int len;
+        switch (i % 5) {
+            case 0:  len = snprintf(line, sizeof(line), "n%zu = 0x%llX\n", i, n); break;
+            case 1:  len = snprintf(line, sizeof(line), "n%zu = 0o%llo\n", i, n); break;
+            case 2:  len = snprintf(line, sizeof(line), "n%zu = -%lld_000\n", i, n % 1000000); break;
+            case 3: {
+                char bits[72];
+                int b = 0;
+                for (int k = 40; k >= 0; k--) bits[b++] = (char)('0' + ((n >> k) & 1));
+                bits[b] = '\0';
+                len = snprintf(line, sizeof(line), "n%zu = 0b%s\n", i, bits);
+                break;
+            }
+            default: len = snprintf(line, sizeof(line), "n%zu = %lld\n", i, n); break;
+        }
+        strbuf_append(&forms, line, (size_t)len);
+        long long value = i % 5 == 2 ? -(n % 1000000) * 1000 : i % 5 == 3 ? n & ((1LL << 41) - 1) : n;
+        len = snprintf(line, sizeof(line), "n%zu = %lld\n", i, value);
+        strbuf_append(&decimal, line, (size_t)len);
+    }
+    strbuf_append(&forms, "", 0);
+    strbuf_append(&decimal, "", 0);
+
+    const char *names[2] = {"numeric config, decimal", "numeric config, mixed forms"};
+    const StrBuf *texts[2] = {&decimal, &forms};
+    ParserContext *contexts[2];
+    for (int i = 0; i < 2; i++) {
+        contexts[i] = parser_init(false);
+        double start = now_ns();
+        sink += parse_string(contexts[i], texts[i]->data);
+        double elapsed = now_ns() - start;
+        report(names[i], elapsed, keys);
+        printf("  %-36s %12.1f MiB/s\n", i ? "mixed forms throughput" : "decimal throughput",
+               (texts[i]->length / 1048576.0) / (elapsed / 1e9));
+    }
+
+    // Both spellings must have read back as the same integers
+    size_t mismatches = 0;
+    for (size_t i = 0; i < keys; i++) {
+        snprintf(line, sizeof(line), "n%zu", i);
+        int64_t a = 0, b = 1;
+        if (config_get_int(contexts[0], line, &a) != CONFIG_OK ||
+            config_get_int(contexts[1], line, &b) != CONFIG_OK || a != b) {
+            mismatches++;
+        }
+    }
+    if (mismatches) printf("  numeric mismatches                   %12zu\n", mismatches);
+    parser_free(contexts[0]);
+    parser_free(contexts[1]);
+    free(forms.data);
+    free(decimal.data);
+}
+
+/* The RFC 3339 decoder against strptime + timegm on 1M UTC timestamps */
+static void bench_timestamps(void) {
+    const size_t count = 1000000;
+    enum { WIDTH = 32 };
+    char *stamps = (char*)malloc(count * WIDTH);
+    if (!stamps) return;
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < count; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        // Whole seconds from 1970 to about 2100, which strptime can express
+        int64_t seconds = (int64_t)(x % 4102444800ULL);
+        format_timestamp(stamps + i * WIDTH, WIDTH, seconds * 1000000000LL);
+    }
+
+    int64_t decoded = 0;
+    double start = now_ns();
+    for (size_t i = 0; i < count; i++) {
+        const char *stamp = stamps + i * WIDTH;
+        int64_t nanoseconds = 0;
+        scan_timestamp(stamp, strlen(stamp), &nanoseconds);
+        decoded += nanoseconds / 1000000000;
+    }
+    report("RFC 3339 decoder, per timestamp", now_ns() - start, count);
+
+    int64_t baseline = 0;
+    start = now_ns();
+    for (size_t i = 0; i < count; i++) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        if (strptime(stamps + i * WIDTH, "%Y-%m-%dT%H:%M:%S%z", &tm)) {
+            baseline += (int64_t)timegm(&tm) - tm.tm_gmtoff;
+        }
+    }
+    report("strptime + timegm, per timestamp", now_ns() - start, count);
+
+    if (decoded != baseline) printf("  timestamp decoders disagree\n");
+    sink += (uintptr_t)decoded;
+    free(stamps);
+}
+
+static void bench_array(void) {
+    const size_t count = 1000000;
+    StrBuf sb = {NULL, 0, 0};
+    char element[32];
+    strbuf_append(&sb, "[", 1);
+    for (size_t i = 0; i < count; i++) {
+        int len = snprintf(element, sizeof(element), i ? ", %zu" : "%zu", i * 7919);
+        strbuf_append(&sb, element, len);
+    }
+    strbuf_append(&sb, "]", 1);
+
+    // The lexer itself: parse_value's trim_whitespace deliberately overflows on text this long
+    char *cursor = sb.data;
+    double start = now_ns();
+    ConfigValue *value = lex_array(&cursor, sb.data + sb.length, NULL, NULL, NULL, 0);
+    report("1M-element array, per element", now_ns() - start, count);
+    sink += value ? value->data.array_val.count : 0;
+    free_value(value);
+    free(sb.data);
+}
+
+/* RSS and lookup latency of a 1M-key config before and after config_freeze */
+static void bench_freeze(void) {
+    const size_t keys = 1000000;
+    const size_t lookups = 1000000;
+    size_t baseline = resident_bytes();
+    char *text = generated_config(1, keys);
+    ParserContext *ctx = parser_init(false);
+    if (!ctx || parse_string(ctx, text) < 0) {
+        fprintf(stderr, "parse error: %s\n", ctx ? get_error(ctx) : "out of memory");
+        parser_free(ctx);
+        free(text);
+        return;
+    }
+    free(text);
+
+    char key[64];
+    for (int frozen = 0; frozen < 2; frozen++) {
+        if (frozen && config_freeze(ctx, true) < 0) break;
+        size_t resident = resident_bytes();
+        report_bytes(frozen ? "1M keys, frozen RSS" : "1M keys, RSS", resident - baseline);
+
+        double start = now_ns();
+        for (size_t i = 0; i < lookups; i++) {
+            snprintf(key, sizeof(key), "key.k%zu", (i * 104729) % keys);
+            sink += (uintptr_t)find_entry(ctx, "s0", key, false);
+        }
+        report(frozen ? "1M keys, frozen lookup" : "1M keys, lookup", now_ns() - start, lookups);
+    }
+    parser_free(ctx);
+}
+
+/* Resident memory of 200k values drawn from 64 distinct strings, copied vs interned */
+static void bench_interning(void) {
+    const size_t count = 200000;
+    StrBuf sb = {NULL, 0, 0};
+    char line[128];
+    strbuf_append(&sb, "[s0]\n", 5);
+    for (size_t i = 0; i < count; i++) {
+        int len = snprintf(line, sizeof(line), "key.k%zu = \"shared value number %zu of the pool\"\n",
+                           i, i % 64);
+        strbuf_append(&sb, line, len);
+    }
+
+    for (int intern = 0; intern < 2; intern++) {
+        size_t baseline = resident_bytes();
+        ParserContext *ctx = parser_init(false);
+        ctx->intern_values = intern;
+        parse_string(ctx, sb.data);
+        size_t resident = resident_bytes();
+        report_bytes(intern ? "200k values, interned RSS" : "200k values, copied RSS",
+                     resident > baseline ? resident - baseline : 0);
+        if (intern && ctx->value_pool) {
+            printf("  %-36s %12zu bytes in %zu strings, %zu reused\n", "value pool",
+                   ctx->value_pool->bytes, ctx->value_pool->count, ctx->value_pool->hits);
+        }
+        parser_free(ctx);
+    }
+    free(sb.data);
+}
+
+/* Journaled config_set, then replaying the journal onto the base config */
+static void bench_journal(void) {
+    char dir[] = "/tmp/config_parser_bench.XXXXXX";
+    if (!mkdtemp(dir)) return;
+    char path[256];
+    snprintf(path, sizeof(path), "%s/journal.log", dir);
+
+    const size_t ops = 200000;
+    char *text = generated_config(1, 10000);
+    char key[64];
+    ParserContext *ctx = parser_init(false);
+    parse_string(ctx, text);
+    if (config_journal_open(ctx, path) == 0) {
+        double start = now_ns();
+        for (size_t i = 0; i < ops; i++) {
+            snprintf(key, sizeof(key), "key.k%zu", (i * 7919) % 10000);
+            ConfigValue *value = i % 2 ? create_int_value((int64_t)i) :
+                                         create_string_value("replayed value");
+            config_set(ctx, "s0", key, value);
+        }
+        report("journaled config_set", now_ns() - start, ops);
+        config_journal_close(ctx);
+    }
+    parser_free(ctx);
+
+    ctx = parser_init(false);
+    parse_string(ctx, text);
+    double start = now_ns();
+    long replayed = config_journal_replay(ctx, path);
+    double elapsed = now_ns() - start;
+    if (replayed > 0) {
+        report("journal replay, per op", elapsed, (size_t)replayed);
+        printf("  %-36s %12.0f ops/s\n", "journal replay", replayed / (elapsed / 1e9));
+    }
+    parser_free(ctx);
+    free(text);
+
+    unlink(path);
+    rmdir(dir);
+}
+
+/* One section of keys; edited drops, changes and appends about 1% of them */
+static char* diff_config(size_t keys, bool edited) {
+    StrBuf sb = {NULL, 0, 0};
+    char line[128];
+    strbuf_append(&sb, "[s0]\n", 5);
+    for (size_t k = 0; k < keys; k++) {
+        if (edited && k % 100 == 1) continue;
+        int len = snprintf(line, sizeof(line), "key.k%zu = \"value %zu\"\n", k,
+                           edited && k % 100 == 2 ? k + 1 : k);
+        strbuf_append(&sb, line, len);
+    }
+    for (size_t k = 0; edited && k < keys / 100; k++) {
+        int len = snprintf(line, sizeof(line), "new.k%zu = %zu\n", k, k);
+        strbuf_append(&sb, line, len);
+    }
+    return sb.data;
+}
+
+/* config_diff of two 1M-entry contexts that differ in about 3% of keys */
+static void bench_diff(void) {
+    const size_t keys = 1000000;
+    ParserContext *contexts[2];
+    for (int i = 0; i < 2; i++) {
+        char *text = diff_config(keys, i == 1);
+        contexts[i] = parser_init(false);
+        parse_string(contexts[i], text);
+        free(text);
+    }
+
+    ConfigDiff diff;
+    double start = now_ns();
+    if (config_diff(contexts[0], contexts[1], &diff) == 0) {
+        report("diff of 1M-entry configs, per entry", now_ns() - start, keys);
+        printf("  %-36s %12zu\n", "changes found", diff.count);
+        config_diff_free(&diff);
+    }
+    parser_free(contexts[0]);
+    parser_free(contexts[1]);
+}
+
+/* 1k keys each defined 200 times, parsed under each duplicate policy */
+static void bench_overrides(void) {
+    const size_t keys = 1000, repeats = 200;
+    StrBuf sb = {NULL, 0, 0};
+    char line[64];
+    for (size_t r = 0; r < repeats; r++) {
+        for (size_t k = 0; k < keys; k++) {
+            int len = snprintf(line, sizeof(line), "key.k%zu = %zu\n", k, r);
+            strbuf_append(&sb, line, (size_t)len);
+        }
+    }
+    strbuf_append(&sb, "", 0);
+
+    const ConfigDuplicatePolicy policies[3] = {
+        CONFIG_DUP_KEEP_ALL, CONFIG_DUP_LAST_WINS, CONFIG_DUP_COLLECT};
+    const char *names[3] = {"200x overrides, KEEP_ALL", "200x overrides, LAST_WINS",
+                            "200x overrides, COLLECT"};
+    for (int i = 0; i < 3; i++) {
+        size_t baseline = resident_bytes();
+        ParserContext *ctx = parser_init(false);
+        ctx->duplicate_policy = policies[i];
+        double start = now_ns();
+        sink += parse_string(ctx, sb.data);
+        report(names[i], now_ns() - start, keys * repeats);
+        size_t resident = resident_bytes();
+        printf("  %-36s %12.1f MiB, %zu entries\n", "  resident", 
+               (resident > baseline ? resident - baseline : 0) / 1048576.0, ctx->entry_count);
+        parser_free(ctx);
+    }
+    free(sb.data);
+}
+
+/* The --diff mode end to end on 1M-key files, against parsing them one after the other */
+static void bench_diff_main(void) {
+    char dir[] = "/tmp/config_parser_bench.XXXXXX";
+    if (!mkdtemp(dir)) return;
+    char paths[2][256];
+    for (int i = 0; i < 2; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%s.conf", dir, i ? "new" : "old");
+        char *text = diff_config(1000000, i == 1);
+        FILE *file = fopen(paths[i], "w");
+        if (file) {
+            fputs(text, file);
+            fclose(file);
+        }
+        free(text);
+    }
+
+    double start = now_ns();
+    for (int i = 0; i < 2; i++) {
+        ParserContext *ctx = parser_init(false);
+        parse_file(ctx, paths[i]);
+        parser_free(ctx);
+    }
+    report("parse both 1M-key files, serial", now_ns() - start, 1);
+
+    // The 30k changes are printed, so send them nowhere
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (saved >= 0 && null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        start = now_ns();
+        int status = diff_main(paths[0], paths[1]);
+        double elapsed = now_ns() - start;
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        report("--diff of 1M-key files", elapsed, 1);
+        sink += status;
+    }
+    if (saved >= 0) close(saved);
+    if (null_fd >= 0) close(null_fd);
+
+    unlink(paths[0]);
+    unlink(paths[1]);
+    rmdir(dir);
+}
+
+#ifdef HAVE_ZLIB
+/* Parsing a gzip file as it streams in, against gunzip to disk and then parsing */
+static void bench_gzip(void) {
+    char dir[] = "/tmp/config_parser_bench.XXXXXX";
+    if (!mkdtemp(dir)) return;
+    char packed[256], plain[256];
+    snprintf(packed, sizeof(packed), "%s/input.conf.gz", dir);
+    snprintf(plain, sizeof(plain), "%s/input.conf", dir);
+    char *text = generated_config(1, 200000);
+    gzFile gz = gzopen(packed, "wb");
+    if (gz) {
+        gzputs(gz, text);
+        gzclose(gz);
+    }
+    free(text);
+
+    const int rounds = 5;
+    double start = now_ns();
+    for (int r = 0; r < rounds; r++) {
+        ParserContext *ctx = parser_init(false);
+        sink += parse_file(ctx, packed);
+        parser_free(ctx);
+    }
+    report("parse 200k-key gzip file", now_ns() - start, rounds);
+
+    start = now_ns();
+    for (int r = 0; r < rounds; r++) {
+        gz = gzopen(packed, "rb");
+        FILE *out = fopen(plain, "w");
+        char chunk[65536];
+        int got;
+        while (gz && out && (got = gzread(gz, chunk, sizeof(chunk))) > 0) {
+            fwrite(chunk, 1, (size_t)got, out);
+        }
+        if (gz) gzclose(gz);
+        if (out) fclose(out);
+        ParserContext *ctx = parser_init(false);
+        sink += parse_file(ctx, plain);
+        parser_free(ctx);
+    }
+    report("gunzip to disk, then parse", now_ns() - start, rounds);
+
+    unlink(packed);
+    unlink(plain);
+    rmdir(dir);
+}
+#endif
+
+int main(void) {
+    char *text = generated_config(100, 1000);
+    ParserContext *ctx = parser_init(false);
+
+    double start = now_ns();
+    if (parse_string(ctx, text) < 0) {
+        fprintf(stderr, "parse error: %s\n", get_error(ctx));
+        return 1;
+    }
+    printf("%zu entries\n", ctx->entry_count);
+    report("parse_string, per entry", now_ns() - start, ctx->entry_count);
+
+    bench_lookup(ctx);
+    bench_prefix(ctx);
+    bench_snapshot(ctx);
+    bench_mixed(ctx);
+    bench_cache(text);
+    bench_case_folding();
+    bench_utf8();
+    bench_strings();
+    bench_keywords();
+    bench_numeric();
+    bench_timestamps();
+    bench_array();
+    bench_heredoc();
+    bench_freeze();
+    bench_interpolation();
+    bench_interning();
+    bench_journal();
+    bench_overrides();
+    bench_diff();
+    bench_diff_main();
+#ifdef HAVE_ZLIB
+    bench_gzip();
+#endif
+
+    parser_free(ctx);
+    free(text);
+    return 0;
+}
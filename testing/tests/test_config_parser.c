@@ -0,0 +1,1398 @@
+/*
+ * Regression tests for the config parser.
+ *
+ * The parser is a single translation unit, so it is included directly:
+ * tests can reach the static helpers and compare them against a plain
+ * reference. Run with "make test"; every check prints on failure and
+ * the exit status is the number of failed tests.
+ */
+
+#define main config_parser_main
+#include "../src/config_parser.c"
+#undef main
+
+#include <time.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static int checks_failed;
+static char scratch_dir[] = "/tmp/config_parser_test.XXXXXX";
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "  %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        checks_failed++; \
+    } \
+} while (0)
+
+/* ========================================================================
+ * Helpers
+ * ======================================================================== */
+
+static char* scratch_path(const char *name) {
+    static char path[4][512];
+    static size_t next;
+    char *buffer = path[next++ % 4];
+    snprintf(buffer, sizeof(path[0]), "%s/%s", scratch_dir, name);
+    return buffer;
+}
+
+static void write_text(const char *path, const char *text) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+    fputs(text, file);
+    fclose(file);
+}
+
+static ParserContext* parse_text(const char *text) {
+    ParserContext *ctx = parser_init(false);
+    if (ctx && parse_string(ctx, text) < 0) {
+        fprintf(stderr, "  parse error: %s\n", get_error(ctx));
+        checks_failed++;
+    }
+    return ctx;
+}
+
+static const char* string_in(ParserContext *ctx, const char *section, const char *key) {
+    ConfigValue *value = get_value_in_section(ctx, section, key);
+    return value && value->type == TYPE_STRING ? value->data.string_val : NULL;
+}
+
+static int64_t int_in(ParserContext *ctx, const char *section, const char *key) {
+    ConfigValue *value = get_value_in_section(ctx, section, key);
+    return value && value->type == TYPE_INTEGER ? value->data.int_val : -1;
+}
+
+static bool streq(const char *a, const char *b) {
+    return a && b && strcmp(a, b) == 0;
+}
+
+/* Deterministic generator so failures reproduce */
+static uint64_t rng_state = 0x853c49e6748fea9bULL;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/* "[s<i>]" sections with n keys each, as one string */
+static char* generated_config(size_t sections, size_t keys) {
+    StrBuf sb = {NULL, 0, 0};
+    char line[128];
+    for (size_t s = 0; s < sections; s++) {
+        int len = snprintf(line, sizeof(line), "[s%zu]\n", s);
+        strbuf_append(&sb, line, len);
+        for (size_t k = 0; k < keys; k++) {
+            len = snprintf(line, sizeof(line), "key.k%zu = %zu\n", k, s * keys + k);
+            strbuf_append(&sb, line, len);
+        }
+    }
+    return sb.data;
+}
+
+/* ========================================================================
+ * Index, interpolation and queries
+ * ======================================================================== */
+
+/* The hash index finds the same entry as a scan of the entry list */
+static void test_index_matches_list_scan(void) {
+    char *text = generated_config(50, 200);
+    ParserContext *ctx = parse_text(text);
+    free(text);
+    CHECK(ctx->entry_count == 50 * 200);
+
+    // Every 97th entry against a first-match scan of the list
+    size_t mismatches = 0, position = 0;
+    for (ConfigEntry *entry = ctx->entries; entry; entry = entry->next) {
+        if (position++ % 97) continue;
+        ConfigEntry *scanned = NULL;
+        for (ConfigEntry *e = ctx->entries; e; e = e->next) {
+            if (strcmp(e->key, entry->key) == 0 && section_equals(e->section, entry->section)) {
+                scanned = e;
+                break;
+            }
+        }
+        if (find_entry(ctx, entry->section, entry->key, false) != scanned) mismatches++;
+    }
+    CHECK(mismatches == 0);
+    CHECK(int_in(ctx, "s49", "key.k199") == 49 * 200 + 199);
+    CHECK(get_value_in_section(ctx, "s50", "key.k0") == NULL);
+    parser_free(ctx);
+}
+
+static void test_interpolation_memoized(void) {
+    ParserContext *ctx = parse_text(
+        "[db]\nhost = example.org\nport = 5432\n"
+        "[app]\nurl = pg://${db.host}:${db.port}/main\nmirror = ${app.url}\n");
+
+    CHECK(streq(string_in(ctx, "app", "mirror"), "pg://example.org:5432/main"));
+    ConfigValue *memo = get_value_in_section(ctx, "app", "url");
+    CHECK(get_value_in_section(ctx, "app", "url") == memo);
+
+    // Changing a target re-expands its dependents
+    CHECK(config_set(ctx, "db", "host", create_string_value("db.internal")) == 0);
+    CHECK(streq(string_in(ctx, "app", "mirror"), "pg://db.internal:5432/main"));
+
+    parser_free(ctx);
+
+    ctx = parser_init(false);
+    CHECK(parse_string(ctx, "[loop]\na = ${loop.b}\nb = ${loop.a}\n") < 0);
+    CHECK(strstr(get_error(ctx), "cycle") != NULL);
+    parser_free(ctx);
+}
+
+static void test_prefix_scan_sorted(void) {
+    ParserContext *ctx = parse_text(
+        "[net]\nhttp.port = 80\nhttp.host = a\nhttps.port = 443\ndns = 1\n"
+        "[net.extra]\nhttp.timeout = 5\n");
+
+    ConfigCursor cursor;
+    CHECK(config_prefix_scan(ctx, "net.http.", &cursor) == 0);
+    CHECK(config_cursor_count(&cursor) == 2);
+
+    const char *path, *previous = "";
+    ConfigEntry *entry;
+    size_t seen = 0;
+    while (config_cursor_next(&cursor, &path, &entry)) {
+        CHECK(strncmp(path, "net.http.", 9) == 0);
+        CHECK(strcmp(previous, path) < 0);
+        previous = path;
+        seen++;
+    }
+    CHECK(seen == 2);
+
+    CHECK(config_section_scan(ctx, "net", &cursor) == 0);
+    CHECK(config_cursor_count(&cursor) == 2);
+    parser_free(ctx);
+}
+
+/* Replacing values keeps the index; adding a key rebuilds it */
+static void test_prefix_scan_across_sets(void) {
+    ParserContext *ctx = parse_text("[net]\nhttp.port = 80\nhttp.host = a\n");
+
+    ConfigCursor cursor, sections;
+    CHECK(config_prefix_scan(ctx, "net.http.", &cursor) == 0);
+    CHECK(config_section_scan(ctx, "net", &sections) == 0);
+    const PrefixIndexItem *items = ctx->prefix_index;
+    CHECK(config_set(ctx, "net", "http.port", create_int_value(8080)) == 0);
+    CHECK(config_set(ctx, "net", "http.host", create_string_value("b")) == 0);
+    CHECK(!ctx->prefix_index_dirty && ctx->prefix_index == items);
+
+    // The cursor sees the new versions; the section item names a live entry
+    const char *path;
+    ConfigEntry *entry;
+    CHECK(config_cursor_next(&cursor, &path, &entry) && streq(path, "net.http.host"));
+    CHECK(entry->died == ENTRY_LIVE && streq(entry->value->data.string_val, "b"));
+    CHECK(config_cursor_next(&cursor, &path, &entry) && streq(path, "net.http.port"));
+    CHECK(entry->died == ENTRY_LIVE && entry->value->data.int_val == 8080);
+    CHECK(config_cursor_next(&sections, &path, &entry) && entry->died == ENTRY_LIVE);
+    CHECK(streq(path, "net"));
+
+    CHECK(config_set(ctx, "net", "http.timeout", create_int_value(5)) == 0);
+    CHECK(ctx->prefix_index_dirty);
+    CHECK(config_prefix_scan(ctx, "net.http.", &cursor) == 0);
+    CHECK(config_cursor_count(&cursor) == 3);
+    parser_free(ctx);
+}
+
+static void test_tree_paths(void) {
+    ParserContext *ctx = parse_text("[server]\nhttp.port = 80\nhttp.host = a\nname = x\n");
+    const ConfigTree *tree = config_tree(ctx);
+    CHECK(tree != NULL);
+
+    size_t http = config_tree_find(tree, 0, "server.http");
+    CHECK(http != CONFIG_TREE_NONE);
+    CHECK(tree->nodes[http].child_count == 2);
+    size_t port = config_tree_find(tree, http, "port");
+    CHECK(port != CONFIG_TREE_NONE && tree->nodes[port].entry &&
+          tree->nodes[port].entry->value->data.int_val == 80);
+    CHECK(config_tree_find(tree, 0, "server.http.missing") == CONFIG_TREE_NONE);
+    parser_free(ctx);
+}
+
+/* ========================================================================
+ * Storage: freeze, interning, borrowed values
+ * ======================================================================== */
+
+static void test_freeze_packs_entries(void) {
+    ParserContext *ctx = parse_text("[a]\nx = 1\ny = \"two\"\nz = [1, 2, 3]\nw = ${a.y}!\n");
+    CHECK(config_freeze(ctx, false) == 0);
+    CHECK(ctx->frozen);
+
+    const char *lo = (const char*)ctx->frozen_block;
+    const char *hi = lo + ctx->frozen_size;
+    for (ConfigEntry *entry = ctx->entries; entry; entry = entry->next) {
+        CHECK((const char*)entry >= lo && (const char*)entry < hi);
+        CHECK((const char*)entry->value >= lo && (const char*)entry->value < hi);
+    }
+    CHECK(streq(string_in(ctx, "a", "w"), "two!"));
+    CHECK(get_value_in_section(ctx, "a", "z")->data.array_val.count == 3);
+    CHECK(config_set(ctx, "a", "x", create_int_value(2)) < 0);
+    parser_free(ctx);
+}
+
+/* Borrowed and interned strings move into the block, which frees their storage */
+static void test_freeze_releases_storage(void) {
+    char big[300];
+    memset(big, 'v', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    char text[512];
+    snprintf(text, sizeof(text), "[a]\nmode = production\nbig = %s\n[b]\nmode = production\n", big);
+    write_text(scratch_path("freeze.conf"), text);
+
+    ParserContext *ctx = parser_init(false);
+    ctx->intern_values = true;
+    CHECK(config_borrow_large_values(ctx, 128) == 0);
+    CHECK(parse_file(ctx, scratch_path("freeze.conf")) == 0);
+    CHECK(ctx->sources && ctx->value_pool);
+    CHECK(config_freeze(ctx, true) == 0);
+    CHECK(!ctx->sources && !ctx->value_pool);
+
+    const char *lo = (const char*)ctx->frozen_block;
+    const char *hi = lo + ctx->frozen_size;
+    const char *names[3][2] = {{"a", "mode"}, {"a", "big"}, {"b", "mode"}};
+    for (int i = 0; i < 3; i++) {
+        ConfigValue *value = get_value_in_section(ctx, names[i][0], names[i][1]);
+        CHECK(value && value->data.string_val >= lo && value->data.string_val < hi);
+        CHECK(value && !(value->flags & (VALUE_FLAG_INTERNED | VALUE_FLAG_BORROWED)));
+    }
+    CHECK(streq(string_in(ctx, "a", "big"), big));
+    CHECK(streq(string_in(ctx, "b", "mode"), "production"));
+    parser_free(ctx);
+}
+
+static void test_interned_values_shared(void) {
+    ParserContext *ctx = parser_init(false);
+    ctx->intern_values = true;
+    CHECK(parse_string(ctx, "[a]\nmode = production\n[b]\nmode = production\n") == 0);
+    CHECK(string_in(ctx, "a", "mode") == string_in(ctx, "b", "mode"));
+    CHECK(ctx->value_pool && ctx->value_pool->hits >= 1);
+    parser_free(ctx);
+}
+
+static void test_borrowed_large_values(void) {
+    char text[512];
+    char big[300];
+    memset(big, 'v', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    snprintf(text, sizeof(text), "[a]\nsmall = s\nbig = %s\n", big);
+    write_text(scratch_path("borrow.conf"), text);
+
+    ParserContext *ctx = parser_init(false);
+    CHECK(config_borrow_large_values(ctx, 128) == 0);
+    CHECK(parse_file(ctx, scratch_path("borrow.conf")) == 0);
+    ConfigValue *value = get_value_in_section(ctx, "a", "big");
+    CHECK(value && (value->flags & VALUE_FLAG_BORROWED));
+    CHECK(streq(string_in(ctx, "a", "big"), big));
+    CHECK(!(get_value_in_section(ctx, "a", "small")->flags & VALUE_FLAG_BORROWED));
+    parser_free(ctx);
+}
+
+/* Only string values are borrowed; other long lines parse as usual */
+static void test_borrow_routes_by_content(void) {
+    write_text(scratch_path("routes.conf"),
+               "[a.section.with.a.long.name]\n"
+               "n = 123456789012345678\n"
+               "z = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11]\n"
+               "q = \"a quoted long value\"\n"
+               "bare = a bare long string value\n"
+               "after = 1\n");
+
+    ParserContext *ctx = parser_init(true);
+    CHECK(config_borrow_large_values(ctx, 16) == 0);
+    CHECK(parse_file(ctx, scratch_path("routes.conf")) == 0);
+    CHECK(ctx->entry_count == 5);
+
+    const char *section = "a.section.with.a.long.name";
+    ConfigValue *value = get_value_in_section(ctx, section, "n");
+    CHECK(value && value->type == TYPE_INTEGER && value->data.int_val == 123456789012345678LL);
+    value = get_value_in_section(ctx, section, "z");
+    CHECK(value && value->type == TYPE_ARRAY && value->data.array_val.count == 11);
+    value = get_value_in_section(ctx, section, "q");
+    CHECK(value && (value->flags & VALUE_FLAG_BORROWED) &&
+          streq(value->data.string_val, "a quoted long value"));
+    value = get_value_in_section(ctx, section, "bare");
+    CHECK(value && (value->flags & VALUE_FLAG_BORROWED) &&
+          streq(value->data.string_val, "a bare long string value"));
+    CHECK(int_in(ctx, section, "after") == 1);
+    parser_free(ctx);
+
+    // Thresholds past the line buffer are kept as given
+    ctx = parser_init(false);
+    CHECK(config_borrow_large_values(ctx, 4 * MAX_LINE_LENGTH) == 0);
+    CHECK(ctx->borrow_threshold == 4 * MAX_LINE_LENGTH);
+    parser_free(ctx);
+}
+
+/* ========================================================================
+ * Publication, snapshots, journal, reload
+ * ======================================================================== */
+
+static void test_shm_publication(void) {
+    char name[64];
+    snprintf(name, sizeof(name), "/config_parser_test_%d", (int)getpid());
+
+    ParserContext *ctx = parse_text("[a]\nport = 8080\nhosts = [\"x\", \"y\"]\n");
+    CHECK(config_publish(ctx, name) == 0);
+
+    ConfigShmReader *reader = config_shm_open(name);
+    CHECK(reader != NULL);
+    if (reader) {
+        ConfigValueView view;
+        CHECK(config_shm_get(reader, "a", "port", &view) && view.data.int_val == 8080);
+        CHECK(config_shm_get(reader, "a", "hosts", &view) &&
+              streq(config_view_string_element(&view, 1), "y"));
+
+        CHECK(config_set(ctx, "a", "port", create_int_value(9090)) == 0);
+        CHECK(config_publish(ctx, name) == 0);
+        CHECK(config_shm_refresh(reader) == 1);
+        CHECK(config_shm_get(reader, "a", "port", &view) && view.data.int_val == 9090);
+
+        // A publisher that died mid-update: readers give up, the next publish recovers
+        ShmControl *control = shm_map_control(name, true);
+        atomic_fetch_add(&control->sequence, 1);
+        CHECK(config_set(ctx, "a", "port", create_int_value(7070)) == 0);
+        CHECK(config_shm_refresh(reader) == -1);
+        CHECK(config_publish(ctx, name) == 0);
+        CHECK((atomic_load(&control->sequence) & 1) == 0);
+        CHECK(config_shm_refresh(reader) == 1);
+        CHECK(config_shm_get(reader, "a", "port", &view) && view.data.int_val == 7070);
+        munmap(control, sizeof(ShmControl));
+        config_shm_close(reader);
+    }
+    config_unpublish(name);
+    parser_free(ctx);
+}
+
+/* A reader rejects images that are stale or whose links leave the mapping */
+static void test_shm_image_validation(void) {
+    ParserContext *ctx = parse_text("[a]\nx = 1\nname = n\nnested = [[1, \"s\"], [2]]\n");
+    size_t size = 0;
+    char *image = image_build(ctx, &size);
+    CHECK(image && image_valid(image, size));
+
+    char *copy = (char*)malloc(size);
+    ImageHeader *header = (ImageHeader*)copy;
+    ImageEntry *entries = (ImageEntry*)(copy + ((ImageHeader*)image)->entries);
+
+#define CORRUPTED(change) (memcpy(copy, image, size), (change), !image_valid(copy, size))
+    CHECK(CORRUPTED(header->version = IMAGE_VERSION - 1));
+    CHECK(CORRUPTED(header->bucket_count = 3));
+    CHECK(CORRUPTED(header->size = size + 8));
+    CHECK(CORRUPTED(header->entries = size - 8));
+    CHECK(CORRUPTED(header->entry_count = size));
+    CHECK(CORRUPTED(entries[0].next = 1));
+    CHECK(CORRUPTED(entries[1].key = size));
+    CHECK(CORRUPTED(entries[2].value.data.offset = size - 8));
+    CHECK(CORRUPTED(copy[size - 1] = 'x'));
+#undef CORRUPTED
+    CHECK(!image_valid(image, sizeof(ImageHeader) - 1));
+
+    free(copy);
+    free(image);
+    parser_free(ctx);
+}
+
+static void test_snapshot_isolation(void) {
+    ParserContext *ctx = parse_text("[a]\nx = 1\ny = 2\n");
+
+    ConfigSnapshot snapshot;
+    CHECK(config_snapshot_acquire(ctx, &snapshot) == 0);
+    CHECK(config_set(ctx, "a", "x", create_int_value(10)) == 0);
+    CHECK(config_set(ctx, "a", "z", create_int_value(3)) == 0);
+    CHECK(config_remove(ctx, "a", "y") == 0);
+
+    ConfigValue *value = config_snapshot_get(&snapshot, "a", "x");
+    CHECK(value && value->data.int_val == 1);
+    value = config_snapshot_get(&snapshot, "a", "y");
+    CHECK(value && value->data.int_val == 2);
+    CHECK(config_snapshot_get(&snapshot, "a", "z") == NULL);
+    config_snapshot_release(&snapshot);
+
+    CHECK(int_in(ctx, "a", "x") == 10);
+    CHECK(get_value_in_section(ctx, "a", "y") == NULL);
+    CHECK(int_in(ctx, "a", "z") == 3);
+    parser_free(ctx);
+}
+
+/* Snapshots only ever see expanded values, including those of a later parse */
+static void test_snapshot_interpolation(void) {
+    ParserContext *ctx = parse_text("[db]\nhost = h1\n[app]\nurl = x://${db.host}\n");
+
+    ConfigSnapshot snapshot;
+    CHECK(config_snapshot_acquire(ctx, &snapshot) == 0);
+    ConfigValue *value = config_snapshot_get(&snapshot, "app", "url");
+    CHECK(value && value->type == TYPE_STRING && streq(value->data.string_val, "x://h1"));
+
+    CHECK(parse_string(ctx, "[app]\nmirror = ${app.url}/m\n") == 0);
+    CHECK(config_snapshot_get(&snapshot, "app", "mirror") == NULL);
+    config_snapshot_release(&snapshot);
+
+    CHECK(config_snapshot_acquire(ctx, &snapshot) == 0);
+    value = config_snapshot_get(&snapshot, "app", "mirror");
+    CHECK(value && value->type == TYPE_STRING && streq(value->data.string_val, "x://h1/m"));
+    config_snapshot_release(&snapshot);
+
+    // Entries added line by line are expanded when they are published
+    CHECK(parse_line(ctx, "port = ${db.host}:80") == 0);
+    CHECK(resolve_interpolations(ctx) == 0);
+    CHECK(config_snapshot_acquire(ctx, &snapshot) == 0);
+    value = config_snapshot_get(&snapshot, "app", "port");
+    CHECK(value && value->type == TYPE_STRING && streq(value->data.string_val, "h1:80"));
+    config_snapshot_release(&snapshot);
+    parser_free(ctx);
+}
+
+static void test_journal_round_trip(void) {
+    const char *base = "[a]\nx = 1\ny = keep\n";
+    const char *journal = scratch_path("journal.log");
+    unlink(journal);
+
+    ParserContext *ctx = parse_text(base);
+    CHECK(config_journal_open(ctx, journal) == 0);
+    CHECK(config_set(ctx, "a", "x", create_int_value(42)) == 0);
+    CHECK(config_set(ctx, NULL, "top", create_string_value("with \"quotes\"")) == 0);
+    CHECK(config_set(ctx, "a", "list", parse_value("[1, 2, 3]")) == 0);
+    CHECK(config_remove(ctx, "a", "y") == 0);
+    config_journal_close(ctx);
+    parser_free(ctx);
+
+    ctx = parse_text(base);
+    CHECK(config_journal_replay(ctx, journal) == 4);
+    CHECK(int_in(ctx, "a", "x") == 42);
+    CHECK(streq(string_in(ctx, NULL, "top"), "with \"quotes\""));
+    CHECK(get_value_in_section(ctx, "a", "list")->data.array_val.count == 3);
+    CHECK(get_value_in_section(ctx, "a", "y") == NULL);
+    parser_free(ctx);
+}
+
+static ConfigValue* create_null_value(void) {
+    ConfigValue *value = (ConfigValue*)calloc(1, sizeof(ConfigValue));
+    value->type = TYPE_NULL;
+    return value;
+}
+
+static ParserContext* parse_with_literals(const char *text) {
+    ParserContext *ctx = parser_init(false);
+    config_define_literal(ctx, "nil", create_null_value());
+    config_define_literal(ctx, "enabled", create_bool_value(true));
+    parse_string(ctx, text);
+    return ctx;
+}
+
+/* Values only a literal can spell survive the journal and config_write */
+static void test_journal_literals(void) {
+    const char *journal = scratch_path("literals.log");
+    unlink(journal);
+
+    ParserContext *ctx = parse_with_literals("[a]\nx = 1\n");
+    CHECK(config_journal_open(ctx, journal) == 0);
+    CHECK(config_set(ctx, "a", "x", create_null_value()) == 0);
+    CHECK(config_set(ctx, "a", "list", parse_value_pooled("[nil, 1, \"nil\"]", NULL,
+                                                          ctx->literals, NULL)) == 0);
+    CHECK(config_set(ctx, "a", "flag", parse_value_pooled("enabled", NULL,
+                                                          ctx->literals, NULL)) == 0);
+    config_journal_close(ctx);
+
+    const char *written = scratch_path("literals.conf");
+    CHECK(config_write_file(ctx, written) == 0);
+    parser_free(ctx);
+
+    ctx = parse_with_literals("[a]\nx = 1\n");
+    CHECK(config_journal_replay(ctx, journal) == 3);
+    ParserContext *reread = parser_init(false);
+    config_define_literal(reread, "nil", create_null_value());
+    CHECK(parse_file(reread, written) == 0);
+
+    ParserContext *contexts[2] = {ctx, reread};
+    for (int i = 0; i < 2; i++) {
+        ConfigValue *x = get_value_in_section(contexts[i], "a", "x");
+        ConfigValue *list = get_value_in_section(contexts[i], "a", "list");
+        CHECK(x && x->type == TYPE_NULL);
+        CHECK(list && list->data.array_val.element_type == TYPE_ARRAY);
+        if (list && list->data.array_val.element_type == TYPE_ARRAY) {
+            ConfigValue **items = (ConfigValue**)list->data.array_val.elements;
+            CHECK(items[0]->type == TYPE_NULL);
+            CHECK(items[2]->type == TYPE_STRING && streq(items[2]->data.string_val, "nil"));
+        }
+        ConfigValue *flag = get_value_in_section(contexts[i], "a", "flag");
+        CHECK(flag && flag->type == TYPE_BOOLEAN && flag->data.bool_val);
+    }
+    parser_free(ctx);
+    parser_free(reread);
+}
+
+typedef struct {
+    size_t calls;
+    size_t changes;
+    ConfigChangeKind last_kind;
+} ChangeLog;
+
+static void record_changes(const ConfigChange *changes, size_t count, void *user_data) {
+    ChangeLog *log = (ChangeLog*)user_data;
+    log->calls++;
+    log->changes += count;
+    if (count) log->last_kind = changes[count - 1].kind;
+}
+
+static void test_reload_delivers_diff(void) {
+    const char *path = scratch_path("reload.conf");
+    write_text(path, "[a]\nx = 1\ny = 2\n[b]\nz = 3\n");
+
+    ParserContext *ctx = parser_init(false);
+    CHECK(parse_file(ctx, path) == 0);
+    ChangeLog key_log = {0}, section_log = {0}, other_log = {0};
+    CHECK(config_subscribe(ctx, CONFIG_WATCH_KEY, "a", "x", record_changes, &key_log) >= 0);
+    CHECK(config_subscribe(ctx, CONFIG_WATCH_SECTION, "a", NULL, record_changes,
+                           &section_log) >= 0);
+    CHECK(config_subscribe(ctx, CONFIG_WATCH_PREFIX, NULL, "b.", record_changes,
+                           &other_log) >= 0);
+
+    write_text(path, "[a]\nx = 5\nw = 4\n[b]\nz = 3\n");
+    CHECK(config_reload(ctx, path) == 0);
+    CHECK(key_log.calls == 1 && key_log.changes == 1 &&
+          key_log.last_kind == CONFIG_CHANGE_MODIFIED);
+    CHECK(section_log.changes == 3);
+    CHECK(other_log.calls == 0);
+    CHECK(int_in(ctx, "a", "x") == 5 && int_in(ctx, "a", "w") == 4);
+    CHECK(get_value_in_section(ctx, "a", "y") == NULL);
+    parser_free(ctx);
+}
+
+/* The reload parses with ctx's settings, so nothing changes spuriously */
+static void test_reload_keeps_parse_settings(void) {
+    const char *path = scratch_path("settings.conf");
+    const char *text = "[Net]\nHost = a\nhost = b\nMode = on\n";
+    write_text(path, text);
+
+    ParserContext *ctx = parser_init(false);
+    ctx->case_insensitive = true;
+    ctx->duplicate_policy = CONFIG_DUP_LAST_WINS;
+    config_define_literal(ctx, "on", create_int_value(1));
+    CHECK(parse_file(ctx, path) == 0);
+    ChangeLog log = {0};
+    CHECK(config_subscribe(ctx, CONFIG_WATCH_SECTION, "net", NULL, record_changes, &log) >= 0);
+
+    CHECK(config_reload(ctx, path) == 0);
+    CHECK(log.changes == 0);
+    CHECK(streq(string_in(ctx, "NET", "HOST"), "b") && int_in(ctx, "net", "mode") == 1);
+
+    write_text(path, "[NET]\nhost = c\nMODE = on\n");
+    CHECK(config_reload(ctx, path) == 0);
+    CHECK(log.changes == 1 && streq(string_in(ctx, "net", "host"), "c"));
+    parser_free(ctx);
+}
+
+typedef struct {
+    ParserContext *ctx;
+    int count;
+} SetterJob;
+
+static void* set_keys(void *arg) {
+    SetterJob *job = (SetterJob*)arg;
+    char key[32];
+    for (int i = 0; i < job->count; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        config_set(job->ctx, "live", key, create_int_value(i));
+    }
+    return NULL;
+}
+
+/* Reloads skip the journal without dropping records of concurrent writers */
+static void test_reload_with_concurrent_journal(void) {
+    const char *path = scratch_path("journaled.conf");
+    const char *journal = scratch_path("journaled.log");
+    unlink(journal);
+    write_text(path, "[a]\nx = 1\n");
+
+    ParserContext *ctx = parser_init(false);
+    CHECK(parse_file(ctx, path) == 0);
+    CHECK(config_journal_open(ctx, journal) == 0);
+
+    SetterJob job = {ctx, 2000};
+    pthread_t thread;
+    pthread_create(&thread, NULL, set_keys, &job);
+    for (int i = 0; i < 50; i++) {
+        write_text(path, i % 2 ? "[a]\nx = 1\n" : "[a]\nx = 2\ny = 3\n");
+        config_reload(ctx, path);
+    }
+    pthread_join(thread, NULL);
+    config_journal_close(ctx);
+    parser_free(ctx);
+
+    // Every concurrent set, and no reload change, is in the journal
+    ctx = parse_text("[a]\nx = 9\n");
+    CHECK(config_journal_replay(ctx, journal) == job.count);
+    CHECK(int_in(ctx, "live", "k1999") == 1999 && int_in(ctx, "a", "x") == 9);
+    parser_free(ctx);
+}
+
+static void test_diff_and_parallel_parse(void) {
+    write_text(scratch_path("old.conf"), "[a]\nx = 1\ny = 2\nz = [1, 2]\n");
+    write_text(scratch_path("new.conf"), "[a]\nx = 1\ny = 3\nw = 4\n");
+
+    ParserContext *contexts[2] = {parser_init(false), parser_init(false)};
+    const char *files[2] = {scratch_path("old.conf"), scratch_path("new.conf")};
+    CHECK(parse_files_parallel(contexts, files, 2) == 0);
+
+    ConfigDiff diff = {0};
+    CHECK(config_diff(contexts[0], contexts[1], &diff) == 0);
+    size_t kinds[3] = {0};
+    for (size_t i = 0; i < diff.count; i++) {
+        kinds[diff.changes[i].kind]++;
+    }
+    CHECK(diff.count == 3);
+    CHECK(kinds[CONFIG_CHANGE_ADDED] == 1 && kinds[CONFIG_CHANGE_REMOVED] == 1 &&
+          kinds[CONFIG_CHANGE_MODIFIED] == 1);
+    config_diff_free(&diff);
+
+    CHECK(config_diff(contexts[0], contexts[0], &diff) == 0 && diff.count == 0);
+    config_diff_free(&diff);
+    parser_free(contexts[0]);
+    parser_free(contexts[1]);
+}
+
+/* ========================================================================
+ * Input: hashes, cache, compression
+ * ======================================================================== */
+
+static void test_content_hashes(void) {
+    ParserContext *a = parse_text("[s]\nx = 1\ny = two\n");
+    ParserContext *b = parse_text("[s]\ny = two\nx = 1\n");
+    ParserContext *c = parse_text("[s]\nx = 1\ny = two\n");
+    CHECK(a->raw_hash != b->raw_hash);
+    CHECK(a->raw_hash == c->raw_hash);
+    CHECK(a->canonical_hash == b->canonical_hash);
+
+    // The streaming hash does not depend on how the input is split
+    const char *text = "streaming content fingerprint over several update calls";
+    ContentHasher hasher;
+    content_hash_init(&hasher, 7);
+    size_t len = strlen(text);
+    for (size_t offset = 0; offset < len; offset += 3) {
+        content_hash_update(&hasher, text + offset, len - offset < 3 ? len - offset : 3);
+    }
+    CHECK(content_hash_digest(&hasher) == content_hash(text, len, 7));
+
+    CHECK(config_set(b, "s", "x", create_int_value(2)) == 0);
+    CHECK(a->canonical_hash != b->canonical_hash);
+    CHECK(config_set(b, "s", "x", create_int_value(1)) == 0);
+    CHECK(a->canonical_hash == b->canonical_hash);
+    parser_free(a);
+    parser_free(b);
+    parser_free(c);
+}
+
+static void test_parse_cache_hit_and_miss(void) {
+    const char *path = scratch_path("cached.conf");
+    const char *cache = scratch_path("cache");
+    write_text(path, "[a]\nx = 1\nname = \"cached\"\nlist = [1, 2]\n");
+
+    ParserContext *ctx = parser_init(false);
+    CHECK(config_cache_enable(ctx, cache, 0) == 0);
+    CHECK(parse_file(ctx, path) == 0);
+    CHECK(!ctx->from_cache);
+    parser_free(ctx);
+
+    ctx = parser_init(false);
+    CHECK(config_cache_enable(ctx, cache, 0) == 0);
+    CHECK(parse_file(ctx, path) == 0);
+    CHECK(ctx->from_cache);
+    CHECK(int_in(ctx, "a", "x") == 1 && streq(string_in(ctx, "a", "name"), "cached"));
+    parser_free(ctx);
+
+    // Different parse settings must not share an image
+    for (int setting = 0; setting < 8; setting++) {
+        ctx = parser_init(setting == 0);
+        switch (setting) {
+            case 1: ctx->case_insensitive = true; break;
+            case 2: ctx->duplicate_policy = CONFIG_DUP_LAST_WINS; break;
+            case 3: ctx->validate_utf8 = true; break;
+            case 4: ctx->intern_values = true; break;
+            case 5: config_borrow_large_values(ctx, 64); break;
+            case 6: config_define_literal(ctx, "cached", create_bool_value(true)); break;
+            case 7: ctx->max_entries = 2; break;
+        }
+        CHECK(config_cache_enable(ctx, cache, 0) == 0);
+        parse_file(ctx, path);
+        CHECK(!ctx->from_cache);
+        parser_free(ctx);
+    }
+
+    // The same literals in another order are the same settings
+    for (int round = 0; round < 2; round++) {
+        ctx = parser_init(false);
+        config_define_literal(ctx, round ? "x2" : "x1", create_int_value(round ? 2 : 1));
+        config_define_literal(ctx, round ? "x1" : "x2", create_int_value(round ? 1 : 2));
+        CHECK(config_cache_enable(ctx, cache, 0) == 0);
+        CHECK(parse_file(ctx, path) == 0);
+        CHECK(ctx->from_cache == (round == 1));
+        parser_free(ctx);
+    }
+
+    // Nor may a changed file
+    write_text(path, "[a]\nx = 2\nname = \"cached\"\nlist = [1, 2]\n");
+    ctx = parser_init(false);
+    CHECK(config_cache_enable(ctx, cache, 0) == 0);
+    CHECK(parse_file(ctx, path) == 0);
+    CHECK(!ctx->from_cache && int_in(ctx, "a", "x") == 2);
+    parser_free(ctx);
+}
+
+static void test_compressed_input(void) {
+    // Plain input shorter than the sniffed magic is passed through whole
+    write_text(scratch_path("tiny.conf"), "a=1");
+    ParserContext *tiny = parser_init(false);
+    CHECK(parse_file(tiny, scratch_path("tiny.conf")) == 0 && int_in(tiny, NULL, "a") == 1);
+    parser_free(tiny);
+
+#ifdef HAVE_ZLIB
+    const char *text = "[a]\nx = 1\ny = \"compressed\"\n";
+    gzFile gz = gzopen(scratch_path("input.conf.gz"), "wb");
+    CHECK(gz != NULL);
+    if (!gz) return;
+    gzputs(gz, text);
+    gzclose(gz);
+
+    ParserContext *ctx = parser_init(false);
+    CHECK(parse_file(ctx, scratch_path("input.conf.gz")) == 0);
+    ParserContext *plain = parse_text(text);
+    CHECK(int_in(ctx, "a", "x") == 1 && streq(string_in(ctx, "a", "y"), "compressed"));
+    CHECK(ctx->canonical_hash == plain->canonical_hash);
+    parser_free(ctx);
+    parser_free(plain);
+#endif
+}
+
+/* ========================================================================
+ * Lexing: multi-line values, strings, arrays, UTF-8, literals
+ * ======================================================================== */
+
+static void test_multiline_values(void) {
+    ParserContext *ctx = parse_text(
+        "[m]\n"
+        "triple = \"\"\"\nfirst\nsecond\n\"\"\"\n"
+        "doc = <<END\n  keep indent\nEND\n"
+        "joined = one \\\n  two\n"
+        "after = 1\n");
+    CHECK(streq(string_in(ctx, "m", "triple"), "first\nsecond\n"));
+    CHECK(streq(string_in(ctx, "m", "doc"), "  keep indent"));
+    CHECK(streq(string_in(ctx, "m", "joined"), "one two"));
+    CHECK(int_in(ctx, "m", "after") == 1);
+    parser_free(ctx);
+
+    // Longer than a line buffer, built one line at a time
+    StrBuf sb = {NULL, 0, 0};
+    strbuf_append(&sb, "big = <<EOT\n", 12);
+    for (int i = 0; i < 200; i++) {
+        strbuf_append(&sb, "0123456789012345678901234567890123456789\n", 41);
+    }
+    strbuf_append(&sb, "EOT\n", 4);
+    ctx = parse_text(sb.data);
+    const char *big = string_in(ctx, NULL, "big");
+    CHECK(big && strlen(big) == 200 * 41 - 1);
+    free(sb.data);
+    parser_free(ctx);
+}
+
+static void test_string_escapes(void) {
+    ParserContext *ctx = parse_text(
+        "plain = \"no escapes here\"\n"
+        "esc = \"tab\\there \\\"q\\\" \\u00e9\\\\\"\n"
+        "list = [\"a,b\", \"c\\\"]\", d]\n");
+    ConfigValue *plain = get_value(ctx, "plain");
+    CHECK(plain && streq(plain->data.string_val, "no escapes here"));
+    CHECK(streq(string_in(ctx, NULL, "esc"), "tab\there \"q\" \xc3\xa9\\"));
+
+    ConfigValue *list = get_value(ctx, "list");
+    CHECK(list && list->type == TYPE_ARRAY && list->data.array_val.count == 3);
+    if (list && list->data.array_val.count == 3) {
+        CHECK(streq((char*)list->data.array_val.elements[0], "a,b"));
+        CHECK(streq((char*)list->data.array_val.elements[1], "c\"]"));
+    }
+    parser_free(ctx);
+}
+
+static void test_nested_and_mixed_arrays(void) {
+    ParserContext *ctx = parse_text(
+        "flat = [1, 2, 3]\n"
+        "nested = [[1, 2], [3], [[4]]]\n"
+        "mixed = [1, \"two\", 3.5, true]\n"
+        "empty = []\n");
+
+    ConfigValue *flat = get_value(ctx, "flat");
+    CHECK(flat->data.array_val.element_type == TYPE_INTEGER &&
+          *(int64_t*)flat->data.array_val.elements[2] == 3);
+
+    ConfigValue *nested = get_value(ctx, "nested");
+    CHECK(nested->data.array_val.element_type == TYPE_ARRAY &&
+          nested->data.array_val.count == 3);
+    ConfigValue *inner = (ConfigValue*)nested->data.array_val.elements[0];
+    CHECK(inner->type == TYPE_ARRAY && inner->data.array_val.count == 2);
+    ConfigValue *deep = (ConfigValue*)nested->data.array_val.elements[2];
+    CHECK(deep->data.array_val.element_type == TYPE_ARRAY &&
+          ((ConfigValue*)deep->data.array_val.elements[0])->type == TYPE_ARRAY);
+    CHECK(get_value(ctx, "empty") == NULL);
+
+    ConfigValue *mixed = get_value(ctx, "mixed");
+    CHECK(mixed->data.array_val.element_type == TYPE_ARRAY);
+    ConfigValue *second = (ConfigValue*)mixed->data.array_val.elements[1];
+    ConfigValue *fourth = (ConfigValue*)mixed->data.array_val.elements[3];
+    CHECK(second->type == TYPE_STRING && streq(second->data.string_val, "two"));
+    CHECK(fourth->type == TYPE_BOOLEAN && fourth->data.bool_val);
+
+    ConfigValue *copy = copy_value(nested);
+    CHECK(config_value_equals(copy, nested));
+    free_value(copy);
+    parser_free(ctx);
+}
+
+/*
+ * Arrays have no element cap. The lexer is called directly: parse_value
+ * would run into the deliberate test_array overflow on text this long.
+ */
+static void test_long_array(void) {
+    StrBuf sb = {NULL, 0, 0};
+    char element[16];
+    strbuf_append(&sb, "[", 1);
+    for (int i = 0; i < 150; i++) {
+        int len = snprintf(element, sizeof(element), i ? ", %d" : "%d", i);
+        strbuf_append(&sb, element, len);
+    }
+    strbuf_append(&sb, "]", 1);
+
+    char *cursor = sb.data;
+    ConfigValue *big = lex_array(&cursor, sb.data + sb.length, NULL, NULL, NULL, 0);
+    CHECK(big && big->type == TYPE_ARRAY && big->data.array_val.count == 150);
+    if (big && big->type == TYPE_ARRAY && big->data.array_val.count == 150) {
+        CHECK(*(int64_t*)big->data.array_val.elements[149] == 149);
+        CHECK(validate_key_value("big", big));
+    }
+    free_value(big);
+    free(sb.data);
+}
+
+static void test_utf8_validation(void) {
+    ParserContext *ctx = parser_init(false);
+    ctx->validate_utf8 = true;
+    CHECK(parse_string(ctx, "name = \"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80\"\n") == 0);
+    CHECK(parse_string(ctx, "bad = \"\xc0\xaf\"\n") < 0);
+    CHECK(strstr(get_error(ctx), "column 8") != NULL);
+    parser_free(ctx);
+}
+
+/* Random text built from valid sequences, with some bytes corrupted */
+static size_t random_utf8(unsigned char *out, size_t max) {
+    static const char *pieces[] = {
+        "a", "key = value ", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80",
+        "\xed\x9f\xbf", "\xef\xbf\xbf", "\xf4\x8f\xbf\xbf", "\xc2\x80",
+    };
+    size_t len = 0, target = rng_next() % max;
+    while (len < target) {
+        const char *piece = pieces[rng_next() % (sizeof(pieces) / sizeof(pieces[0]))];
+        size_t piece_len = strlen(piece);
+        if (len + piece_len > max) break;
+        memcpy(out + len, piece, piece_len);
+        len += piece_len;
+    }
+    for (uint64_t flips = rng_next() % 3; flips > 0 && len > 0; flips--) {
+        out[rng_next() % len] = (unsigned char)rng_next();
+    }
+    return len;
+}
+
+/* The SSSE3 validator accepts exactly what the scalar one accepts */
+static void test_utf8_simd_matches_scalar(void) {
+#ifdef HAVE_SSSE3_DISPATCH
+    if (!__builtin_cpu_supports("ssse3")) return;
+
+    unsigned char text[96];
+    size_t disagreements = 0, invalid = 0;
+    for (int i = 0; i < 200000; i++) {
+        size_t len = random_utf8(text, sizeof(text));
+        bool scalar = utf8_scan_scalar(text, len) == len;
+        if (utf8_valid_simd(text, len) != scalar) disagreements++;
+        if (utf8_validate((const char*)text, len) != utf8_scan_scalar(text, len)) {
+            disagreements++;
+        }
+        if (!scalar) invalid++;
+    }
+    CHECK(disagreements == 0);
+    CHECK(invalid > 10000);
+
+    // Every two-byte tail, so sequences cut off at the end are covered
+    for (unsigned a = 0; a < 256; a++) {
+        for (unsigned b = 0; b < 256; b++) {
+            unsigned char pair[18];
+            memset(pair, 'x', 16);
+            pair[16] = (unsigned char)a;
+            pair[17] = (unsigned char)b;
+            for (size_t len = 17; len <= 18; len++) {
+                if (utf8_valid_simd(pair, len) != (utf8_scan_scalar(pair, len) == len)) {
+                    disagreements++;
+                }
+            }
+        }
+    }
+    CHECK(disagreements == 0);
+#endif
+}
+
+static void test_keywords_and_literals(void) {
+    ParserContext *ctx = parser_init(false);
+    CHECK(config_define_literal(ctx, "on", create_bool_value(true)) == 0);
+    CHECK(config_define_literal(ctx, "none", parse_value("0")) == 0);
+    CHECK(parse_string(ctx, "a = yes\nb = FALSE\nc = on\nd = none\ne = onn\n"
+                            "f = [on, off]\n") == 0);
+
+    CHECK(get_value(ctx, "a")->type == TYPE_BOOLEAN && get_value(ctx, "a")->data.bool_val);
+    CHECK(get_value(ctx, "b")->type == TYPE_BOOLEAN && !get_value(ctx, "b")->data.bool_val);
+    CHECK(get_value(ctx, "c")->type == TYPE_BOOLEAN && get_value(ctx, "c")->data.bool_val);
+    CHECK(get_value(ctx, "d")->type == TYPE_INTEGER);
+    CHECK(get_value(ctx, "e")->type == TYPE_STRING);
+    CHECK(get_value(ctx, "f")->data.array_val.element_type == TYPE_ARRAY);
+    parser_free(ctx);
+}
+
+/* ========================================================================
+ * Typed values
+ * ======================================================================== */
+
+static void test_duration_and_size_literals(void) {
+    ParserContext *ctx = parse_text(
+        "timeout = 1h30m\nshort = 250ms\nbuffer = 512MB\nsmall = 1KB\n"
+        "odd = 5 parsecs\nlist = [1s, 2s]\n");
+    CHECK(get_duration(ctx, "timeout", 0) == (90LL * 60) * 1000000000LL);
+    CHECK(get_duration(ctx, "short", 0) == 250LL * 1000000);
+    CHECK(get_size(ctx, "buffer", 0) == 512LL << 20);
+    CHECK(get_size(ctx, "small", 0) == 1024);
+    CHECK(get_value(ctx, "odd")->type == TYPE_STRING);
+    CHECK(get_value(ctx, "list")->data.array_val.element_type == TYPE_ARRAY);
+
+    // Serialized values read back as the same value
+    char buffer[64];
+    format_unit_literal(buffer, sizeof(buffer), TYPE_DURATION, get_duration(ctx, "timeout", 0));
+    int64_t round_trip = 0;
+    CHECK(scan_duration(buffer, &round_trip) && round_trip == get_duration(ctx, "timeout", 0));
+    parser_free(ctx);
+}
+
+/* Decimal literals decode exactly as strtoll does, overflow included */
+static void test_integers_against_strtoll(void) {
+    size_t bad = 0;
+    char text[64];
+    for (int i = 0; i < 200000; i++) {
+        // Random digit strings around the int64_t boundary, and random values
+        if (i % 2) {
+            int digits = 1 + (int)(rng_next() % 21);
+            size_t len = 0;
+            if (rng_next() % 2) text[len++] = rng_next() % 2 ? '-' : '+';
+            for (int d = 0; d < digits; d++) {
+                text[len++] = (char)('0' + (d == 0 && digits > 1 ? 1 + rng_next() % 9 :
+                                            rng_next() % 10));
+            }
+            text[len] = '\0';
+        } else {
+            snprintf(text, sizeof(text), "%" PRId64, (int64_t)rng_next());
+        }
+
+        errno = 0;
+        char *end;
+        long long expected = strtoll(text, &end, 10);
+        int expected_result = errno == ERANGE ? -1 : 1;
+
+        int64_t value = 0;
+        int result = scan_integer(text, &value);
+        if (result != expected_result || (result == 1 && value != expected)) bad++;
+    }
+    CHECK(bad == 0);
+}
+
+/* Append digits of magnitude in base (2, 8 or 16), separated at random */
+static size_t append_digits(char *out, uint64_t magnitude, unsigned base, bool separators) {
+    char digits[80];
+    size_t count = 0;
+    do {
+        digits[count++] = "0123456789abcdef"[magnitude % base];
+        magnitude /= base;
+    } while (magnitude);
+
+    size_t len = 0;
+    while (count) {
+        out[len++] = digits[--count];
+        if (separators && count && rng_next() % 4 == 0) out[len++] = '_';
+    }
+    return len;
+}
+
+/* Prefixed literals with separators decode to the value they spell */
+static void test_prefixed_integers(void) {
+    static const struct { unsigned base; const char *prefix; } bases[] = {
+        {16, "0x"}, {8, "0o"}, {2, "0b"}, {10, ""},
+    };
+    size_t bad = 0;
+    char text[160];
+    for (int i = 0; i < 100000; i++) {
+        unsigned pick = (unsigned)(rng_next() % 4);
+        unsigned base = bases[pick].base;
+        uint64_t magnitude = rng_next() >> (rng_next() % 64);
+        bool negative = rng_next() % 2;
+        bool wide = rng_next() % 8 == 0;    // one more leading digit than fits
+
+        size_t len = 0;
+        if (negative) text[len++] = '-';
+        len += (size_t)sprintf(text + len, "%s", bases[pick].prefix);
+        if (wide) {
+            text[len++] = '1';
+            if (rng_next() % 2) text[len++] = '_';
+            len += append_digits(text + len, UINT64_MAX, base, true);
+        } else {
+            len += append_digits(text + len, magnitude, base, true);
+        }
+        text[len] = '\0';
+
+        int64_t value = 0;
+        int result = scan_integer(text, &value);
+        uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+        if (wide || magnitude > limit) {
+            if (result != -1) bad++;
+        } else {
+            int64_t expected = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+            if (result != 1 || value != expected) bad++;
+        }
+    }
+    CHECK(bad == 0);
+
+    static const char *not_integers[] = {
+        "_1", "1_", "1__0", "0x", "0x_1", "0b2", "0o8", "0xg", "--1", "1e3", "", "-",
+    };
+    for (size_t i = 0; i < sizeof(not_integers) / sizeof(not_integers[0]); i++) {
+        int64_t value;
+        if (scan_integer(not_integers[i], &value) != 0) {
+            fprintf(stderr, "  accepted '%s'\n", not_integers[i]);
+            bad++;
+        }
+    }
+    CHECK(bad == 0);
+
+    ParserContext *ctx = parse_text(
+        "min = -0x8000_0000_0000_0000\nmax = 9_223_372_036_854_775_807\n"
+        "over = 9223372036854775808\nbits = 0b1010\nmode = 0o755\nmask = 0XfF\n");
+    CHECK(get_int(ctx, "min", 0) == INT64_MIN && get_int(ctx, "max", 0) == INT64_MAX);
+    CHECK(get_int(ctx, "bits", 0) == 10 && get_int(ctx, "mode", 0) == 0755);
+    CHECK(get_int(ctx, "mask", 0) == 0xff);
+    CHECK(get_value(ctx, "over")->type == TYPE_STRING);
+
+    // The extremes survive serialization
+    StrBuf sb = {NULL, 0, 0};
+    strbuf_append_literal(&sb, get_value(ctx, "min"), NULL);
+    ConfigValue *again = parse_value(sb.data);
+    CHECK(again && again->type == TYPE_INTEGER && again->data.int_val == INT64_MIN);
+    free_value(again);
+    free(sb.data);
+    parser_free(ctx);
+
+    ctx = parser_init(true);
+    CHECK(parse_string(ctx, "over = -9223372036854775809\n") < 0);
+    CHECK(strstr(get_error(ctx), "out of range") != NULL);
+    parser_free(ctx);
+}
+
+/* Decoded timestamps agree with timegm for random instants */
+static void test_timestamps_against_timegm(void) {
+    size_t bad = 0;
+    for (int i = 0; i < 20000; i++) {
+        time_t seconds = (time_t)(rng_next() % 8000000000ULL) - 2000000000LL;
+        struct tm tm;
+        gmtime_r(&seconds, &tm);
+        char text[64];
+        strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+        int64_t decoded = 0;
+        if (!scan_timestamp(text, strlen(text), &decoded) ||
+            decoded != (int64_t)timegm(&tm) * 1000000000LL) {
+            bad++;
+        }
+
+        char formatted[64];
+        format_timestamp(formatted, sizeof(formatted), decoded);
+        int64_t again = 0;
+        if (!scan_timestamp(formatted, strlen(formatted), &again) || again != decoded) bad++;
+    }
+    CHECK(bad == 0);
+
+    ParserContext *ctx = parse_text("at = 2024-02-29T12:00:00.5+02:00\nbad = 2023-02-29\n");
+    CHECK(get_timestamp(ctx, "at", 0) == 1709200800LL * 1000000000LL + 500000000LL);
+    CHECK(get_value(ctx, "bad")->type == TYPE_STRING);
+    parser_free(ctx);
+}
+
+static void test_cached_coercion(void) {
+    ParserContext *ctx = parse_text("port = \"8080\"\nratio = 3\nflag = \"yes\"\nname = abc\n");
+    int64_t port = 0;
+    double ratio = 0;
+    bool flag = false;
+
+    // Off by default: a string is not an integer
+    CHECK(config_get_int(ctx, "port", &port) == CONFIG_TYPE_MISMATCH);
+
+    ctx->coerce_values = true;
+    CHECK(config_get_int(ctx, "port", &port) == CONFIG_OK && port == 8080);
+    ConfigEntry *entry = find_entry(ctx, NULL, "port", true);
+    CHECK(entry->coerce_state == COERCE_READY(TYPE_INTEGER));
+    CHECK(config_get_int(ctx, "port", &port) == CONFIG_OK && port == 8080);
+    CHECK(config_get_float(ctx, "ratio", &ratio) == CONFIG_OK && ratio == 3.0);
+    CHECK(config_get_bool(ctx, "flag", &flag) == CONFIG_OK && flag);
+    CHECK(config_get_int(ctx, "name", &port) == CONFIG_COERCE_FAILED);
+    CHECK(config_get_int(ctx, "missing", &port) == CONFIG_NOT_FOUND);
+
+    // Only the first coerced type is cached; others are still converted
+    CHECK(config_get_float(ctx, "port", &ratio) == CONFIG_OK && ratio == 8080.0);
+    CHECK(entry->coerce_state == COERCE_READY(TYPE_INTEGER));
+
+    // A new value drops the cached coercion
+    CHECK(config_set(ctx, NULL, "port", create_string_value("9090")) == 0);
+    CHECK(get_int(ctx, "port", 0) == 9090);
+    parser_free(ctx);
+}
+
+typedef struct {
+    ParserContext *ctx;
+    size_t wrong;
+} CoerceJob;
+
+static void* coerce_keys(void *arg) {
+    CoerceJob *job = (CoerceJob*)arg;
+    char key[32];
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 500; i++) {
+            snprintf(key, sizeof(key), "k%d", i);
+            int64_t value = -1;
+            double real = -1;
+            if (config_get_int(job->ctx, key, &value) != CONFIG_OK || value != i * 1000003) {
+                job->wrong++;
+            }
+            if (config_get_float(job->ctx, key, &real) != CONFIG_OK || real != i * 1000003.0) {
+                job->wrong++;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Readers racing to fill the coercion cache all see whole values */
+static void test_concurrent_coercion(void) {
+    StrBuf sb = {NULL, 0, 0};
+    char line[64];
+    for (int i = 0; i < 500; i++) {
+        int len = snprintf(line, sizeof(line), "k%d = \"%d\"\n", i, i * 1000003);
+        strbuf_append(&sb, line, len);
+    }
+    ParserContext *ctx = parse_text(sb.data);
+    free(sb.data);
+    ctx->coerce_values = true;
+
+    CoerceJob jobs[4];
+    pthread_t threads[4];
+    for (int t = 0; t < 4; t++) {
+        jobs[t] = (CoerceJob){ctx, 0};
+        pthread_create(&threads[t], NULL, coerce_keys, &jobs[t]);
+    }
+    for (int t = 0; t < 4; t++) {
+        pthread_join(threads[t], NULL);
+        CHECK(jobs[t].wrong == 0);
+    }
+    parser_free(ctx);
+}
+
+/* ========================================================================
+ * Keys: case folding and duplicates
+ * ======================================================================== */
+
+static void test_case_insensitive_keys(void) {
+    ParserContext *ctx = parser_init(false);
+    ctx->case_insensitive = true;
+    CHECK(parse_string(ctx, "[Server]\nHTTP.Port = 80\n") == 0);
+    CHECK(int_in(ctx, "server", "http.port") == 80);
+    CHECK(int_in(ctx, "SERVER", "Http.PORT") == 80);
+
+    ConfigCursor cursor;
+    CHECK(config_prefix_scan(ctx, "SERVER.HTTP", &cursor) == 0 &&
+          config_cursor_count(&cursor) == 1);
+
+    ConfigSnapshot snapshot;
+    CHECK(config_snapshot_acquire(ctx, &snapshot) == 0);
+    CHECK(config_snapshot_get(&snapshot, "sErVeR", "http.port") != NULL);
+    config_snapshot_release(&snapshot);
+    parser_free(ctx);
+
+    ctx = parse_text("[Server]\nPort = 80\n");
+    CHECK(get_value_in_section(ctx, "server", "port") == NULL);
+    parser_free(ctx);
+}
+
+static ParserContext* parse_with_policy(ConfigDuplicatePolicy policy, const char *text) {
+    ParserContext *ctx = parser_init(false);
+    ctx->duplicate_policy = policy;
+    parse_string(ctx, text);
+    return ctx;
+}
+
+static void test_duplicate_policies(void) {
+    const char *text = "[a]\nx = 1\ny = ${a.x}\nx = 2\nx = 3\n";
+
+    ParserContext *ctx = parse_with_policy(CONFIG_DUP_KEEP_ALL, text);
+    CHECK(ctx->entry_count == 4 && int_in(ctx, "a", "x") == 1);
+    parser_free(ctx);
+
+    ctx = parse_with_policy(CONFIG_DUP_FIRST_WINS, text);
+    CHECK(ctx->entry_count == 2 && int_in(ctx, "a", "x") == 1);
+    parser_free(ctx);
+
+    ctx = parse_with_policy(CONFIG_DUP_LAST_WINS, text);
+    CHECK(ctx->entry_count == 2 && int_in(ctx, "a", "x") == 3);
+    CHECK(streq(string_in(ctx, "a", "y"), "3"));
+    CHECK(ctx->retired == NULL);    // repeats within a parse are overwritten in place
+    parser_free(ctx);
+
+    ctx = parse_with_policy(CONFIG_DUP_LAST_WINS, "[a]\nz = 5\nx = ${a.z}\nx = 7\n");
+    CHECK(int_in(ctx, "a", "x") == 7 && ctx->interpolated_count == 0);
+    parser_free(ctx);
+
+    ctx = parse_with_policy(CONFIG_DUP_ERROR, text);
+    CHECK(strstr(get_error(ctx), "Duplicate") != NULL);
+    parser_free(ctx);
+
+    ctx = parse_with_policy(CONFIG_DUP_COLLECT, text);
+    ConfigValue *x = get_value_in_section(ctx, "a", "x");
+    CHECK(ctx->entry_count == 2);
+    CHECK(x && x->type == TYPE_ARRAY && x->data.array_val.count == 3 &&
+          (x->flags & VALUE_FLAG_COLLECTED));
+    CHECK(ctx->retired == NULL);
+    parser_free(ctx);
+}
+
+/* A repeat parsed into a context replaces versions, like config_set */
+static void test_duplicates_under_snapshot(void) {
+    ConfigDuplicatePolicy policies[] = {CONFIG_DUP_LAST_WINS, CONFIG_DUP_COLLECT};
+    for (int i = 0; i < 2; i++) {
+        ParserContext *ctx = parse_with_policy(policies[i], "[a]\nname = \"first value\"\n");
+        ConfigSnapshot snapshot;
+        CHECK(config_snapshot_acquire(ctx, &snapshot) == 0);
+
+        CHECK(parse_string(ctx, "[a]\nname = \"second value\"\nname = \"third\"\n") == 0);
+        ConfigValue *pinned = config_snapshot_get(&snapshot, "a", "name");
+        CHECK(pinned && pinned->type == TYPE_STRING &&
+              streq(pinned->data.string_val, "first value"));
+        CHECK(ctx->entry_count == 1);
+        config_snapshot_release(&snapshot);
+
+        ConfigValue *live = get_value_in_section(ctx, "a", "name");
+        if (policies[i] == CONFIG_DUP_LAST_WINS) {
+            CHECK(live && live->type == TYPE_STRING && streq(live->data.string_val, "third"));
+        } else {
+            CHECK(live && live->type == TYPE_ARRAY && live->data.array_val.count == 3);
+        }
+        parser_free(ctx);
+    }
+}
+
+static void test_entry_limit(void) {
+    ParserContext *ctx = parser_init(false);
+    ctx->max_entries = 2;
+    CHECK(parse_string(ctx, "a = 1\nb = 2\nc = 3\n") < 0);
+    CHECK(config_set(ctx, NULL, "d", create_int_value(4)) < 0);
+    parser_free(ctx);
+
+    // The default leaves room for far more than the old fixed cap of 1000
+    ctx = parser_init(false);
+    char *text = generated_config(4, 2000);
+    CHECK(parse_string(ctx, text) == 0);
+    free(text);
+    parser_free(ctx);
+}
+
+/* ========================================================================
+ * Runner
+ * ======================================================================== */
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} TestCase;
+
+static const TestCase tests[] = {
+    {"index_matches_list_scan", test_index_matches_list_scan},
+    {"interpolation_memoized", test_interpolation_memoized},
+    {"prefix_scan_sorted", test_prefix_scan_sorted},
+    {"prefix_scan_across_sets", test_prefix_scan_across_sets},
+    {"tree_paths", test_tree_paths},
+    {"freeze_packs_entries", test_freeze_packs_entries},
+    {"freeze_releases_storage", test_freeze_releases_storage},
+    {"interned_values_shared", test_interned_values_shared},
+    {"borrowed_large_values", test_borrowed_large_values},
+    {"borrow_routes_by_content", test_borrow_routes_by_content},
+    {"shm_publication", test_shm_publication},
+    {"shm_image_validation", test_shm_image_validation},
+    {"snapshot_isolation", test_snapshot_isolation},
+    {"snapshot_interpolation", test_snapshot_interpolation},
+    {"journal_round_trip", test_journal_round_trip},
+    {"journal_literals", test_journal_literals},
+    {"reload_delivers_diff", test_reload_delivers_diff},
+    {"reload_keeps_parse_settings", test_reload_keeps_parse_settings},
+    {"reload_with_concurrent_journal", test_reload_with_concurrent_journal},
+    {"diff_and_parallel_parse", test_diff_and_parallel_parse},
+    {"content_hashes", test_content_hashes},
+    {"parse_cache_hit_and_miss", test_parse_cache_hit_and_miss},
+    {"compressed_input", test_compressed_input},
+    {"multiline_values", test_multiline_values},
+    {"string_escapes", test_string_escapes},
+    {"nested_and_mixed_arrays", test_nested_and_mixed_arrays},
+    {"long_array", test_long_array},
+    {"utf8_validation", test_utf8_validation},
+    {"utf8_simd_matches_scalar", test_utf8_simd_matches_scalar},
+    {"keywords_and_literals", test_keywords_and_literals},
+    {"duration_and_size_literals", test_duration_and_size_literals},
+    {"integers_against_strtoll", test_integers_against_strtoll},
+    {"prefixed_integers", test_prefixed_integers},
+    {"timestamps_against_timegm", test_timestamps_against_timegm},
+    {"cached_coercion", test_cached_coercion},
+    {"concurrent_coercion", test_concurrent_coercion},
+    {"case_insensitive_keys", test_case_insensitive_keys},
+    {"duplicate_policies", test_duplicate_policies},
+    {"duplicates_under_snapshot", test_duplicates_under_snapshot},
+    {"entry_limit", test_entry_limit},
+};
+
+int main(int argc, char *argv[]) {
+    if (!mkdtemp(scratch_dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (argc > 1 && !strstr(tests[i].name, argv[1])) continue;
+
+        int before = checks_failed;
+        tests[i].run();
+        bool ok = checks_failed == before;
+        printf("%s %s\n", ok ? "ok  " : "FAIL", tests[i].name);
+        if (!ok) failed++;
+    }
+
+    char command[600];
+    snprintf(command, sizeof(command), "rm -rf %s", scratch_dir);
+    if (system(command) != 0) {
+        fprintf(stderr, "failed to remove %s\n", scratch_dir);
+    }
+
+    printf("%d test(s) failed\n", failed);
+    return failed;
+}